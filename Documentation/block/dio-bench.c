@@ -0,0 +1,200 @@
+/*
+ * dio-bench: O_DIRECT random read or write IOPS on a block device
+ *
+ *	dio-bench [-w] [-v] [-b bs] [-j threads] [-t secs] device
+ *
+ * issues synchronous reads (or writes with -w) of bs bytes at random,
+ * aligned offsets of device from each of the threads and reports the
+ * I/Os per second and their mean latency.
+ *
+ * A single segment of up to four pages is done by the simple direct I/O
+ * path of fs/block_dev.c, which puts the user pages into one bio.  With
+ * -v every I/O is split into two iovecs of half the size, still aligned
+ * to the logical block size, which takes the general __blockdev_direct_IO()
+ * path instead, so that
+ *
+ *	dio-bench /dev/nullb0
+ *	dio-bench -v /dev/nullb0
+ *
+ * compare the two for the same I/O.  null_blk (Documentation/block/
+ * null_blk.txt) shows the software overhead best; with queue_mode=2,
+ * irqmode=2 and io_poll set in its queue directory both paths also
+ * poll for the completion.
+ *
+ * -w overwrites the device.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <linux/fs.h>
+
+static int fd;
+static int do_write, split;
+static size_t bs = 4096;
+static int secs = 10;
+static unsigned long long dev_blocks;
+static volatile int stop;
+
+struct worker {
+	pthread_t thread;
+	unsigned int seed;
+	unsigned long long ios;
+	double busy;
+};
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void fatal(const char *msg)
+{
+	perror(msg);
+	exit(EXIT_FAILURE);
+}
+
+static void *worker_fn(void *arg)
+{
+	struct worker *w = arg;
+	struct iovec iov[2];
+	ssize_t ret;
+	off_t offset;
+	double t;
+	char *buf;
+
+	if (posix_memalign((void **)&buf, 4096, bs))
+		fatal("posix_memalign");
+	memset(buf, 0x5a, bs);
+	iov[0].iov_base = buf;
+	iov[0].iov_len = bs / 2;
+	iov[1].iov_base = buf + bs / 2;
+	iov[1].iov_len = bs / 2;
+
+	while (!stop) {
+		offset = (off_t)(rand_r(&w->seed) % dev_blocks) * bs;
+
+		t = now();
+		if (split)
+			ret = do_write ? pwritev(fd, iov, 2, offset) :
+					 preadv(fd, iov, 2, offset);
+		else
+			ret = do_write ? pwrite(fd, buf, bs, offset) :
+					 pread(fd, buf, bs, offset);
+		w->busy += now() - t;
+
+		if (ret != (ssize_t)bs)
+			fatal(do_write ? "write" : "read");
+		w->ios++;
+	}
+
+	free(buf);
+	return NULL;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-w] [-v] [-b bs] [-j threads] [-t secs] device\n"
+		"  -w          write instead of read, destroys the data\n"
+		"  -v          split every I/O into two iovecs\n"
+		"  -b bs       I/O size in bytes (default 4096)\n"
+		"  -j threads  threads doing I/O (default 1)\n"
+		"  -t secs     run time (default 10)\n", prog);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long long size, ios = 0;
+	struct worker *workers;
+	int threads = 1, lbs, opt, i;
+	double busy = 0, t;
+
+	while ((opt = getopt(argc, argv, "wvb:j:t:")) != -1) {
+		switch (opt) {
+		case 'w':
+			do_write = 1;
+			break;
+		case 'v':
+			split = 1;
+			break;
+		case 'b':
+			bs = strtoul(optarg, NULL, 0);
+			break;
+		case 'j':
+			threads = atoi(optarg);
+			break;
+		case 't':
+			secs = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || threads <= 0)
+		usage(argv[0]);
+
+	fd = open(argv[optind], (do_write ? O_RDWR : O_RDONLY) | O_DIRECT);
+	if (fd < 0)
+		fatal("open");
+	if (ioctl(fd, BLKGETSIZE64, &size))
+		fatal("BLKGETSIZE64");
+	if (ioctl(fd, BLKSSZGET, &lbs))
+		fatal("BLKSSZGET");
+	if (!bs || bs % lbs || (split && (bs / 2) % lbs)) {
+		fprintf(stderr, "%s: I/O size not aligned to the %d byte "
+			"logical blocks%s\n", argv[0], lbs,
+			split ? " once split" : "");
+		return EXIT_FAILURE;
+	}
+	dev_blocks = size / bs;
+	if (!dev_blocks) {
+		fprintf(stderr, "%s: device smaller than an I/O\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	workers = calloc(threads, sizeof(*workers));
+	if (!workers)
+		fatal("calloc");
+
+	t = now();
+	for (i = 0; i < threads; i++) {
+		workers[i].seed = getpid() + i;
+		if (pthread_create(&workers[i].thread, NULL, worker_fn,
+				   &workers[i]))
+			fatal("pthread_create");
+	}
+	sleep(secs);
+	stop = 1;
+	for (i = 0; i < threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		ios += workers[i].ios;
+		busy += workers[i].busy;
+	}
+	t = now() - t;
+
+	printf("%s of %zu bytes, %s, %d thread%s\n",
+	       do_write ? "writes" : "reads", bs,
+	       split ? "two iovecs" : "one iovec", threads,
+	       threads > 1 ? "s" : "");
+	printf("IOPS          %12.0f\n", ios / t);
+	printf("usecs/IO      %12.2f\n", ios ? busy * 1e6 / ios : 0);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,114 @@
+#! /bin/sh
+# Compare the latency of small reads behind background writes across I/O
+# schedulers, with fio, see Documentation/block/flash-iosched.txt.
+#
+#   iosched-bench.sh [-d dev] [-t secs] [-s "sched ..."] [-c usecs] [-o dir]
+#
+# Without -d, null_blk is loaded with a request_fn queue that completes
+# every request after $NULL_NSEC ns, $NULL_DEPTH at a time, which behaves
+# like a small flash device with a fixed service time.  The job writes to
+# the device, its contents are lost.
+
+set -e
+me=`basename $0`
+dev=
+secs=30
+scheds=
+target=
+out=${TMPDIR:-/tmp}/iosched-bench
+NULL_NSEC=${NULL_NSEC:-200000}
+NULL_DEPTH=${NULL_DEPTH:-2}
+
+usage() {
+	echo "usage: $me [-d dev] [-t secs] [-s \"sched ...\"] [-c usecs] [-o dir]" 1>&2
+	exit 1
+}
+
+while getopts "d:t:s:c:o:" opt; do
+	case $opt in
+	d) dev=`basename $OPTARG` ;;
+	t) secs=$OPTARG ;;
+	s) scheds=$OPTARG ;;
+	c) target=$OPTARG ;;
+	o) out=$OPTARG ;;
+	*) usage ;;
+	esac
+done
+
+which fio > /dev/null || {
+	echo "$me: fio not found" 1>&2
+	exit 1
+}
+
+if test -z "$dev"; then
+	modprobe -r null_blk 2> /dev/null || true
+	modprobe null_blk queue_mode=1 irqmode=2 completion_nsec=$NULL_NSEC \
+		hw_queue_depth=$NULL_DEPTH nr_devices=1 gb=4
+	dev=nullb0
+fi
+
+q=/sys/block/$dev/queue
+test -f $q/scheduler || {
+	echo "$me: $dev has no I/O scheduler" 1>&2
+	exit 1
+}
+test -n "$scheds" || scheds=`sed 's/[][]//g' $q/scheduler`
+
+# the foreground reader runs in a blkio cgroup with a latency target
+cgopt=
+if test -n "$target"; then
+	blkio=`awk '$3 == "cgroup" && $4 ~ /blkio/ { print $2; exit }' /proc/mounts`
+	test -n "$blkio" || {
+		echo "$me: the blkio cgroup controller is not mounted" 1>&2
+		exit 1
+	}
+	mkdir -p $blkio/iosched-bench
+	echo $target > $blkio/iosched-bench/blkio.latency_target
+	cgopt="cgroup=iosched-bench"
+fi
+
+mkdir -p $out
+cat > $out/job.fio <<JOB
+[global]
+filename=/dev/$dev
+runtime=$secs
+time_based
+
+; app launch: small random reads, one at a time
+[reader]
+rw=randread
+bs=4k
+direct=1
+ioengine=sync
+$cgopt
+
+; background writeback of large buffered writes
+[writeback]
+rw=write
+bs=128k
+direct=0
+ioengine=sync
+offset=1g
+
+; an application syncing its database
+[fsync]
+rw=randwrite
+bs=4k
+direct=0
+ioengine=sync
+fsync=1
+offset=2g
+size=512m
+JOB
+
+for s in $scheds; do
+	echo $s > $q/scheduler || continue
+	sync
+	echo 3 > /proc/sys/vm/drop_caches
+	fio $out/job.fio > $out/$s.txt
+	echo "=== $s"
+	grep -E "^(reader|writeback|fsync):|^  (read|write) *:| clat \(|99\.00th|99\.90th" \
+		$out/$s.txt
+done
+
+echo "full fio output in $out"
@@ -0,0 +1,298 @@
+/*
+ * memcg-pressure: many memory cgroups competing under global memory pressure
+ *
+ * Creates a number of memory cgroups below the given mount point, each with
+ * the same soft limit, and runs one process in every group that maps a file
+ * of its own and keeps touching its pages.  Together the files are meant to
+ * exceed the memory of the machine, so that kswapd has to take pages from
+ * the groups all the time:
+ *
+ *	memcg-pressure -m /dev/memcg -d /data/tmp -n 50 -s 64 -l 32 -t 60
+ *
+ * When the run is over, the usage and the major faults of every group are
+ * printed together with their spread, and the CPU time kswapd spent and the
+ * reclaim counters of /proc/vmstat.  A fair reclaim leaves all groups with
+ * about the same usage; a slow one shows in the kswapd time and the faults.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <dirent.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define NAME	"memcg-pressure"
+
+static const char *mnt = "/dev/memcg";
+static const char *dir = "/tmp";
+static unsigned int nr_groups = 50;
+static unsigned long size_mb = 64;
+static unsigned long limit_mb = 32;
+static unsigned int nsecs = 30;
+
+static long page_size;
+
+static const char * const counters[] = {
+	"pgscan_kswapd_normal",
+	"pgscan_direct_normal",
+	"pgsteal_normal",
+	"pgmajfault",
+	"kswapd_steal",
+	"allocstall",
+};
+#define NR_COUNTERS	(sizeof(counters) / sizeof(counters[0]))
+
+static void fatal(const char *msg)
+{
+	perror(msg);
+	exit(EXIT_FAILURE);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-m memcg mount] [-d dir] [-n groups] [-s MB] "
+		"[-l MB] [-t secs]\n"
+		"  -m  mount point of the memory cgroup hierarchy "
+		"(default %s)\n"
+		"  -d  directory for the files of the groups (default %s)\n"
+		"  -n  number of cgroups (default %u)\n"
+		"  -s  size of the file mapped in each group (default %lu)\n"
+		"  -l  soft limit of each group (default %lu)\n"
+		"  -t  duration of the run (default %u)\n",
+		prog, mnt, dir, nr_groups, size_mb, limit_mb, nsecs);
+	exit(EXIT_FAILURE);
+}
+
+static void write_file(const char *path, const char *buf)
+{
+	int fd = open(path, O_WRONLY);
+
+	if (fd < 0 || write(fd, buf, strlen(buf)) < 0)
+		fatal(path);
+	close(fd);
+}
+
+static unsigned long long read_value(const char *path, const char *key)
+{
+	unsigned long long val = 0, v;
+	char name[64];
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f)
+		return 0;
+	if (!key) {
+		if (fscanf(f, "%llu", &val) != 1)
+			val = 0;
+	} else {
+		while (fscanf(f, "%63s %llu", name, &v) == 2)
+			if (!strcmp(name, key)) {
+				val = v;
+				break;
+			}
+	}
+	fclose(f);
+	return val;
+}
+
+static void read_vmstat(unsigned long long *vals)
+{
+	unsigned int i;
+
+	for (i = 0; i < NR_COUNTERS; i++)
+		vals[i] = read_value("/proc/vmstat", counters[i]);
+}
+
+/* user and system time of all kswapd threads, in clock ticks */
+static unsigned long long kswapd_ticks(void)
+{
+	unsigned long long total = 0, utime, stime;
+	char path[300], buf[512], *p;
+	struct dirent *de;
+	DIR *proc;
+	FILE *f;
+
+	proc = opendir("/proc");
+	if (!proc)
+		fatal("/proc");
+	while ((de = readdir(proc))) {
+		snprintf(path, sizeof(path), "/proc/%s/stat", de->d_name);
+		f = fopen(path, "r");
+		if (!f)
+			continue;
+		if (fgets(buf, sizeof(buf), f) && strstr(buf, "(kswapd")) {
+			/* utime and stime are fields 14 and 15 */
+			p = strrchr(buf, ')');
+			if (p && sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u "
+					"%*u %*u %*u %*u %llu %llu",
+					&utime, &stime) == 2)
+				total += utime + stime;
+		}
+		fclose(f);
+	}
+	closedir(proc);
+	return total;
+}
+
+static void group_path(char *buf, size_t len, unsigned int i,
+		       const char *file)
+{
+	snprintf(buf, len, "%s/%s-%u%s%s", mnt, NAME, i, file ? "/" : "",
+		 file ? file : "");
+}
+
+/* the work of one group: keep touching the pages of its own file */
+static void child(unsigned int i)
+{
+	size_t len = size_mb << 20;
+	unsigned long nr = len / page_size, n;
+	char path[4096], buf[32];
+	volatile char *map;
+	unsigned int seed = i + 1;
+	int fd;
+
+	group_path(path, sizeof(path), i, "tasks");
+	snprintf(buf, sizeof(buf), "%d\n", getpid());
+	write_file(path, buf);
+
+	snprintf(path, sizeof(path), "%s/%s-%u", dir, NAME, i);
+	fd = open(path, O_RDWR | O_CREAT, 0600);
+	if (fd < 0 || ftruncate(fd, len) < 0)
+		fatal(path);
+	map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		fatal("mmap");
+	close(fd);
+
+	/* populate, then touch at random */
+	for (n = 0; n < nr; n++)
+		map[n * page_size] = 1;
+	for (;;) {
+		n = rand_r(&seed) % nr;
+		map[n * page_size]++;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long before[NR_COUNTERS], after[NR_COUNTERS];
+	unsigned long long ticks, *used, *faults;
+	double sum = 0, sq = 0, mean, dev;
+	unsigned long long min = ~0ULL, max = 0;
+	char path[4096], buf[32];
+	unsigned int i;
+	pid_t *pids;
+	int c;
+
+	while ((c = getopt(argc, argv, "m:d:n:s:l:t:")) != -1) {
+		switch (c) {
+		case 'm':
+			mnt = optarg;
+			break;
+		case 'd':
+			dir = optarg;
+			break;
+		case 'n':
+			nr_groups = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			size_mb = strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			limit_mb = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			nsecs = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!nr_groups || !size_mb)
+		usage(argv[0]);
+	page_size = sysconf(_SC_PAGESIZE);
+
+	pids = calloc(nr_groups, sizeof(*pids));
+	used = calloc(nr_groups, sizeof(*used));
+	faults = calloc(nr_groups, sizeof(*faults));
+	if (!pids || !used || !faults)
+		fatal("calloc");
+
+	for (i = 0; i < nr_groups; i++) {
+		group_path(path, sizeof(path), i, NULL);
+		if (mkdir(path, 0755) < 0 && errno != EEXIST)
+			fatal(path);
+		group_path(path, sizeof(path), i, "memory.soft_limit_in_bytes");
+		snprintf(buf, sizeof(buf), "%lu\n", limit_mb << 20);
+		write_file(path, buf);
+	}
+
+	read_vmstat(before);
+	ticks = kswapd_ticks();
+
+	for (i = 0; i < nr_groups; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0)
+			fatal("fork");
+		if (!pids[i])
+			child(i);
+	}
+	sleep(nsecs);
+
+	for (i = 0; i < nr_groups; i++) {
+		group_path(path, sizeof(path), i, "memory.usage_in_bytes");
+		used[i] = read_value(path, NULL);
+		group_path(path, sizeof(path), i, "memory.stat");
+		faults[i] = read_value(path, "pgmajfault");
+	}
+	ticks = kswapd_ticks() - ticks;
+	read_vmstat(after);
+
+	for (i = 0; i < nr_groups; i++)
+		kill(pids[i], SIGKILL);
+	for (i = 0; i < nr_groups; i++)
+		waitpid(pids[i], NULL, 0);
+
+	printf("%-20s %12s %12s\n", "group", "usage (KB)", "majfaults");
+	for (i = 0; i < nr_groups; i++) {
+		printf("%s-%-5u %12llu %12llu\n", NAME, i, used[i] >> 10,
+		       faults[i]);
+		sum += used[i];
+		sq += (double)used[i] * used[i];
+		if (used[i] < min)
+			min = used[i];
+		if (used[i] > max)
+			max = used[i];
+	}
+	mean = sum / nr_groups;
+	dev = sqrt(sq / nr_groups - mean * mean);
+	printf("\nusage: min %llu KB, max %llu KB, mean %.0f KB, "
+	       "stddev %.1f%%\n", min >> 10, max >> 10, mean / 1024,
+	       mean ? dev * 100 / mean : 0);
+	printf("kswapd: %.2f s of CPU\n",
+	       (double)ticks / sysconf(_SC_CLK_TCK));
+	for (i = 0; i < NR_COUNTERS; i++)
+		printf("%-24s %llu\n", counters[i], after[i] - before[i]);
+
+	for (i = 0; i < nr_groups; i++) {
+		snprintf(path, sizeof(path), "%s/%s-%u", dir, NAME, i);
+		unlink(path);
+		group_path(path, sizeof(path), i, NULL);
+		if (rmdir(path) < 0)
+			perror(path);
+	}
+	return 0;
+}
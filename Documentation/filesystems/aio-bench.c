@@ -0,0 +1,282 @@
+/*
+ * aio-bench: random reads from a file through the native aio interface
+ *
+ *	aio-bench [-d] [-r] [-b bs] [-q depth] [-s batch] [-t secs] file
+ *
+ * keeps depth reads of bs bytes in flight at random, aligned offsets of
+ * file, submitting them batch iocbs per io_submit().  Reads go through the
+ * page cache unless -d opens the file O_DIRECT.  Completions are reaped
+ * with io_getevents(), or with -r straight from the completion ring
+ * mapped in userspace, falling back to io_getevents() only to sleep.
+ *
+ * Reported are the reads per second and the time spent in io_submit().
+ * A buffered read of a page that is not cached only starts the I/O in
+ * io_submit() and is finished from the aio workqueue once the page is
+ * read in, so the submit time should stay well below the read latency.
+ * Drop the page cache before runs that should miss:
+ *
+ *	echo 1 > /proc/sys/vm/drop_caches
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/aio_abi.h>
+
+/* the head of the completion ring, see include/linux/aio.h */
+#define AIO_RING_MAGIC	0xa10a10a1
+
+struct aio_ring {
+	unsigned id;
+	unsigned nr;
+	unsigned head;
+	unsigned tail;
+	unsigned magic;
+	unsigned compat_features;
+	unsigned incompat_features;
+	unsigned header_length;
+	struct io_event events[0];
+};
+
+#define ACCESS_ONCE(x)	(*(volatile typeof(x) *)&(x))
+
+static int io_setup(unsigned nr, aio_context_t *ctx)
+{
+	return syscall(__NR_io_setup, nr, ctx);
+}
+
+static int io_submit(aio_context_t ctx, long nr, struct iocb **iocbs)
+{
+	return syscall(__NR_io_submit, ctx, nr, iocbs);
+}
+
+static int io_getevents(aio_context_t ctx, long min_nr, long nr,
+			struct io_event *events, struct timespec *timeout)
+{
+	return syscall(__NR_io_getevents, ctx, min_nr, nr, events, timeout);
+}
+
+static int io_destroy(aio_context_t ctx)
+{
+	return syscall(__NR_io_destroy, ctx);
+}
+
+/*
+ * Reap up to nr events from the ring without entering the kernel, as
+ * aio_read_evt() does: the tail is read before the events it covers, and
+ * the head is advanced with a compare-and-swap as io_getevents() may be
+ * reaping concurrently.
+ */
+static int ring_reap(aio_context_t ctx, struct io_event *events, int nr)
+{
+	struct aio_ring *ring = (struct aio_ring *)ctx;
+	unsigned old, head, tail;
+	int i = 0;
+
+	while (i < nr) {
+		old = ACCESS_ONCE(ring->head);
+		head = old % ring->nr;
+		tail = ACCESS_ONCE(ring->tail);
+		if (head == tail)
+			break;
+		__sync_synchronize();
+		events[i] = ring->events[head];
+		__sync_synchronize();
+		if (__sync_bool_compare_and_swap(&ring->head, old,
+						 (head + 1) % ring->nr))
+			i++;
+	}
+	return i;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void fatal(const char *msg)
+{
+	perror(msg);
+	exit(EXIT_FAILURE);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-d] [-r] [-b bs] [-q depth] [-s batch] [-t secs] "
+		"file\n"
+		"  -d         O_DIRECT reads\n"
+		"  -r         reap completions from the mapped ring\n"
+		"  -b bs      read size in bytes (default 4096)\n"
+		"  -q depth   reads in flight (default 32)\n"
+		"  -s batch   iocbs per io_submit (default 8)\n"
+		"  -t secs    run time (default 10)\n", prog);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+	size_t bs = 4096;
+	int depth = 32, batch = 8, secs = 10;
+	int direct = 0, ring_reaping = 0;
+	unsigned long long reads = 0, submits = 0, ring_hits = 0, errors = 0;
+	double submit_time = 0, start, t;
+	struct io_event *events;
+	struct iocb *iocbs, **pending;
+	aio_context_t ctx = 0;
+	struct aio_ring *ring;
+	int fd, opt, i, n, nr_pending, inflight = 0;
+	off_t blocks;
+	struct stat st;
+	char *bufs;
+
+	while ((opt = getopt(argc, argv, "drb:q:s:t:")) != -1) {
+		switch (opt) {
+		case 'd':
+			direct = 1;
+			break;
+		case 'r':
+			ring_reaping = 1;
+			break;
+		case 'b':
+			bs = strtoul(optarg, NULL, 0);
+			break;
+		case 'q':
+			depth = atoi(optarg);
+			break;
+		case 's':
+			batch = atoi(optarg);
+			break;
+		case 't':
+			secs = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || !bs || depth <= 0 || batch <= 0)
+		usage(argv[0]);
+	if (batch > depth)
+		batch = depth;
+
+	fd = open(argv[optind], O_RDONLY | (direct ? O_DIRECT : 0));
+	if (fd < 0)
+		fatal("open");
+	if (fstat(fd, &st))
+		fatal("fstat");
+	blocks = st.st_size / bs;
+	if (!blocks) {
+		fprintf(stderr, "%s: file smaller than a read\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (posix_memalign((void **)&bufs, 4096, depth * bs))
+		fatal("posix_memalign");
+	iocbs = calloc(depth, sizeof(*iocbs));
+	pending = calloc(depth, sizeof(*pending));
+	events = calloc(depth, sizeof(*events));
+	if (!iocbs || !pending || !events)
+		fatal("calloc");
+
+	if (io_setup(depth, &ctx))
+		fatal("io_setup");
+	ring = (struct aio_ring *)ctx;
+	if (ring_reaping && ring->magic != AIO_RING_MAGIC) {
+		fprintf(stderr, "%s: no completion ring at the context\n",
+			argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	srandom(getpid());
+	for (i = 0; i < depth; i++) {
+		iocbs[i].aio_fildes = fd;
+		iocbs[i].aio_lio_opcode = IOCB_CMD_PREAD;
+		iocbs[i].aio_buf = (unsigned long)(bufs + i * bs);
+		iocbs[i].aio_nbytes = bs;
+		iocbs[i].aio_data = i;
+		pending[i] = &iocbs[i];
+	}
+	nr_pending = depth;
+
+	start = now();
+	while (now() - start < secs) {
+		/* submit what has been reaped, batch iocbs at a time */
+		while (nr_pending) {
+			n = nr_pending < batch ? nr_pending : batch;
+			for (i = 0; i < n; i++)
+				pending[nr_pending - n + i]->aio_offset =
+					(random() % blocks) * bs;
+			t = now();
+			n = io_submit(ctx, n, &pending[nr_pending - n]);
+			submit_time += now() - t;
+			if (n <= 0) {
+				if (n == 0 || errno == EAGAIN)
+					break;
+				fatal("io_submit");
+			}
+			submits++;
+			nr_pending -= n;
+			inflight += n;
+		}
+
+		n = 0;
+		if (ring_reaping) {
+			n = ring_reap(ctx, events, inflight);
+			ring_hits += n;
+		}
+		if (!n) {
+			n = io_getevents(ctx, 1, inflight, events, NULL);
+			if (n < 0) {
+				if (errno == EINTR)
+					continue;
+				fatal("io_getevents");
+			}
+		}
+
+		for (i = 0; i < n; i++) {
+			if (events[i].res != (long long)bs)
+				errors++;
+			pending[nr_pending++] = &iocbs[events[i].data];
+		}
+		inflight -= n;
+		reads += n;
+	}
+	t = now() - start;
+
+	while (inflight > 0) {
+		n = io_getevents(ctx, 1, inflight, events, NULL);
+		if (n < 0 && errno != EINTR)
+			fatal("io_getevents");
+		if (n > 0)
+			inflight -= n;
+	}
+	io_destroy(ctx);
+
+	printf("%s reads of %zu bytes, depth %d, batch %d\n",
+	       direct ? "direct" : "buffered", bs, depth, batch);
+	printf("reads/s          %12.0f\n", reads / t);
+	printf("MB/s             %12.1f\n", reads * bs / t / (1 << 20));
+	printf("usecs/io_submit  %12.1f\n",
+	       submits ? submit_time * 1e6 / submits : 0);
+	if (ring_reaping)
+		printf("reaped from ring %11.1f%%\n",
+		       reads ? 100.0 * ring_hits / reads : 0);
+	if (errors)
+		printf("short or failed  %12llu\n", errors);
+
+	return EXIT_SUCCESS;
+}
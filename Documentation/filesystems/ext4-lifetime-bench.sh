@@ -0,0 +1,165 @@
+#! /bin/sh
+# Compare fragmentation and an estimate of the flash write amplification of
+# ext4 with and without lifetime separation (mb_lifetime_sep), on a loop
+# device, see "Lifetime separation" in Documentation/filesystems/ext4.txt.
+#
+#   ext4-lifetime-bench.sh [-s MB] [-r rounds] [-e KB] [-o dir]
+#
+# Each round writes a few application data files of mixed sizes and
+# replaces some of those of earlier rounds, one media file, and temporary
+# files that are all deleted again at the end of the round.  The same
+# rounds run on a fresh filesystem of -s MB, first with mb_lifetime_sep=0
+# and then with 1.
+#
+# Afterwards the free space of the filesystem is mapped onto erase blocks
+# of -e KB.  An erase block holding both live and free blocks has to have
+# its live blocks copied before it can be written again, so the estimate of
+# the write amplification is
+#
+#	(blocks written + live blocks in partly free erase blocks) /
+#	blocks written
+#
+# Needs root, losetup, mkfs.ext4, dumpe2fs, filefrag and e2freefrag.
+
+set -e
+me=`basename $0`
+size=512
+rounds=40
+ebkb=512
+out=${TMPDIR:-/tmp}/ext4-lifetime-bench
+
+usage() {
+	echo "usage: $me [-s MB] [-r rounds] [-e KB] [-o dir]" 1>&2
+	exit 1
+}
+
+while getopts "s:r:e:o:" opt; do
+	case $opt in
+	s) size=$OPTARG ;;
+	r) rounds=$OPTARG ;;
+	e) ebkb=$OPTARG ;;
+	o) out=$OPTARG ;;
+	*) usage ;;
+	esac
+done
+
+for p in losetup mkfs.ext4 dumpe2fs filefrag e2freefrag; do
+	which $p > /dev/null || {
+		echo "$me: $p not found" 1>&2
+		exit 1
+	}
+done
+
+mkdir -p $out
+img=$out/fs.img
+mnt=$out/mnt
+mkdir -p $mnt
+
+# the same pseudo random sizes for both runs
+seed=1
+rnd() {
+	seed=$(( (seed * 1103515245 + 12345) % 2147483648 ))
+	echo $(( $1 + seed / 65536 % ($2 - $1 + 1) ))
+}
+
+# write $2 KB to $1
+wr() {
+	dd if=/dev/zero of=$1 bs=4k count=$(( $2 / 4 )) 2> /dev/null
+}
+
+workload() {
+	mkdir -p $mnt/app $mnt/media $mnt/tmp
+	r=0
+	while test $r -lt $rounds; do
+		i=0
+		while test $i -lt 8; do
+			wr $mnt/tmp/$r.$i.tmp `rnd 64 1024`
+			wr $mnt/app/$r.$i.db `rnd 16 256`
+			i=$(( i + 1 ))
+		done
+		wr $mnt/media/$r.mp4 `rnd 2048 8192`
+		# a new version of an older file, written beside it first
+		if test $r -ge 4; then
+			old=$(( r - `rnd 1 4` )).`rnd 0 7`.db
+			if test -f $mnt/app/$old; then
+				wr $mnt/app/$old.tmp `rnd 16 256`
+				mv $mnt/app/$old.tmp $mnt/app/$old
+			fi
+		fi
+		sync
+		rm -f $mnt/tmp/*
+		sync
+		r=$(( r + 1 ))
+	done
+}
+
+run() {
+	sep=$1
+	seed=1
+	dd if=/dev/zero of=$img bs=1M count=0 seek=$size 2> /dev/null
+	mkfs.ext4 -q -F -b 4096 $img
+	loop=`losetup -f --show $img`
+	dev=`basename $loop`
+	mount -t ext4 $loop $mnt
+	echo 1 > /sys/fs/ext4/$dev/mb_stats
+	echo $sep > /sys/fs/ext4/$dev/mb_lifetime_sep
+
+	workload
+
+	written=`cat /sys/fs/ext4/$dev/session_write_kbytes`
+	sed -n '1,5p' /proc/fs/ext4/$dev/mb_lifetime > $out/mb_lifetime.$sep
+	find $mnt -type f | xargs filefrag 2> /dev/null | awk '
+		{ files++; extents += $(NF - 2) }
+		END {
+			printf("files            %10d\n", files)
+			printf("extents/file     %10.2f\n", extents / files)
+		}' > $out/frag.$sep
+	umount $mnt
+	e2freefrag $loop > $out/freefrag.$sep
+	dumpe2fs $loop 2> /dev/null > $out/dumpe2fs.$sep
+	losetup -d $loop
+
+	echo "mb_lifetime_sep=$sep"
+	cat $out/frag.$sep
+	awk '/free extent/' $out/freefrag.$sep
+	awk -v ebkb=$ebkb -v written=$written '
+		/^Block count:/ { nblocks = $3 }
+		/^Block size:/ { bs = $3; per = ebkb * 1024 / bs }
+		/^  Free blocks: / {
+			sub(/^  Free blocks: */, "")
+			n = split($0, r, /, */)
+			for (i = 1; i <= n; i++) {
+				if (split(r[i], ab, "-") == 1)
+					ab[2] = ab[1]
+				for (b = ab[1]; b <= ab[2]; b++)
+					free[int(b / per)]++
+			}
+		}
+		END {
+			neb = int((nblocks + per - 1) / per)
+			for (e = 0; e < neb; e++) {
+				f = free[e] + 0
+				n = e < neb - 1 ? per : nblocks - e * per
+				if (f == 0)
+					full++
+				else if (f >= n)
+					empty++
+				else {
+					mixed++
+					copies += n - f
+				}
+			}
+			host = written * 1024 / bs
+			printf("erase blocks     %10d full %d empty %d mixed\n",
+			       full, empty, mixed)
+			printf("blocks written   %10d\n", host)
+			printf("blocks to copy   %10d\n", copies)
+			printf("write amp. est.  %10.2f\n", (host + copies) / host)
+		}' $out/dumpe2fs.$sep
+	cat $out/mb_lifetime.$sep
+	echo
+}
+
+run 0
+run 1
+rm -f $img
@@ -0,0 +1,308 @@
+/*
+ * lru-gen-bench: reproducible memory pressure for comparing page reclaim
+ *
+ * Maps a file and an anonymous region which together should exceed the
+ * available memory and touches their pages following a fixed pseudo
+ * random pattern: a hot set gets most of the accesses, the rest is cold.
+ * Once the run is over, the deltas of the reclaim counters in /proc/vmstat
+ * are printed, most importantly the major faults, i.e. the pages that were
+ * reclaimed and had to be read back.  Running it with the same arguments
+ * on kernels with and without CONFIG_LRU_GEN compares how well they keep
+ * the hot set in memory:
+ *
+ *	lru-gen-bench -f /data/bench.img -F 512 -a 256 -t 60
+ *
+ * The file is created and filled if it is shorter than requested; drop
+ * the page cache before each run to start from the same state.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+#define _LARGEFILE64_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+static const char *file_path;
+static unsigned long file_mb = 256;
+static unsigned long anon_mb = 128;
+static unsigned int hot_percent = 10;	/* share of the pages that is hot */
+static unsigned int hot_access = 90;	/* share of the accesses going there */
+static unsigned int nsecs = 30;
+static unsigned int nprocs = 1;
+static unsigned int seed = 1;
+
+static long page_size;
+
+/* counters compared between runs, summed over the per zone variants */
+static const char * const counters[] = {
+	"pgmajfault",
+	"pswpin",
+	"pswpout",
+	"pgpgin",
+	"pgscan_kswapd",
+	"pgscan_direct",
+	"pgsteal",
+	"lru_gen_aging",
+	"lru_gen_walk",
+	"lru_gen_young",
+	"workingset_refault",
+	"workingset_activate",
+};
+#define NR_COUNTERS	(sizeof(counters) / sizeof(counters[0]))
+
+static void fatal(const char *msg)
+{
+	perror(msg);
+	exit(EXIT_FAILURE);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s -f file [options]\n"
+		"  -f path    file to map, created if needed\n"
+		"  -F mb      size of the file mapping (default %lu)\n"
+		"  -a mb      size of the anonymous mapping (default %lu)\n"
+		"  -H pct     percentage of pages that are hot (default %u)\n"
+		"  -A pct     percentage of accesses to hot pages (default %u)\n"
+		"  -t secs    duration of the run (default %u)\n"
+		"  -n procs   number of processes (default %u)\n"
+		"  -s seed    seed of the access pattern (default %u)\n",
+		prog, file_mb, anon_mb, hot_percent, hot_access, nsecs,
+		nprocs, seed);
+	exit(EXIT_FAILURE);
+}
+
+static void read_vmstat(unsigned long long *vals)
+{
+	char name[64];
+	unsigned long long val;
+	unsigned int i;
+	FILE *f;
+
+	memset(vals, 0, NR_COUNTERS * sizeof(*vals));
+
+	f = fopen("/proc/vmstat", "r");
+	if (!f)
+		fatal("/proc/vmstat");
+
+	while (fscanf(f, "%63s %llu", name, &val) == 2) {
+		for (i = 0; i < NR_COUNTERS; i++) {
+			size_t len = strlen(counters[i]);
+
+			/* pgscan_kswapd_normal etc. are summed up */
+			if (!strncmp(name, counters[i], len) &&
+			    (name[len] == '\0' || name[len] == '_'))
+				vals[i] += val;
+		}
+	}
+	fclose(f);
+}
+
+static char *map_file(size_t size)
+{
+	struct stat st;
+	char *buf, *p;
+	int fd;
+
+	fd = open(file_path, O_RDWR | O_CREAT, 0644);
+	if (fd < 0)
+		fatal(file_path);
+	if (fstat(fd, &st))
+		fatal("fstat");
+
+	if ((size_t)st.st_size < size) {
+		size_t off;
+
+		/* fill it so that reads are not satisfied by holes */
+		buf = malloc(page_size);
+		if (!buf)
+			fatal("malloc");
+		for (off = 0; off < size; off += page_size) {
+			memset(buf, (int)(off / page_size), page_size);
+			if (pwrite(fd, buf, page_size, off) != page_size)
+				fatal("pwrite");
+		}
+		free(buf);
+		if (fsync(fd))
+			fatal("fsync");
+	}
+
+	p = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED)
+		fatal("mmap file");
+	close(fd);
+
+	return p;
+}
+
+static inline unsigned int next_rand(unsigned int *state)
+{
+	*state = *state * 1103515245 + 12345;
+	return *state >> 1;
+}
+
+/* pick a page out of nr_pages, hot_percent of which are hot */
+static unsigned long pick_page(unsigned int *state, unsigned long nr_pages)
+{
+	unsigned long nr_hot = nr_pages * hot_percent / 100;
+	unsigned long r = next_rand(state);
+
+	if (!nr_hot || nr_hot == nr_pages)
+		return r % nr_pages;
+	if (next_rand(state) % 100 < hot_access)
+		return r % nr_hot;
+	return nr_hot + r % (nr_pages - nr_hot);
+}
+
+static volatile sig_atomic_t done;
+
+static void alarm_handler(int sig)
+{
+	done = 1;
+}
+
+static void worker(unsigned int id, const char *file, int fd)
+{
+	unsigned long nr_file = (file_mb << 20) / page_size;
+	unsigned long nr_anon = (anon_mb << 20) / page_size;
+	unsigned long long accesses = 0;
+	unsigned int state = seed + id * 7919;
+	unsigned long i;
+	volatile char sink;
+	char *anon = NULL;
+
+	if (nr_anon) {
+		anon = mmap(NULL, nr_anon * page_size, PROT_READ | PROT_WRITE,
+			    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (anon == MAP_FAILED)
+			fatal("mmap anon");
+		for (i = 0; i < nr_anon; i++)
+			anon[i * page_size] = (char)i;
+	}
+
+	signal(SIGALRM, alarm_handler);
+	alarm(nsecs);
+
+	while (!done) {
+		/* files and anon get accessed in proportion to their sizes */
+		unsigned long n = next_rand(&state) % (nr_file + nr_anon);
+
+		if (n < nr_file) {
+			sink = file[pick_page(&state, nr_file) * page_size];
+		} else {
+			i = pick_page(&state, nr_anon);
+			anon[i * page_size]++;
+		}
+		accesses++;
+	}
+	(void)sink;
+
+	if (write(fd, &accesses, sizeof(accesses)) != sizeof(accesses))
+		fatal("write");
+	exit(EXIT_SUCCESS);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long before[NR_COUNTERS], after[NR_COUNTERS];
+	unsigned long long accesses = 0, n;
+	struct timeval start, stop;
+	double secs;
+	unsigned int i;
+	char *file;
+	int pfd[2];
+	int c;
+
+	while ((c = getopt(argc, argv, "f:F:a:H:A:t:n:s:")) != -1) {
+		switch (c) {
+		case 'f':
+			file_path = optarg;
+			break;
+		case 'F':
+			file_mb = strtoul(optarg, NULL, 0);
+			break;
+		case 'a':
+			anon_mb = strtoul(optarg, NULL, 0);
+			break;
+		case 'H':
+			hot_percent = strtoul(optarg, NULL, 0);
+			break;
+		case 'A':
+			hot_access = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			nsecs = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			nprocs = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (!file_path || !file_mb || !nsecs || !nprocs ||
+	    hot_percent > 100 || hot_access > 100)
+		usage(argv[0]);
+
+	page_size = sysconf(_SC_PAGESIZE);
+	file = map_file(file_mb << 20);
+
+	if (pipe(pfd))
+		fatal("pipe");
+
+	read_vmstat(before);
+	gettimeofday(&start, NULL);
+
+	for (i = 0; i < nprocs; i++) {
+		switch (fork()) {
+		case -1:
+			fatal("fork");
+		case 0:
+			close(pfd[0]);
+			worker(i, file, pfd[1]);
+		}
+	}
+	close(pfd[1]);
+
+	while (read(pfd[0], &n, sizeof(n)) == sizeof(n))
+		accesses += n;
+	while (wait(NULL) > 0)
+		;
+
+	gettimeofday(&stop, NULL);
+	read_vmstat(after);
+
+	secs = (stop.tv_sec - start.tv_sec) +
+	       (stop.tv_usec - start.tv_usec) / 1e6;
+
+	printf("# %u procs, %lu MB file, %lu MB anon each, %u%% hot pages "
+	       "get %u%% of the accesses, seed %u\n", nprocs, file_mb,
+	       anon_mb, hot_percent, hot_access, seed);
+	printf("%-16s %14llu\n", "accesses", accesses);
+	printf("%-16s %14.0f\n", "accesses/sec", accesses / secs);
+	for (i = 0; i < NR_COUNTERS; i++)
+		printf("%-16s %14llu\n", counters[i], after[i] - before[i]);
+	printf("%-16s %14.3f\n", "majfault/1k acc",
+	       accesses ? (after[0] - before[0]) * 1000.0 / accesses : 0.0);
+
+	return 0;
+}
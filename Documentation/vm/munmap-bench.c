@@ -0,0 +1,142 @@
+/*
+ * munmap-bench: throughput of tearing down large mappings
+ *
+ * Maps and populates an anonymous region of the given size, the way media
+ * buffers are, and times the munmap() of it, over a number of rounds.
+ * Helper threads spin on the other CPUs so that the address space is live
+ * there and every TLB invalidate has to reach them, as it has in a real
+ * multi-threaded application:
+ *
+ *	munmap-bench -s 64 -n 100 -t 3
+ *
+ * On ARM the TLB invalidation of the unmapped range switches to a flush by
+ * ASID past /sys/module/kernel/parameters/tlb_range_flush_ceiling pages;
+ * running with different values of it shows where the crossover is for
+ * a given CPU.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/mman.h>
+
+static unsigned long size_mb = 64;
+static unsigned int rounds = 100;
+static int nthreads = -1;		/* default: one per other CPU */
+
+static volatile int stop;
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-s MB] [-n rounds] [-t threads]\n"
+		"  -s  size of the mapping (default %lu)\n"
+		"  -n  number of map/unmap rounds (default %u)\n"
+		"  -t  helper threads keeping other CPUs in the mm "
+		"(default: CPUs - 1)\n", prog, size_mb, rounds);
+	exit(EXIT_FAILURE);
+}
+
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void *spin(void *arg)
+{
+	long cpu = (long)arg;
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	sched_setaffinity(0, sizeof(set), &set);
+	while (!stop)
+		sched_yield();
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	double t, total = 0, min = 1e30, max = 0;
+	long page_size = sysconf(_SC_PAGESIZE);
+	size_t len, off;
+	pthread_t *threads;
+	unsigned int i;
+	char *map;
+	int c;
+
+	while ((c = getopt(argc, argv, "s:n:t:")) != -1) {
+		switch (c) {
+		case 's':
+			size_mb = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			rounds = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			nthreads = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!size_mb || !rounds)
+		usage(argv[0]);
+	if (nthreads < 0)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+	len = size_mb << 20;
+
+	threads = calloc(nthreads + 1, sizeof(*threads));
+	if (!threads) {
+		perror("calloc");
+		return EXIT_FAILURE;
+	}
+	for (i = 0; i < (unsigned int)nthreads; i++)
+		if (pthread_create(&threads[i], NULL, spin, (void *)(long)(i + 1))) {
+			perror("pthread_create");
+			return EXIT_FAILURE;
+		}
+
+	for (i = 0; i < rounds; i++) {
+		map = mmap(NULL, len, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (map == MAP_FAILED) {
+			perror("mmap");
+			return EXIT_FAILURE;
+		}
+		for (off = 0; off < len; off += page_size)
+			map[off] = 1;
+
+		t = now_us();
+		munmap(map, len);
+		t = now_us() - t;
+
+		total += t;
+		if (t < min)
+			min = t;
+		if (t > max)
+			max = t;
+	}
+
+	stop = 1;
+	for (i = 0; i < (unsigned int)nthreads; i++)
+		pthread_join(threads[i], NULL);
+
+	printf("munmap of %lu MB, %u rounds, %d helper threads\n",
+	       size_mb, rounds, nthreads);
+	printf("avg %.0f us, min %.0f us, max %.0f us, %.0f MB/s\n",
+	       total / rounds, min, max, size_mb * rounds / (total / 1e6));
+	return 0;
+}
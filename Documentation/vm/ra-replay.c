@@ -0,0 +1,304 @@
+/*
+ * ra-replay: record the file reads of a boot or an application launch and
+ * replay them as readahead the next time
+ *
+ * Recording works from the readahead:mm_readahead trace event, which is
+ * emitted for every range the readahead code reads from disk, including
+ * read-around for mmap faults.  Enable it from the start, e.g. with
+ * "trace_event=readahead:mm_readahead trace_buf_size=4M" on the kernel
+ * command line for a boot, or for a launch:
+ *
+ *	echo 1 > /sys/kernel/debug/tracing/events/readahead/mm_readahead/enable
+ *	(start the application, wait until it is up)
+ *	echo 0 > /sys/kernel/debug/tracing/events/readahead/mm_readahead/enable
+ *	ra-replay record -r /system < /sys/kernel/debug/tracing/trace > app.ra
+ *
+ * The inodes in the trace are looked up below the directories given with
+ * -r (default /) and the ranges read from each file merged; the list is
+ * written in the order the files were first read.  Replaying it
+ *
+ *	ra-replay replay app.ra
+ *
+ * issues readahead(2) for every range so that the launch finds its pages
+ * in the page cache.  Comparing the readahead_sync and readahead_async
+ * counters of /proc/vmstat across a launch with and without the replay
+ * shows how many misses it saved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+#define _XOPEN_SOURCE 500
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <ftw.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/types.h>
+
+#define HASH_SIZE	4096
+
+struct extent {
+	unsigned long start;
+	unsigned long end;		/* exclusive, in pages */
+};
+
+struct file {
+	struct file *hash_next;
+	unsigned int major, minor;
+	unsigned long ino;
+	char *path;
+	struct extent *extents;
+	unsigned int nr_extents, max_extents;
+};
+
+static struct file *hash[HASH_SIZE];
+static struct file **files;
+static unsigned int nr_files, max_files;
+static unsigned int nr_resolved;
+
+static long page_size;
+
+static void fatal(const char *msg)
+{
+	perror(msg);
+	exit(EXIT_FAILURE);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s record [-r root]... < trace > list\n"
+		"       %s replay [list]\n"
+		"  -r dir     directory below which inodes are looked up "
+		"(default /)\n", prog, prog);
+	exit(EXIT_FAILURE);
+}
+
+static void *xrealloc(void *p, size_t size)
+{
+	p = realloc(p, size);
+	if (!p)
+		fatal("realloc");
+	return p;
+}
+
+static unsigned int hash_key(unsigned int major, unsigned int minor,
+			     unsigned long ino)
+{
+	return (ino ^ (major << 20) ^ minor) % HASH_SIZE;
+}
+
+static struct file *lookup_file(unsigned int major, unsigned int minor,
+				unsigned long ino, int create)
+{
+	unsigned int key = hash_key(major, minor, ino);
+	struct file *f;
+
+	for (f = hash[key]; f; f = f->hash_next)
+		if (f->ino == ino && f->major == major && f->minor == minor)
+			return f;
+	if (!create)
+		return NULL;
+
+	f = calloc(1, sizeof(*f));
+	if (!f)
+		fatal("calloc");
+	f->major = major;
+	f->minor = minor;
+	f->ino = ino;
+	f->hash_next = hash[key];
+	hash[key] = f;
+
+	if (nr_files == max_files) {
+		max_files = max_files ? max_files * 2 : 256;
+		files = xrealloc(files, max_files * sizeof(*files));
+	}
+	files[nr_files++] = f;
+	return f;
+}
+
+/* add [start, end) to the extents of @f, merging with the ones it touches */
+static void add_extent(struct file *f, unsigned long start, unsigned long end)
+{
+	unsigned int i, j;
+
+	for (i = 0; i < f->nr_extents; i++) {
+		struct extent *e = &f->extents[i];
+
+		if (end < e->start || start > e->end)
+			continue;
+		if (start < e->start)
+			e->start = start;
+		if (end > e->end)
+			e->end = end;
+
+		/* it may now reach into later extents */
+		for (j = i + 1; j < f->nr_extents; ) {
+			struct extent *n = &f->extents[j];
+
+			if (n->end < e->start || n->start > e->end) {
+				j++;
+				continue;
+			}
+			if (n->start < e->start)
+				e->start = n->start;
+			if (n->end > e->end)
+				e->end = n->end;
+			*n = f->extents[--f->nr_extents];
+		}
+		return;
+	}
+
+	if (f->nr_extents == f->max_extents) {
+		f->max_extents = f->max_extents ? f->max_extents * 2 : 8;
+		f->extents = xrealloc(f->extents,
+				      f->max_extents * sizeof(*f->extents));
+	}
+	f->extents[f->nr_extents].start = start;
+	f->extents[f->nr_extents].end = end;
+	f->nr_extents++;
+}
+
+static int cmp_extent(const void *a, const void *b)
+{
+	const struct extent *x = a, *y = b;
+
+	return x->start < y->start ? -1 : x->start > y->start;
+}
+
+static int resolve_one(const char *path, const struct stat *st, int flag,
+		       struct FTW *ftw)
+{
+	struct file *f;
+
+	if (flag != FTW_F || !S_ISREG(st->st_mode))
+		return 0;
+
+	f = lookup_file(major(st->st_dev), minor(st->st_dev), st->st_ino, 0);
+	if (f && !f->path) {
+		f->path = strdup(path);
+		if (!f->path)
+			fatal("strdup");
+		if (++nr_resolved == nr_files)
+			return 1;	/* all found, stop the walk */
+	}
+	return 0;
+}
+
+static int record(char **roots, int nr_roots)
+{
+	unsigned long ino, offset, nr_to_read;
+	unsigned int major, minor, i, j;
+	char line[1024];
+	int actual;
+	char *p;
+
+	while (fgets(line, sizeof(line), stdin)) {
+		p = strstr(line, "mm_readahead: ");
+		if (!p)
+			continue;
+		if (sscanf(p, "mm_readahead: dev=%u:%u ino=%lu offset=%lu "
+			   "nr_to_read=%lu actual=%d", &major, &minor, &ino,
+			   &offset, &nr_to_read, &actual) != 6)
+			continue;
+		if (actual <= 0)
+			continue;
+		add_extent(lookup_file(major, minor, ino, 1), offset,
+			   offset + nr_to_read);
+	}
+
+	for (i = 0; i < (unsigned int)nr_roots && nr_resolved < nr_files; i++)
+		if (nftw(roots[i], resolve_one, 64, FTW_PHYS) < 0)
+			perror(roots[i]);
+
+	for (i = 0; i < nr_files; i++) {
+		struct file *f = files[i];
+
+		if (!f->path) {
+			fprintf(stderr, "dev %u:%u ino %lu not found\n",
+				f->major, f->minor, f->ino);
+			continue;
+		}
+		qsort(f->extents, f->nr_extents, sizeof(*f->extents),
+		      cmp_extent);
+		for (j = 0; j < f->nr_extents; j++)
+			printf("%s %lu %lu\n", f->path, f->extents[j].start,
+			       f->extents[j].end - f->extents[j].start);
+	}
+	fprintf(stderr, "%u files, %u found\n", nr_files, nr_resolved);
+	return 0;
+}
+
+static int replay(const char *list)
+{
+	unsigned long start, nr, pages = 0, ranges = 0;
+	char path[4096], prev[4096] = "";
+	FILE *in = stdin;
+	int fd = -1;
+
+	if (list) {
+		in = fopen(list, "r");
+		if (!in)
+			fatal(list);
+	}
+
+	while (fscanf(in, "%4095s %lu %lu", path, &start, &nr) == 3) {
+		if (strcmp(path, prev)) {
+			if (fd >= 0)
+				close(fd);
+			strcpy(prev, path);
+			fd = open(path, O_RDONLY);
+			if (fd < 0)
+				perror(path);
+		}
+		if (fd < 0)
+			continue;
+		if (readahead(fd, (off64_t)start * page_size,
+			      nr * page_size) < 0)
+			perror(path);
+		pages += nr;
+		ranges++;
+	}
+	if (fd >= 0)
+		close(fd);
+
+	fprintf(stderr, "%lu ranges, %lu pages\n", ranges, pages);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	char *roots[64] = { "/" };
+	int nr_roots = 0;
+	int c;
+
+	if (argc < 2)
+		usage(argv[0]);
+	page_size = sysconf(_SC_PAGESIZE);
+
+	if (!strcmp(argv[1], "replay"))
+		return replay(argc > 2 ? argv[2] : NULL);
+	if (strcmp(argv[1], "record"))
+		usage(argv[0]);
+
+	optind = 2;
+	while ((c = getopt(argc, argv, "r:")) != -1) {
+		switch (c) {
+		case 'r':
+			if (nr_roots == 64)
+				usage(argv[0]);
+			roots[nr_roots++] = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	return record(roots, nr_roots ? nr_roots : 1);
+}
@@ -1,6 +1,63 @@
 #ifndef __ARM_PERCPU
 #define __ARM_PERCPU
 
+#include <linux/types.h>
 #include <asm-generic/percpu.h>
 
+#ifndef CONFIG_GENERIC_ATOMIC64
+/*
+ * ldrexd/strexd let us replace two adjacent words of this cpu's area at
+ * once without having to disable interrupts: an interrupt that comes in
+ * between clears the exclusive monitor on its way out, the strexd fails
+ * and the comparison is redone against whatever the interrupt left behind.
+ * Only preemption has to be held off so that we stay on the same cpu.
+ *
+ * The two words have to be 8 byte aligned, which the generic code checks.
+ */
+static inline int __percpu_cmpxchg_double(void *ptr,
+		unsigned long o1, unsigned long o2,
+		unsigned long n1, unsigned long n2)
+{
+	union {
+		unsigned long w[2];
+		u64 v;
+	} old = { .w = { o1, o2 } }, new = { .w = { n1, n2 } };
+	u64 *p = ptr;
+	u64 oldval;
+	unsigned long res;
+
+	do {
+		__asm__ __volatile__("@ percpu_cmpxchg_double\n"
+		"ldrexd		%1, %H1, [%3]\n"
+		"mov		%0, #0\n"
+		"teq		%1, %4\n"
+		"teqeq		%H1, %H4\n"
+		"strexdeq	%0, %5, %H5, [%3]"
+		: "=&r" (res), "=&r" (oldval), "+Qo" (*p)
+		: "r" (p), "r" (old.v), "r" (new.v)
+		: "cc");
+	} while (res);
+
+	return oldval == old.v;
+}
+
+#define __this_cpu_cmpxchg_double_4(pcp1, pcp2, o1, o2, n1, n2)	\
+	__percpu_cmpxchg_double(__this_cpu_ptr(&(pcp1)),		\
+		(unsigned long)(o1), (unsigned long)(o2),		\
+		(unsigned long)(n1), (unsigned long)(n2))
+
+#define this_cpu_cmpxchg_double_4(pcp1, pcp2, o1, o2, n1, n2)		\
+({									\
+	int ret__;							\
+	preempt_disable();						\
+	ret__ = __this_cpu_cmpxchg_double_4(pcp1, pcp2,			\
+			o1, o2, n1, n2);				\
+	preempt_enable();						\
+	ret__;								\
+})
+
+#define irqsafe_cpu_cmpxchg_double_4(pcp1, pcp2, o1, o2, n1, n2)	\
+	this_cpu_cmpxchg_double_4(pcp1, pcp2, o1, o2, n1, n2)
+#endif /* !CONFIG_GENERIC_ATOMIC64 */
+
 #endif
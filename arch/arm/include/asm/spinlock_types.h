@@ -5,12 +5,37 @@
 # error "please don't include this file directly"
 #endif
 
+#ifdef CONFIG_ARM_TICKET_LOCKS
+
+#define TICKET_SHIFT	16
+
+typedef struct {
+	union {
+		u32 slock;
+		struct __raw_tickets {
+#ifdef __ARMEB__
+			u16 next;
+			u16 owner;
+#else
+			u16 owner;
+			u16 next;
+#endif
+		} tickets;
+	};
+} arch_spinlock_t;
+
+#define __ARCH_SPIN_LOCK_UNLOCKED	{ { 0 } }
+
+#else
+
 typedef struct {
 	volatile unsigned int lock;
 } arch_spinlock_t;
 
 #define __ARCH_SPIN_LOCK_UNLOCKED	{ 0 }
 
+#endif
+
 typedef struct {
 	volatile unsigned int lock;
 } arch_rwlock_t;
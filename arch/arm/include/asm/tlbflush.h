@@ -548,21 +548,34 @@ static inline void clean_pmd_entry(pmd_t *pmd)
 #define local_flush_tlb_range(vma,start,end)	__cpu_flush_user_tlb_range(start,end,vma)
 #define local_flush_tlb_kernel_range(s,e)	__cpu_flush_kern_tlb_range(s,e)
 
+/*
+ * A user range is invalidated one page at a time, and on SMP each of those
+ * operations is broadcast to the other CPUs.  Ranges of more than
+ * tlb_range_flush_ceiling pages are dropped with a flush of the whole
+ * address space instead, which is a single operation by ASID on ARMv6+.
+ */
+extern unsigned long tlb_range_flush_ceiling;
+
+static inline int tlb_range_flush_by_asid(unsigned long start,
+					  unsigned long end)
+{
+	return (end - start) >> PAGE_SHIFT > tlb_range_flush_ceiling;
+}
+
 #ifndef CONFIG_SMP
 #define flush_tlb_all		local_flush_tlb_all
 #define flush_tlb_mm		local_flush_tlb_mm
 #define flush_tlb_page		local_flush_tlb_page
 #define flush_tlb_kernel_page	local_flush_tlb_kernel_page
-#define flush_tlb_range		local_flush_tlb_range
 #define flush_tlb_kernel_range	local_flush_tlb_kernel_range
 #else
 extern void flush_tlb_all(void);
 extern void flush_tlb_mm(struct mm_struct *mm);
 extern void flush_tlb_page(struct vm_area_struct *vma, unsigned long uaddr);
 extern void flush_tlb_kernel_page(unsigned long kaddr);
-extern void flush_tlb_range(struct vm_area_struct *vma, unsigned long start, unsigned long end);
 extern void flush_tlb_kernel_range(unsigned long start, unsigned long end);
 #endif
+extern void flush_tlb_range(struct vm_area_struct *vma, unsigned long start, unsigned long end);
 
 /*
  * If PG_dcache_clean is not set for the page, we need to ensure that any
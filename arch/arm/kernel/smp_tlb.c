@@ -116,6 +116,11 @@ void flush_tlb_kernel_page(unsigned long kaddr)
 void flush_tlb_range(struct vm_area_struct *vma,
                      unsigned long start, unsigned long end)
 {
+	if (tlb_range_flush_by_asid(start, end)) {
+		flush_tlb_mm(vma->vm_mm);
+		return;
+	}
+
 	if (tlb_ops_need_broadcast()) {
 		struct tlb_args ta;
 		ta.ta_vma = vma;
@@ -10,6 +10,7 @@
  * published by the Free Software Foundation.
  */
 
+#include <linux/cma.h>
 #include <linux/ion.h>
 #include <linux/memblock.h>
 #include <linux/omap_ion.h>
@@ -17,8 +18,14 @@
 
 #include "omap4_ion.h"
 
+#ifdef CONFIG_CMA
+#define OMAP4_ION_NR_HEAPS	4
+#else
+#define OMAP4_ION_NR_HEAPS	3
+#endif
+
 static struct ion_platform_data omap4_ion_data = {
-	.nr = 3,
+	.nr = OMAP4_ION_NR_HEAPS,
 	.heaps = {
 		{
 			.type = ION_HEAP_TYPE_CARVEOUT,
@@ -42,6 +49,19 @@ static struct ion_platform_data omap4_ion_data = {
 			.base = 0x80000000 + SZ_512M + SZ_2M,
 			.size = OMAP4_ION_HEAP_NONSECURE_TILER_SIZE,
 		},
+#ifdef CONFIG_CMA
+		/*
+		 * Large buffers for the display and camera.  The area lends
+		 * itself to movable pages while there are none allocated,
+		 * base is filled in once it has been reserved.
+		 */
+		{
+			.type = ION_HEAP_TYPE_CMA,
+			.id = OMAP_ION_HEAP_LARGE_SURFACES,
+			.name = "large_surfaces",
+			.size = OMAP4_ION_HEAP_LARGE_SURFACES_SIZE,
+		},
+#endif
 	},
 };
 
@@ -58,6 +78,21 @@ void __init omap4_register_ion(void)
 	platform_device_register(&omap4_ion_device);
 }
 
+static void __init omap_ion_declare_cma(struct ion_platform_heap *heap)
+{
+	struct cma *cma;
+	int ret;
+
+	ret = cma_declare_contiguous(0, heap->size, 0, heap->name, &cma);
+	if (ret) {
+		pr_err("cma reservation of %x for %s failed: %d\n",
+		       heap->size, heap->name, ret);
+		return;
+	}
+	heap->priv = cma;
+	heap->base = cma_get_base(cma);
+}
+
 void __init omap_ion_init(void)
 {
 	int i;
@@ -66,7 +101,9 @@ void __init omap_ion_init(void)
 	memblock_remove(OMAP4_RAMCONSOLE_START, OMAP4_RAMCONSOLE_SIZE);
 
 	for (i = 0; i < omap4_ion_data.nr; i++)
-		if (omap4_ion_data.heaps[i].type == ION_HEAP_TYPE_CARVEOUT ||
+		if (omap4_ion_data.heaps[i].type == ION_HEAP_TYPE_CMA)
+			omap_ion_declare_cma(&omap4_ion_data.heaps[i]);
+		else if (omap4_ion_data.heaps[i].type == ION_HEAP_TYPE_CARVEOUT ||
 		    omap4_ion_data.heaps[i].type == OMAP_ION_HEAP_TYPE_TILER) {
 			ret = memblock_remove(omap4_ion_data.heaps[i].base,
 					      omap4_ion_data.heaps[i].size);
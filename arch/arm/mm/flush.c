@@ -21,6 +21,25 @@
 
 #include "mm.h"
 
+/*
+ * Past this many pages, flush_tlb_range() drops the whole address space
+ * of the vma, see tlb_range_flush_by_asid().  Can be set on the command
+ * line or in /sys/module/kernel/parameters.
+ */
+unsigned long tlb_range_flush_ceiling __read_mostly = 64;
+core_param(tlb_range_flush_ceiling, tlb_range_flush_ceiling, ulong, 0644);
+
+#ifndef CONFIG_SMP
+void flush_tlb_range(struct vm_area_struct *vma,
+		     unsigned long start, unsigned long end)
+{
+	if (tlb_range_flush_by_asid(start, end))
+		local_flush_tlb_mm(vma->vm_mm);
+	else
+		local_flush_tlb_range(vma, start, end);
+}
+#endif
+
 #ifdef CONFIG_CPU_CACHE_VIPT
 
 #define ALIAS_FLUSH_START	0xffff4000
@@ -119,6 +119,23 @@ struct blkio_cgroup *task_blkio_cgroup(struct task_struct *tsk)
 }
 EXPORT_SYMBOL_GPL(task_blkio_cgroup);
 
+/*
+ * Latency target of the cgroup of @tsk in microseconds, 0 if it has none.
+ * I/O schedulers that support it use it to bound the time the requests of
+ * the group wait before they are dispatched.
+ */
+unsigned int blkiocg_latency_target(struct task_struct *tsk)
+{
+	unsigned int target;
+
+	rcu_read_lock();
+	target = task_blkio_cgroup(tsk)->latency_target;
+	rcu_read_unlock();
+
+	return target;
+}
+EXPORT_SYMBOL_GPL(blkiocg_latency_target);
+
 static inline void
 blkio_update_group_weight(struct blkio_group *blkg, unsigned int weight)
 {
@@ -134,6 +151,21 @@ blkio_update_group_weight(struct blkio_group *blkg, unsigned int weight)
 	}
 }
 
+static inline void blkio_update_group_latency_target(struct blkio_group *blkg,
+				unsigned int latency_target)
+{
+	struct blkio_policy_type *blkiop;
+
+	list_for_each_entry(blkiop, &blkio_list, list) {
+		/* If this policy does not own the blkg, do not send updates */
+		if (blkiop->plid != blkg->plid)
+			continue;
+		if (blkiop->ops.blkio_update_group_latency_target_fn)
+			blkiop->ops.blkio_update_group_latency_target_fn(
+					blkg->key, blkg, latency_target);
+	}
+}
+
 static inline void blkio_update_group_bps(struct blkio_group *blkg, u64 bps,
 				int fileid)
 {
@@ -463,6 +495,34 @@ void blkiocg_update_io_merged_stats(struct blkio_group *blkg, bool direction,
 }
 EXPORT_SYMBOL_GPL(blkiocg_update_io_merged_stats);
 
+/*
+ * Accounts a completed request of @blkg in the latency histogram, @latency
+ * being the time in ns since the request was allocated.  Latency stats are
+ * per cpu.
+ */
+void blkiocg_update_latency_stats(struct blkio_group *blkg, uint64_t latency,
+					bool direction)
+{
+	struct blkio_group_stats_cpu *stats_cpu;
+	unsigned long flags;
+	unsigned long usecs = div_u64(latency, NSEC_PER_USEC);
+	int bucket = 0;
+
+	if (usecs >> BLKIO_LAT_MIN_SHIFT)
+		bucket = min(ilog2(usecs) - BLKIO_LAT_MIN_SHIFT + 1,
+			     BLKIO_LAT_NR_BUCKETS - 1);
+
+	local_irq_save(flags);
+
+	stats_cpu = this_cpu_ptr(blkg->stats_cpu);
+
+	u64_stats_update_begin(&stats_cpu->syncp);
+	stats_cpu->lat_hist[direction][bucket]++;
+	u64_stats_update_end(&stats_cpu->syncp);
+	local_irq_restore(flags);
+}
+EXPORT_SYMBOL_GPL(blkiocg_update_latency_stats);
+
 /*
  * This function allocates the per cpu stats for blkio_group. Should be called
  * from sleepable context as alloc_per_cpu() requires that.
@@ -568,6 +628,7 @@ static void blkio_reset_stats_cpu(struct blkio_group *blkg)
 		for(j = 0; j < BLKIO_STAT_CPU_NR; j++)
 			for (k = 0; k < BLKIO_STAT_TOTAL; k++)
 				stats_cpu->stat_arr_cpu[j][k] = 0;
+		memset(stats_cpu->lat_hist, 0, sizeof(stats_cpu->lat_hist));
 	}
 }
 
@@ -1216,6 +1277,66 @@ static int blkio_read_blkg_stats(struct blkio_cgroup *blkcg,
 	return 0;
 }
 
+static uint64_t blkio_read_lat_hist_cpu(struct blkio_group *blkg, int rw,
+			int bucket)
+{
+	int cpu;
+	struct blkio_group_stats_cpu *stats_cpu;
+	u64 val = 0, tval;
+
+	for_each_possible_cpu(cpu) {
+		unsigned int start;
+		stats_cpu = per_cpu_ptr(blkg->stats_cpu, cpu);
+
+		do {
+			start = u64_stats_fetch_begin(&stats_cpu->syncp);
+			tval = stats_cpu->lat_hist[rw][bucket];
+		} while(u64_stats_fetch_retry(&stats_cpu->syncp, start));
+
+		val += tval;
+	}
+
+	return val;
+}
+
+/*
+ * One line per device, direction and histogram bucket, keyed with the upper
+ * bound of the bucket in usecs, "inf" for the last one.
+ */
+static int blkio_read_latency_hist(struct blkio_cgroup *blkcg,
+		struct cftype *cft, struct cgroup_map_cb *cb)
+{
+	struct blkio_group *blkg;
+	struct hlist_node *n;
+	char key_str[MAX_KEY_LEN];
+	int rw, bucket, len;
+
+	rcu_read_lock();
+	hlist_for_each_entry_rcu(blkg, n, &blkcg->blkg_list, blkcg_node) {
+		if (!blkg->dev || !cftype_blkg_same_policy(cft, blkg))
+			continue;
+		for (rw = READ; rw <= WRITE; rw++) {
+			blkio_get_key_name(rw == READ ? BLKIO_STAT_READ :
+					BLKIO_STAT_WRITE, blkg->dev, key_str,
+					MAX_KEY_LEN, false);
+			len = strlen(key_str);
+			for (bucket = 0; bucket < BLKIO_LAT_NR_BUCKETS; bucket++) {
+				if (bucket == BLKIO_LAT_NR_BUCKETS - 1)
+					snprintf(key_str + len, MAX_KEY_LEN - len,
+						" inf");
+				else
+					snprintf(key_str + len, MAX_KEY_LEN - len,
+						" %u", 1U << (BLKIO_LAT_MIN_SHIFT
+							      + bucket));
+				cb->fill(cb, key_str,
+					blkio_read_lat_hist_cpu(blkg, rw, bucket));
+			}
+		}
+	}
+	rcu_read_unlock();
+	return 0;
+}
+
 /* All map kind of cgroup file get serviced by this function */
 static int blkiocg_file_read_map(struct cgroup *cgrp, struct cftype *cft,
 				struct cgroup_map_cb *cb)
@@ -1285,6 +1406,8 @@ static int blkiocg_file_read_map(struct cgroup *cgrp, struct cftype *cft,
 		case BLKIO_THROTL_io_serviced:
 			return blkio_read_blkg_stats(blkcg, cft, cb,
 						BLKIO_STAT_CPU_SERVICED, 1, 1);
+		case BLKIO_THROTL_latency_histogram:
+			return blkio_read_latency_hist(blkcg, cft, cb);
 		default:
 			BUG();
 		}
@@ -1322,6 +1445,26 @@ static int blkio_weight_write(struct blkio_cgroup *blkcg, u64 val)
 	return 0;
 }
 
+static int blkio_latency_target_write(struct blkio_cgroup *blkcg, u64 val)
+{
+	struct blkio_group *blkg;
+	struct hlist_node *n;
+
+	if (val > UINT_MAX)
+		return -EINVAL;
+
+	spin_lock(&blkio_list_lock);
+	spin_lock_irq(&blkcg->lock);
+	blkcg->latency_target = (unsigned int)val;
+
+	hlist_for_each_entry(blkg, n, &blkcg->blkg_list, blkcg_node)
+		blkio_update_group_latency_target(blkg, blkcg->latency_target);
+
+	spin_unlock_irq(&blkcg->lock);
+	spin_unlock(&blkio_list_lock);
+	return 0;
+}
+
 static u64 blkiocg_file_read_u64 (struct cgroup *cgrp, struct cftype *cft) {
 	struct blkio_cgroup *blkcg;
 	enum blkio_policy_id plid = BLKIOFILE_POLICY(cft->private);
@@ -1334,6 +1477,8 @@ static u64 blkiocg_file_read_u64 (struct cgroup *cgrp, struct cftype *cft) {
 		switch(name) {
 		case BLKIO_PROP_weight:
 			return (u64)blkcg->weight;
+		case BLKIO_PROP_latency_target:
+			return (u64)blkcg->latency_target;
 		}
 		break;
 	default:
@@ -1356,6 +1501,8 @@ blkiocg_file_write_u64(struct cgroup *cgrp, struct cftype *cft, u64 val)
 		switch(name) {
 		case BLKIO_PROP_weight:
 			return blkio_weight_write(blkcg, val);
+		case BLKIO_PROP_latency_target:
+			return blkio_latency_target_write(blkcg, val);
 		}
 		break;
 	default:
@@ -1381,6 +1528,13 @@ struct cftype blkio_files[] = {
 		.read_u64 = blkiocg_file_read_u64,
 		.write_u64 = blkiocg_file_write_u64,
 	},
+	{
+		.name = "latency_target",
+		.private = BLKIOFILE_PRIVATE(BLKIO_POLICY_PROP,
+				BLKIO_PROP_latency_target),
+		.read_u64 = blkiocg_file_read_u64,
+		.write_u64 = blkiocg_file_write_u64,
+	},
 	{
 		.name = "time",
 		.private = BLKIOFILE_PRIVATE(BLKIO_POLICY_PROP,
@@ -1481,6 +1635,12 @@ struct cftype blkio_files[] = {
 				BLKIO_THROTL_io_serviced),
 		.read_map = blkiocg_file_read_map,
 	},
+	{
+		.name = "throttle.latency_histogram",
+		.private = BLKIOFILE_PRIVATE(BLKIO_POLICY_THROTL,
+				BLKIO_THROTL_latency_histogram),
+		.read_map = blkiocg_file_read_map,
+	},
 #endif /* CONFIG_BLK_DEV_THROTTLING */
 
 #ifdef CONFIG_DEBUG_BLK_CGROUP
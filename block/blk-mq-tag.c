@@ -0,0 +1,109 @@
+/*
+ * Tag allocation for multi-queue block devices
+ *
+ * Every hardware context has a bitmap of tags, one per preallocated
+ * request.  Allocation starts searching where the software queue of the
+ * allocating CPU last found a free tag, so that CPUs sharing a hardware
+ * context tend to work on different words of the map.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/sched.h>
+#include <linux/blk-mq.h>
+
+#include "blk-mq.h"
+
+struct blk_mq_tags {
+	unsigned int		nr_tags;
+	unsigned long		*map;
+	wait_queue_head_t	wait;
+};
+
+static int __blk_mq_get_tag(struct blk_mq_tags *tags, unsigned int start,
+			    unsigned int end)
+{
+	unsigned int tag = start;
+
+	while ((tag = find_next_zero_bit(tags->map, end, tag)) < end) {
+		if (!test_and_set_bit_lock(tag, tags->map))
+			return tag;
+		tag++;
+	}
+	return -1;
+}
+
+/*
+ * Returns a free tag, or -1 if all of them are in use.  @last_tag is the
+ * allocation hint of the caller and is advanced past the tag found.
+ */
+int blk_mq_get_tag(struct blk_mq_tags *tags, unsigned int *last_tag)
+{
+	unsigned int start = *last_tag;
+	int tag;
+
+	if (start >= tags->nr_tags)
+		start = 0;
+
+	tag = __blk_mq_get_tag(tags, start, tags->nr_tags);
+	if (tag < 0 && start)
+		tag = __blk_mq_get_tag(tags, 0, start);
+	if (tag >= 0)
+		*last_tag = tag + 1;
+	return tag;
+}
+
+void blk_mq_put_tag(struct blk_mq_tags *tags, unsigned int tag)
+{
+	BUG_ON(tag >= tags->nr_tags);
+
+	clear_bit_unlock(tag, tags->map);
+	smp_mb__after_clear_bit();
+	if (waitqueue_active(&tags->wait))
+		wake_up(&tags->wait);
+}
+
+static bool blk_mq_has_free_tags(struct blk_mq_tags *tags)
+{
+	return find_first_zero_bit(tags->map, tags->nr_tags) < tags->nr_tags;
+}
+
+/*
+ * Sleep until a tag is freed.  The caller retries the allocation after
+ * this returns, every freed tag wakes up one waiter.
+ */
+void blk_mq_wait_for_tags(struct blk_mq_tags *tags)
+{
+	DEFINE_WAIT(wait);
+
+	prepare_to_wait_exclusive(&tags->wait, &wait, TASK_UNINTERRUPTIBLE);
+	if (!blk_mq_has_free_tags(tags))
+		io_schedule();
+	finish_wait(&tags->wait, &wait);
+}
+
+struct blk_mq_tags *blk_mq_init_tags(unsigned int nr_tags, int node)
+{
+	struct blk_mq_tags *tags;
+
+	tags = kzalloc_node(sizeof(*tags), GFP_KERNEL, node);
+	if (!tags)
+		return NULL;
+
+	tags->map = kzalloc_node(BITS_TO_LONGS(nr_tags) * sizeof(long),
+				 GFP_KERNEL, node);
+	if (!tags->map) {
+		kfree(tags);
+		return NULL;
+	}
+
+	tags->nr_tags = nr_tags;
+	init_waitqueue_head(&tags->wait);
+	return tags;
+}
+
+void blk_mq_free_tags(struct blk_mq_tags *tags)
+{
+	kfree(tags->map);
+	kfree(tags);
+}
@@ -0,0 +1,978 @@
+/*
+ * Multi-queue block layer
+ *
+ * Bios are turned into requests on a software queue per CPU and handed
+ * from there to the hardware context the CPU is mapped to.  Submission
+ * only takes the lock of the local software queue, there is no elevator
+ * and no q->queue_lock, so that fast devices are not limited by a single
+ * shared lock.  Requests are preallocated per hardware context and
+ * indexed by tag, the number of tags is the queue depth of the context.
+ *
+ * Flush and FUA requests are passed to the driver as they are, a driver
+ * that sets blk_queue_flush() has to sequence them itself.  There is no
+ * request timeout handling, drivers that need it keep their own timers.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/bio.h>
+#include <linux/blkdev.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/smp.h>
+#include <linux/list_sort.h>
+#include <linux/hrtimer.h>
+#include <linux/blk-mq.h>
+#include <trace/events/block.h>
+
+#include "blk.h"
+#include "blk-mq.h"
+
+/* requests of a software queue looked at for merging, from the tail */
+#define BLK_MQ_MERGE_DEPTH	8
+
+/* how often the per-CPU completion times are folded into q->poll_stat */
+#define BLK_MQ_POLL_STAT_WINDOW	(HZ / 10)
+
+/*
+ * bio->bi_cookie: the hardware queue and tag of the request the bio went
+ * into, for blk_poll().  Zero when the bio didn't get a request of its own.
+ */
+#define BLK_QC_T_VALID		(1U << 31)
+#define BLK_QC_T_SHIFT		16
+
+static inline unsigned int blk_tag_to_qc_t(unsigned int tag,
+					   unsigned int queue_num)
+{
+	return BLK_QC_T_VALID | queue_num << BLK_QC_T_SHIFT | tag;
+}
+
+static inline unsigned int blk_qc_t_to_queue_num(unsigned int cookie)
+{
+	return (cookie & ~BLK_QC_T_VALID) >> BLK_QC_T_SHIFT;
+}
+
+static inline unsigned int blk_qc_t_to_tag(unsigned int cookie)
+{
+	return cookie & ((1U << BLK_QC_T_SHIFT) - 1);
+}
+
+static struct blk_mq_ctx *blk_mq_get_ctx(struct request_queue *q)
+{
+	return per_cpu_ptr(q->queue_ctx, get_cpu());
+}
+
+static void blk_mq_put_ctx(struct blk_mq_ctx *ctx)
+{
+	put_cpu();
+}
+
+/*
+ * Default mapping of a CPU to a hardware queue: the possible CPUs are
+ * spread evenly over the hardware queues, neighbouring CPU numbers
+ * sharing one.  Drivers can use it as their ->map_queue().
+ */
+struct blk_mq_hw_ctx *blk_mq_map_queue(struct request_queue *q, const int cpu)
+{
+	return q->queue_hw_ctx[q->mq_map[cpu]];
+}
+EXPORT_SYMBOL(blk_mq_map_queue);
+
+static void blk_mq_hctx_mark_pending(struct blk_mq_hw_ctx *hctx,
+				     struct blk_mq_ctx *ctx)
+{
+	if (!test_bit(ctx->index_hw, hctx->ctx_map))
+		set_bit(ctx->index_hw, hctx->ctx_map);
+}
+
+static struct request *__blk_mq_alloc_request(struct blk_mq_hw_ctx *hctx,
+					      struct blk_mq_ctx *ctx, int rw)
+{
+	struct request_queue *q = hctx->queue;
+	struct request *rq;
+	int tag;
+
+	tag = blk_mq_get_tag(hctx->tags, &ctx->last_tag);
+	if (tag < 0)
+		return NULL;
+
+	rq = hctx->rqs[tag];
+	blk_rq_init(q, rq);
+	rq->tag = tag;
+	rq->mq_ctx = ctx;
+	rq->cmd_flags = rw;
+	if (blk_queue_io_stat(q))
+		rq->cmd_flags |= REQ_IO_STAT;
+	return rq;
+}
+
+/*
+ * Get a request of the software queue of the current CPU.  If the
+ * hardware context is out of tags and @gfp allows it, wait for one; the
+ * task may run on another CPU afterwards, so the software queue is
+ * looked up again.
+ */
+static struct request *blk_mq_get_request(struct request_queue *q, int rw,
+					  gfp_t gfp)
+{
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_mq_ctx *ctx;
+	struct request *rq;
+
+	for (;;) {
+		ctx = blk_mq_get_ctx(q);
+		hctx = q->mq_ops->map_queue(q, ctx->cpu);
+		rq = __blk_mq_alloc_request(hctx, ctx, rw);
+		blk_mq_put_ctx(ctx);
+
+		if (rq || !(gfp & __GFP_WAIT))
+			return rq;
+
+		/* get the queued requests going, they hold the tags */
+		blk_mq_run_hw_queue(hctx, false);
+		blk_mq_wait_for_tags(hctx->tags);
+	}
+}
+
+/**
+ * blk_mq_alloc_request - allocate a request for driver internal use
+ * @q:		the multi-queue request queue
+ * @rw:		data direction and request flags
+ * @gfp:	waits for a free tag if it includes __GFP_WAIT
+ *
+ * The request is released with blk_mq_free_request(), or by
+ * blk_mq_end_io() when it has no ->end_io.
+ */
+struct request *blk_mq_alloc_request(struct request_queue *q, int rw,
+				     gfp_t gfp)
+{
+	return blk_mq_get_request(q, rw, gfp);
+}
+EXPORT_SYMBOL(blk_mq_alloc_request);
+
+void blk_mq_free_request(struct request *rq)
+{
+	struct request_queue *q = rq->q;
+	struct blk_mq_hw_ctx *hctx = q->mq_ops->map_queue(q, rq->mq_ctx->cpu);
+
+	blk_throtl_rq_free(rq);
+	blk_mq_put_tag(hctx->tags, rq->tag);
+}
+EXPORT_SYMBOL(blk_mq_free_request);
+
+/**
+ * blk_mq_end_io - complete a request
+ * @rq:		the request being completed
+ * @error:	0 for success, < 0 for error
+ *
+ * Ends all the bios of @rq and releases its tag, or passes it to its
+ * ->end_io if it has one.
+ */
+static void blk_rq_stat_init(struct blk_rq_stat *stat)
+{
+	stat->mean = stat->max = stat->batch = 0;
+	stat->min = -1ULL;
+	stat->nr_samples = 0;
+}
+
+static void blk_mq_poll_stat_add(struct request *rq)
+{
+	struct blk_rq_stat *stat;
+	unsigned long flags;
+	s64 value = ktime_to_ns(ktime_get()) - rq->issue_time_ns;
+
+	if (value < 0)
+		return;
+
+	/* completions of interrupt and task context share the CPU's stat */
+	local_irq_save(flags);
+	stat = &per_cpu_ptr(rq->q->queue_ctx,
+			    smp_processor_id())->poll_stat[rq_data_dir(rq)];
+	stat->min = min_t(u64, stat->min, value);
+	stat->max = max_t(u64, stat->max, value);
+	stat->batch += value;
+	stat->nr_samples++;
+	local_irq_restore(flags);
+}
+
+void blk_mq_end_io(struct request *rq, int error)
+{
+	if (blk_update_request(rq, error, blk_rq_bytes(rq)))
+		BUG();
+
+	if (rq->issue_time_ns)
+		blk_mq_poll_stat_add(rq);
+
+	blk_account_io_done(rq);
+	blk_throtl_rq_done(rq);
+
+	if (rq->end_io)
+		rq->end_io(rq, error);
+	else
+		blk_mq_free_request(rq);
+}
+EXPORT_SYMBOL(blk_mq_end_io);
+
+#if defined(CONFIG_SMP) && defined(CONFIG_USE_GENERIC_SMP_HELPERS)
+static void __blk_mq_complete_request_remote(void *data)
+{
+	struct request *rq = data;
+
+	rq->q->mq_ops->complete(rq);
+}
+
+/**
+ * blk_mq_complete_request - end a request from the completion interrupt
+ * @rq:		the request being completed
+ *
+ * Runs the ->complete() of the driver for @rq, on the CPU that submitted
+ * it if the queue asks for completions on the same CPU, so that the
+ * completion finds the data of the submitter in its cache.
+ */
+void blk_mq_complete_request(struct request *rq)
+{
+	struct request_queue *q = rq->q;
+	struct blk_mq_ctx *ctx = rq->mq_ctx;
+	int cpu;
+
+	if (!test_bit(QUEUE_FLAG_SAME_COMP, &q->queue_flags)) {
+		q->mq_ops->complete(rq);
+		return;
+	}
+
+	cpu = get_cpu();
+	if (cpu != ctx->cpu && cpu_online(ctx->cpu)) {
+		rq->csd.func = __blk_mq_complete_request_remote;
+		rq->csd.info = rq;
+		rq->csd.flags = 0;
+		__smp_call_function_single(ctx->cpu, &rq->csd, 0);
+	} else {
+		q->mq_ops->complete(rq);
+	}
+	put_cpu();
+}
+#else
+void blk_mq_complete_request(struct request *rq)
+{
+	rq->q->mq_ops->complete(rq);
+}
+#endif
+EXPORT_SYMBOL(blk_mq_complete_request);
+
+static void blk_mq_start_request(struct request *rq)
+{
+	trace_block_rq_issue(rq->q, rq);
+	rq->cmd_flags |= REQ_STARTED;
+
+	/* the completion time feeds the hybrid polling estimate */
+	if (blk_queue_poll(rq->q))
+		rq->issue_time_ns = ktime_to_ns(ktime_get());
+}
+
+static void blk_mq_requeue_request(struct request *rq)
+{
+	trace_block_rq_requeue(rq->q, rq);
+	rq->cmd_flags &= ~REQ_STARTED;
+}
+
+/*
+ * Move the requests of all software queues with work to the hardware
+ * context and hand them to the driver.  Whatever the driver can't take
+ * now stays on hctx->dispatch and goes first on the next run.
+ */
+static void __blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	struct request_queue *q = hctx->queue;
+	struct blk_mq_ctx *ctx;
+	struct request *rq;
+	LIST_HEAD(rq_list);
+	int bit;
+
+	if (unlikely(test_bit(BLK_MQ_S_STOPPED, &hctx->state)))
+		return;
+
+	for_each_set_bit(bit, hctx->ctx_map, hctx->nr_ctx) {
+		clear_bit(bit, hctx->ctx_map);
+		ctx = hctx->ctxs[bit];
+
+		spin_lock(&ctx->lock);
+		list_splice_tail_init(&ctx->rq_list, &rq_list);
+		spin_unlock(&ctx->lock);
+	}
+
+	if (!list_empty_careful(&hctx->dispatch)) {
+		spin_lock(&hctx->lock);
+		list_splice_init(&hctx->dispatch, &rq_list);
+		spin_unlock(&hctx->lock);
+	}
+
+	while (!list_empty(&rq_list)) {
+		int ret;
+
+		rq = list_first_entry(&rq_list, struct request, queuelist);
+		list_del_init(&rq->queuelist);
+
+		blk_mq_start_request(rq);
+		ret = q->mq_ops->queue_rq(hctx, rq);
+		if (ret == BLK_MQ_RQ_QUEUE_OK)
+			continue;
+		if (ret == BLK_MQ_RQ_QUEUE_BUSY) {
+			blk_mq_requeue_request(rq);
+			list_add(&rq->queuelist, &rq_list);
+			break;
+		}
+		if (ret != BLK_MQ_RQ_QUEUE_ERROR)
+			printk(KERN_ERR "blk-mq: bad return on queue: %d\n",
+			       ret);
+		rq->errors = -EIO;
+		blk_mq_end_io(rq, rq->errors);
+	}
+
+	if (!list_empty(&rq_list)) {
+		spin_lock(&hctx->lock);
+		list_splice(&rq_list, &hctx->dispatch);
+		spin_unlock(&hctx->lock);
+	}
+}
+
+/**
+ * blk_mq_run_hw_queue - dispatch the pending requests of a hardware queue
+ * @hctx:	the hardware context
+ * @async:	leave the dispatch to kblockd instead of doing it here
+ */
+void blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx, bool async)
+{
+	if (unlikely(test_bit(BLK_MQ_S_STOPPED, &hctx->state)))
+		return;
+
+	if (!async)
+		__blk_mq_run_hw_queue(hctx);
+	else
+		kblockd_schedule_delayed_work(hctx->queue,
+					      &hctx->delayed_work, 0);
+}
+EXPORT_SYMBOL(blk_mq_run_hw_queue);
+
+void blk_mq_run_queues(struct request_queue *q, bool async)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i)
+		blk_mq_run_hw_queue(hctx, async);
+}
+EXPORT_SYMBOL(blk_mq_run_queues);
+
+/**
+ * blk_mq_stop_hw_queue - stop dispatching to a hardware queue
+ * @hctx:	the hardware context
+ *
+ * A driver that returns BLK_MQ_RQ_QUEUE_BUSY from ->queue_rq() stops the
+ * queue first and restarts it once it can take requests again.
+ */
+void blk_mq_stop_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	cancel_delayed_work(&hctx->delayed_work);
+	set_bit(BLK_MQ_S_STOPPED, &hctx->state);
+}
+EXPORT_SYMBOL(blk_mq_stop_hw_queue);
+
+void blk_mq_start_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	clear_bit(BLK_MQ_S_STOPPED, &hctx->state);
+	blk_mq_run_hw_queue(hctx, false);
+}
+EXPORT_SYMBOL(blk_mq_start_hw_queue);
+
+/*
+ * Restart the stopped hardware queues of @q from kblockd; can be called
+ * from the completion interrupt.
+ */
+void blk_mq_start_stopped_hw_queues(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (!test_bit(BLK_MQ_S_STOPPED, &hctx->state))
+			continue;
+
+		clear_bit(BLK_MQ_S_STOPPED, &hctx->state);
+		blk_mq_run_hw_queue(hctx, true);
+	}
+}
+EXPORT_SYMBOL(blk_mq_start_stopped_hw_queues);
+
+static void blk_mq_work_fn(struct work_struct *work)
+{
+	struct blk_mq_hw_ctx *hctx;
+
+	hctx = container_of(work, struct blk_mq_hw_ctx, delayed_work.work);
+	__blk_mq_run_hw_queue(hctx);
+}
+
+static void blk_mq_insert_requests(struct request_queue *q,
+				   struct blk_mq_ctx *ctx,
+				   struct list_head *list, unsigned int depth,
+				   bool from_schedule)
+{
+	struct blk_mq_hw_ctx *hctx = q->mq_ops->map_queue(q, ctx->cpu);
+
+	trace_block_unplug(q, depth, !from_schedule);
+
+	spin_lock(&ctx->lock);
+	list_splice_tail_init(list, &ctx->rq_list);
+	blk_mq_hctx_mark_pending(hctx, ctx);
+	spin_unlock(&ctx->lock);
+
+	blk_mq_run_hw_queue(hctx, from_schedule);
+}
+
+static int plug_ctx_cmp(void *priv, struct list_head *a, struct list_head *b)
+{
+	struct request *rqa = container_of(a, struct request, queuelist);
+	struct request *rqb = container_of(b, struct request, queuelist);
+
+	return !(rqa->mq_ctx < rqb->mq_ctx ||
+		 (rqa->mq_ctx == rqb->mq_ctx &&
+		  blk_rq_pos(rqa) < blk_rq_pos(rqb)));
+}
+
+/*
+ * Move the plugged requests to their software queues, one batch per
+ * software queue, and run the hardware queues they map to.
+ */
+void blk_mq_flush_plug_list(struct blk_plug *plug, bool from_schedule)
+{
+	struct blk_mq_ctx *this_ctx;
+	struct request *rq;
+	LIST_HEAD(list);
+	LIST_HEAD(ctx_list);
+	unsigned int depth;
+
+	list_splice_init(&plug->mq_list, &list);
+	list_sort(NULL, &list, plug_ctx_cmp);
+
+	this_ctx = NULL;
+	depth = 0;
+
+	while (!list_empty(&list)) {
+		rq = list_entry_rq(list.next);
+		list_del_init(&rq->queuelist);
+		BUG_ON(!rq->q);
+		if (rq->mq_ctx != this_ctx) {
+			if (this_ctx)
+				blk_mq_insert_requests(this_ctx->queue,
+						       this_ctx, &ctx_list,
+						       depth, from_schedule);
+			this_ctx = rq->mq_ctx;
+			depth = 0;
+		}
+
+		depth++;
+		list_add_tail(&rq->queuelist, &ctx_list);
+	}
+
+	if (this_ctx)
+		blk_mq_insert_requests(this_ctx->queue, this_ctx, &ctx_list,
+				       depth, from_schedule);
+}
+
+/*
+ * Try to merge @bio into one of the last requests of @list, which is
+ * either the plug list of the task or a software queue under its lock.
+ */
+static bool blk_mq_attempt_merge(struct request_queue *q,
+				 struct list_head *list, struct bio *bio)
+{
+	struct request *rq;
+	int checked = BLK_MQ_MERGE_DEPTH;
+
+	list_for_each_entry_reverse(rq, list, queuelist) {
+		int el_ret;
+
+		if (!checked--)
+			break;
+		if (rq->q != q)
+			continue;
+
+		el_ret = elv_try_merge(rq, bio);
+		if (el_ret == ELEVATOR_BACK_MERGE) {
+			if (bio_attempt_back_merge(q, rq, bio))
+				return true;
+			break;
+		} else if (el_ret == ELEVATOR_FRONT_MERGE) {
+			if (bio_attempt_front_merge(q, rq, bio))
+				return true;
+			break;
+		}
+	}
+
+	return false;
+}
+
+static int blk_mq_make_request(struct request_queue *q, struct bio *bio)
+{
+	const bool is_sync = rw_is_sync(bio->bi_rw);
+	const bool is_flush_fua = bio->bi_rw & (REQ_FLUSH | REQ_FUA);
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_mq_ctx *ctx;
+	struct blk_plug *plug;
+	struct request *rq;
+	bool merged;
+	int rw_flags;
+
+	blk_queue_bounce(q, &bio);
+
+	plug = current->plug;
+	if (!is_flush_fua && !blk_queue_nomerges(q)) {
+		if (plug && blk_mq_attempt_merge(q, &plug->mq_list, bio))
+			return 0;
+
+		ctx = blk_mq_get_ctx(q);
+		hctx = q->mq_ops->map_queue(q, ctx->cpu);
+		merged = false;
+		if (hctx->flags & BLK_MQ_F_SHOULD_MERGE) {
+			spin_lock(&ctx->lock);
+			merged = blk_mq_attempt_merge(q, &ctx->rq_list, bio);
+			spin_unlock(&ctx->lock);
+		}
+		blk_mq_put_ctx(ctx);
+		if (merged)
+			return 0;
+	}
+
+	rw_flags = bio_data_dir(bio);
+	if (is_sync)
+		rw_flags |= REQ_SYNC;
+
+	trace_block_getrq(q, bio, rw_flags & 1);
+	rq = blk_mq_get_request(q, rw_flags, GFP_NOIO);
+
+	init_request_from_bio(rq, bio);
+	drive_stat_acct(rq, 1);
+
+	/*
+	 * The request has the software queue of the CPU it was allocated
+	 * on, which it is inserted into even if the task moved since.
+	 */
+	ctx = rq->mq_ctx;
+	hctx = q->mq_ops->map_queue(q, ctx->cpu);
+	bio->bi_cookie = blk_tag_to_qc_t(rq->tag, hctx->queue_num);
+
+	if (plug && !is_flush_fua) {
+		if (list_empty(&plug->mq_list))
+			trace_block_plug(q);
+		list_add_tail(&rq->queuelist, &plug->mq_list);
+		return 0;
+	}
+
+	trace_block_rq_insert(q, rq);
+	spin_lock(&ctx->lock);
+	list_add_tail(&rq->queuelist, &ctx->rq_list);
+	blk_mq_hctx_mark_pending(hctx, ctx);
+	spin_unlock(&ctx->lock);
+
+	/* sync I/O is dispatched right away, async I/O from kblockd */
+	blk_mq_run_hw_queue(hctx, !is_sync && !is_flush_fua);
+	return 0;
+}
+
+/*
+ * Fold the completion times the CPUs collected since the last window into
+ * q->poll_stat.  A direction without completions keeps its last estimate.
+ * Samples that race with the folding on other CPUs may be lost, which is
+ * fine for an estimate.
+ */
+void blk_mq_poll_stat_refresh(struct request_queue *q)
+{
+	struct blk_rq_stat stat[2], *src;
+	unsigned long flags;
+	int cpu, dir;
+
+	spin_lock_irqsave(q->queue_lock, flags);
+	if (time_before(jiffies, q->poll_stat_time + BLK_MQ_POLL_STAT_WINDOW))
+		goto out;
+	q->poll_stat_time = jiffies;
+
+	blk_rq_stat_init(&stat[READ]);
+	blk_rq_stat_init(&stat[WRITE]);
+	for_each_possible_cpu(cpu) {
+		for (dir = READ; dir <= WRITE; dir++) {
+			src = &per_cpu_ptr(q->queue_ctx, cpu)->poll_stat[dir];
+			if (!src->nr_samples)
+				continue;
+			stat[dir].min = min(stat[dir].min, src->min);
+			stat[dir].max = max(stat[dir].max, src->max);
+			stat[dir].batch += src->batch;
+			stat[dir].nr_samples += src->nr_samples;
+			blk_rq_stat_init(src);
+		}
+	}
+
+	for (dir = READ; dir <= WRITE; dir++) {
+		if (!stat[dir].nr_samples)
+			continue;
+		stat[dir].mean = div_u64(stat[dir].batch,
+					 stat[dir].nr_samples);
+		q->poll_stat[dir] = stat[dir];
+	}
+out:
+	spin_unlock_irqrestore(q->queue_lock, flags);
+}
+
+/*
+ * Hybrid polling: rather than spinning from the moment the request was
+ * issued, sleep until about half of the mean completion time has passed,
+ * which is the part of it the device certainly needs.  Only done once per
+ * request; returns true if it slept, for the caller to check whether it
+ * was woken up by the completion.
+ */
+static bool blk_mq_poll_hybrid_sleep(struct request_queue *q,
+				     struct blk_mq_hw_ctx *hctx,
+				     struct request *rq)
+{
+	struct hrtimer_sleeper hs;
+	s64 nsecs;
+
+	/*
+	 * A request that isn't started is not ours any more, or hasn't
+	 * been handed to the driver yet: no issue time to go by either way.
+	 */
+	if (q->poll_nsec < 0 || !(rq->cmd_flags & REQ_STARTED) ||
+	    !rq->issue_time_ns || (rq->cmd_flags & REQ_POLL_SLEPT))
+		return false;
+	rq->cmd_flags |= REQ_POLL_SLEPT;
+
+	if (q->poll_nsec > 0)
+		nsecs = q->poll_nsec;
+	else {
+		blk_mq_poll_stat_refresh(q);
+		nsecs = div_u64(q->poll_stat[rq_data_dir(rq)].mean + 1, 2);
+	}
+	nsecs -= ktime_to_ns(ktime_get()) - rq->issue_time_ns;
+	if (nsecs <= 0)
+		return false;
+
+	hctx->poll_sleeps++;
+
+	/*
+	 * The caller has set its task state already, a completion that
+	 * comes in first wakes it up just like the timer does.
+	 */
+	hrtimer_init_on_stack(&hs.timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	hrtimer_init_sleeper(&hs, current);
+	hrtimer_start(&hs.timer, ns_to_ktime(nsecs), HRTIMER_MODE_REL);
+	if (hs.task)
+		io_schedule();
+	hrtimer_cancel(&hs.timer);
+	destroy_hrtimer_on_stack(&hs.timer);
+
+	__set_current_state(TASK_RUNNING);
+	return true;
+}
+
+/**
+ * blk_poll - wait for a request by polling its hardware queue
+ * @q:		the queue the bio was submitted to
+ * @cookie:	the bi_cookie of the bio
+ *
+ * For synchronous waiters that have set their task state and are woken by
+ * the completion of the bio.  Sleeps for the expected completion time if
+ * io_poll_delay asks for it, then spins on the ->poll() of the driver
+ * until the task is woken up or needs to reschedule.  Returns true if
+ * the caller should check its completion again, false if it should go to
+ * sleep as it would have without polling.
+ */
+bool blk_poll(struct request_queue *q, unsigned int cookie)
+{
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int queue_num, tag;
+	struct request *rq;
+
+	if (!q->mq_ops || !q->mq_ops->poll || !blk_queue_poll(q) ||
+	    !(cookie & BLK_QC_T_VALID))
+		return false;
+
+	queue_num = blk_qc_t_to_queue_num(cookie);
+	tag = blk_qc_t_to_tag(cookie);
+	if (queue_num >= q->nr_hw_queues)
+		return false;
+	hctx = q->queue_hw_ctx[queue_num];
+	if (tag >= hctx->queue_depth)
+		return false;
+
+	/*
+	 * The bio may still sit on our plug, e.g. O_DIRECT under the plug of
+	 * generic_file_aio_read().  Only schedule() would flush it otherwise,
+	 * and we would spin for a request that was never dispatched.
+	 */
+	blk_flush_plug(current);
+
+	/*
+	 * The request may have completed and been reused, in which case
+	 * the completion has woken us up already and we return right away.
+	 */
+	rq = hctx->rqs[tag];
+	if (blk_mq_poll_hybrid_sleep(q, hctx, rq))
+		return true;
+
+	hctx->poll_invoked++;
+	while (!need_resched()) {
+		int ret = q->mq_ops->poll(hctx, tag);
+
+		if (ret > 0) {
+			hctx->poll_success++;
+			__set_current_state(TASK_RUNNING);
+			return true;
+		}
+		if (current->state == TASK_RUNNING)
+			return true;
+		if (ret < 0)
+			break;
+		cpu_relax();
+	}
+
+	return false;
+}
+EXPORT_SYMBOL_GPL(blk_poll);
+
+static unsigned int *blk_mq_make_queue_map(unsigned int nr_hw_queues)
+{
+	unsigned int *map, cpu, i = 0;
+	unsigned int nr_cpus = num_possible_cpus();
+
+	map = kzalloc(sizeof(*map) * nr_cpu_ids, GFP_KERNEL);
+	if (!map)
+		return NULL;
+
+	for_each_possible_cpu(cpu)
+		map[cpu] = i++ * nr_hw_queues / nr_cpus;
+
+	return map;
+}
+
+static void blk_mq_free_rq_map(struct blk_mq_hw_ctx *hctx)
+{
+	unsigned int i;
+
+	if (hctx->rqs) {
+		for (i = 0; i < hctx->queue_depth; i++)
+			kfree(hctx->rqs[i]);
+		kfree(hctx->rqs);
+	}
+	if (hctx->tags)
+		blk_mq_free_tags(hctx->tags);
+}
+
+static int blk_mq_init_rq_map(struct blk_mq_hw_ctx *hctx)
+{
+	size_t rq_size = sizeof(struct request) + hctx->cmd_size;
+	unsigned int i;
+
+	hctx->tags = blk_mq_init_tags(hctx->queue_depth, hctx->numa_node);
+	if (!hctx->tags)
+		return -ENOMEM;
+
+	hctx->rqs = kzalloc_node(hctx->queue_depth * sizeof(struct request *),
+				 GFP_KERNEL, hctx->numa_node);
+	if (!hctx->rqs)
+		return -ENOMEM;
+
+	for (i = 0; i < hctx->queue_depth; i++) {
+		hctx->rqs[i] = kzalloc_node(rq_size, GFP_KERNEL,
+					    hctx->numa_node);
+		if (!hctx->rqs[i])
+			return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static void blk_mq_free_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	blk_mq_free_rq_map(hctx);
+	kfree(hctx->ctx_map);
+	kfree(hctx->ctxs);
+	free_cpumask_var(hctx->cpumask);
+	kfree(hctx);
+}
+
+static int blk_mq_init_hw_queues(struct request_queue *q,
+				 struct blk_mq_reg *reg, void *driver_data)
+{
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i;
+
+	for (i = 0; i < reg->nr_hw_queues; i++) {
+		hctx = kzalloc_node(sizeof(*hctx), GFP_KERNEL, reg->numa_node);
+		if (!hctx)
+			return -ENOMEM;
+		q->queue_hw_ctx[i] = hctx;
+
+		spin_lock_init(&hctx->lock);
+		INIT_LIST_HEAD(&hctx->dispatch);
+		INIT_DELAYED_WORK(&hctx->delayed_work, blk_mq_work_fn);
+		hctx->queue = q;
+		hctx->queue_num = i;
+		hctx->flags = reg->flags;
+		hctx->queue_depth = reg->queue_depth;
+		hctx->numa_node = reg->numa_node;
+		hctx->cmd_size = reg->cmd_size;
+
+		if (!zalloc_cpumask_var_node(&hctx->cpumask, GFP_KERNEL,
+					     reg->numa_node))
+			return -ENOMEM;
+
+		hctx->ctxs = kzalloc_node(nr_cpu_ids * sizeof(void *),
+					  GFP_KERNEL, reg->numa_node);
+		hctx->ctx_map = kzalloc_node(BITS_TO_LONGS(nr_cpu_ids) *
+					     sizeof(unsigned long),
+					     GFP_KERNEL, reg->numa_node);
+		if (!hctx->ctxs || !hctx->ctx_map)
+			return -ENOMEM;
+
+		if (blk_mq_init_rq_map(hctx))
+			return -ENOMEM;
+	}
+
+	/* the driver sees complete hardware contexts only */
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (!reg->ops->init_hctx)
+			break;
+		if (reg->ops->init_hctx(hctx, driver_data, i))
+			goto err_exit;
+	}
+
+	return 0;
+
+err_exit:
+	while (i--) {
+		if (reg->ops->exit_hctx)
+			reg->ops->exit_hctx(q->queue_hw_ctx[i], i);
+	}
+	return -ENOMEM;
+}
+
+static void blk_mq_init_cpu_queues(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_mq_ctx *ctx;
+	unsigned int cpu;
+
+	for_each_possible_cpu(cpu) {
+		ctx = per_cpu_ptr(q->queue_ctx, cpu);
+		memset(ctx, 0, sizeof(*ctx));
+		spin_lock_init(&ctx->lock);
+		INIT_LIST_HEAD(&ctx->rq_list);
+		ctx->cpu = cpu;
+		ctx->queue = q;
+		blk_rq_stat_init(&ctx->poll_stat[READ]);
+		blk_rq_stat_init(&ctx->poll_stat[WRITE]);
+
+		hctx = q->mq_ops->map_queue(q, cpu);
+		cpumask_set_cpu(cpu, hctx->cpumask);
+		ctx->index_hw = hctx->nr_ctx;
+		hctx->ctxs[hctx->nr_ctx++] = ctx;
+	}
+}
+
+/**
+ * blk_mq_init_queue - set up a multi-queue request queue
+ * @reg:	the operations and the geometry of the hardware queues
+ * @driver_data: passed to ->init_hctx() for every hardware queue
+ *
+ * Allocates the request queue with one software queue per possible CPU,
+ * @reg->nr_hw_queues hardware contexts of @reg->queue_depth requests each,
+ * and @reg->cmd_size bytes of driver data behind every request.  Returns
+ * the queue or an ERR_PTR().
+ */
+struct request_queue *blk_mq_init_queue(struct blk_mq_reg *reg,
+					void *driver_data)
+{
+	struct request_queue *q;
+	unsigned int i;
+
+	if (!reg->nr_hw_queues || !reg->ops->queue_rq ||
+	    !reg->ops->map_queue)
+		return ERR_PTR(-EINVAL);
+
+	if (!reg->queue_depth)
+		reg->queue_depth = BLK_MQ_MAX_DEPTH;
+	else if (reg->queue_depth > BLK_MQ_MAX_DEPTH) {
+		printk(KERN_ERR "blk-mq: queuedepth too large (%u)\n",
+		       reg->queue_depth);
+		reg->queue_depth = BLK_MQ_MAX_DEPTH;
+	}
+
+	q = blk_alloc_queue_node(GFP_KERNEL, reg->numa_node);
+	if (!q)
+		return ERR_PTR(-ENOMEM);
+
+	q->mq_ops = reg->ops;
+	q->queue_ctx = alloc_percpu(struct blk_mq_ctx);
+	q->queue_hw_ctx = kzalloc_node(reg->nr_hw_queues * sizeof(void *),
+				       GFP_KERNEL, reg->numa_node);
+	q->mq_map = blk_mq_make_queue_map(reg->nr_hw_queues);
+	if (!q->queue_ctx || !q->queue_hw_ctx || !q->mq_map)
+		goto err;
+
+	q->nr_queues = nr_cpu_ids;
+	q->nr_hw_queues = reg->nr_hw_queues;
+
+	if (blk_mq_init_hw_queues(q, reg, driver_data))
+		goto err;
+
+	blk_mq_init_cpu_queues(q);
+
+	blk_queue_make_request(q, blk_mq_make_request);
+	q->queue_flags |= QUEUE_FLAG_MQ_DEFAULT;
+	q->nr_requests = reg->queue_depth;
+
+	q->poll_nsec = 0;
+	q->poll_stat_time = jiffies;
+	blk_rq_stat_init(&q->poll_stat[READ]);
+	blk_rq_stat_init(&q->poll_stat[WRITE]);
+
+	return q;
+
+err:
+	/* releasing the queue frees what has been set up so far */
+	if (q->queue_hw_ctx) {
+		for (i = 0; i < reg->nr_hw_queues; i++)
+			if (!q->queue_hw_ctx[i])
+				break;
+		q->nr_hw_queues = i;
+	}
+	q->mq_ops = NULL;
+	blk_mq_free_queue(q);
+	blk_cleanup_queue(q);
+	return ERR_PTR(-ENOMEM);
+}
+EXPORT_SYMBOL(blk_mq_init_queue);
+
+/*
+ * Called when the last reference to @q is dropped, see blk_release_queue()
+ */
+void blk_mq_free_queue(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i;
+
+	if (q->queue_hw_ctx) {
+		queue_for_each_hw_ctx(q, hctx, i) {
+			cancel_delayed_work_sync(&hctx->delayed_work);
+			if (q->mq_ops && q->mq_ops->exit_hctx)
+				q->mq_ops->exit_hctx(hctx, i);
+			blk_mq_free_hw_queue(hctx);
+		}
+	}
+
+	kfree(q->queue_hw_ctx);
+	kfree(q->mq_map);
+	free_percpu(q->queue_ctx);
+
+	q->queue_hw_ctx = NULL;
+	q->mq_map = NULL;
+	q->queue_ctx = NULL;
+	q->nr_hw_queues = 0;
+}
@@ -0,0 +1,33 @@
+#ifndef INT_BLK_MQ_H
+#define INT_BLK_MQ_H
+
+struct blk_mq_ctx {
+	struct {
+		spinlock_t		lock;
+		struct list_head	rq_list;
+	}  ____cacheline_aligned_in_smp;
+
+	unsigned int		cpu;
+	unsigned int		index_hw;	/* bit in hctx->ctx_map */
+	unsigned int		last_tag ____cacheline_aligned_in_smp;
+
+	struct request_queue	*queue;
+
+	/* completion times seen on this CPU, folded into q->poll_stat */
+	struct blk_rq_stat	poll_stat[2];
+};
+
+void blk_mq_flush_plug_list(struct blk_plug *plug, bool from_schedule);
+void blk_mq_free_queue(struct request_queue *q);
+void blk_mq_poll_stat_refresh(struct request_queue *q);
+
+/*
+ * Tag allocation, blk-mq-tag.c
+ */
+struct blk_mq_tags *blk_mq_init_tags(unsigned int nr_tags, int node);
+void blk_mq_free_tags(struct blk_mq_tags *tags);
+int blk_mq_get_tag(struct blk_mq_tags *tags, unsigned int *last_tag);
+void blk_mq_put_tag(struct blk_mq_tags *tags, unsigned int tag);
+void blk_mq_wait_for_tags(struct blk_mq_tags *tags);
+
+#endif
@@ -7,8 +7,10 @@
 #include <linux/bio.h>
 #include <linux/blkdev.h>
 #include <linux/blktrace_api.h>
+#include <linux/blk-mq.h>
 
 #include "blk.h"
+#include "blk-mq.h"
 
 struct queue_sysfs_entry {
 	struct attribute attr;
@@ -266,6 +268,88 @@ queue_rq_affinity_store(struct request_queue *q, const char *page, size_t count)
 	return ret;
 }
 
+static ssize_t queue_poll_show(struct request_queue *q, char *page)
+{
+	return queue_var_show(blk_queue_poll(q), page);
+}
+
+static ssize_t queue_poll_store(struct request_queue *q, const char *page,
+				size_t count)
+{
+	unsigned long poll_on;
+	ssize_t ret;
+
+	if (!q->mq_ops || !q->mq_ops->poll)
+		return -EINVAL;
+
+	ret = queue_var_store(&poll_on, page, count);
+
+	spin_lock_irq(q->queue_lock);
+	if (poll_on)
+		queue_flag_set(QUEUE_FLAG_POLL, q);
+	else
+		queue_flag_clear(QUEUE_FLAG_POLL, q);
+	spin_unlock_irq(q->queue_lock);
+
+	return ret;
+}
+
+static ssize_t queue_poll_delay_show(struct request_queue *q, char *page)
+{
+	if (q->poll_nsec < 0)
+		return sprintf(page, "-1\n");
+
+	return sprintf(page, "%ld\n", q->poll_nsec / NSEC_PER_USEC);
+}
+
+static ssize_t queue_poll_delay_store(struct request_queue *q,
+				      const char *page, size_t count)
+{
+	char *p = (char *) page;
+	long val;
+
+	if (!q->mq_ops || !q->mq_ops->poll)
+		return -EINVAL;
+
+	val = simple_strtol(p, &p, 10);
+	if (val < -1 || val > INT_MAX / NSEC_PER_USEC)
+		return -EINVAL;
+
+	q->poll_nsec = val < 0 ? -1 : val * NSEC_PER_USEC;
+	return count;
+}
+
+static ssize_t queue_poll_stat_show(struct request_queue *q, char *page)
+{
+	struct blk_mq_hw_ctx *hctx;
+	unsigned long invoked = 0, success = 0, sleeps = 0;
+	ssize_t ret = 0;
+	int i;
+
+	if (!q->mq_ops)
+		return -EINVAL;
+
+	blk_mq_poll_stat_refresh(q);
+	for (i = READ; i <= WRITE; i++)
+		ret += sprintf(page + ret, "%s samples=%u mean=%llu min=%llu "
+			       "max=%llu\n", i == READ ? "read" : "write",
+			       q->poll_stat[i].nr_samples,
+			       q->poll_stat[i].mean,
+			       q->poll_stat[i].nr_samples ?
+					q->poll_stat[i].min : 0,
+			       q->poll_stat[i].max);
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		invoked += hctx->poll_invoked;
+		success += hctx->poll_success;
+		sleeps += hctx->poll_sleeps;
+	}
+	ret += sprintf(page + ret, "polls=%lu completed=%lu sleeps=%lu\n",
+		       invoked, success, sleeps);
+
+	return ret;
+}
+
 static struct queue_sysfs_entry queue_requests_entry = {
 	.attr = {.name = "nr_requests", .mode = S_IRUGO | S_IWUSR },
 	.show = queue_requests_show,
@@ -380,6 +464,23 @@ static struct queue_sysfs_entry queue_random_entry = {
 	.store = queue_store_random,
 };
 
+static struct queue_sysfs_entry queue_poll_entry = {
+	.attr = {.name = "io_poll", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_poll_show,
+	.store = queue_poll_store,
+};
+
+static struct queue_sysfs_entry queue_poll_delay_entry = {
+	.attr = {.name = "io_poll_delay", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_poll_delay_show,
+	.store = queue_poll_delay_store,
+};
+
+static struct queue_sysfs_entry queue_poll_stat_entry = {
+	.attr = {.name = "io_poll_stat", .mode = S_IRUGO },
+	.show = queue_poll_stat_show,
+};
+
 static struct attribute *default_attrs[] = {
 	&queue_requests_entry.attr,
 	&queue_ra_entry.attr,
@@ -402,6 +503,9 @@ static struct attribute *default_attrs[] = {
 	&queue_rq_affinity_entry.attr,
 	&queue_iostats_entry.attr,
 	&queue_random_entry.attr,
+	&queue_poll_entry.attr,
+	&queue_poll_delay_entry.attr,
+	&queue_poll_stat_entry.attr,
 	NULL,
 };
 
@@ -475,6 +579,9 @@ static void blk_release_queue(struct kobject *kobj)
 	if (q->elevator)
 		elevator_exit(q->elevator);
 
+	if (q->mq_ops)
+		blk_mq_free_queue(q);
+
 	blk_throtl_exit(q);
 
 	if (rl->rq_pool)
@@ -20,6 +20,17 @@ static int throtl_quantum = 32;
 /* Throttling is performed over 100ms slice and after that slice is renewed */
 static unsigned long throtl_slice = HZ/10;	/* 100 ms */
 
+/*
+ * Completion latencies of the groups with a latency target are checked every
+ * window.  If more than 1 in throtl_lat_miss_ratio of their requests missed
+ * the target, the IOPS of the groups without one are capped, the cap halving
+ * every window the target is still missed and growing back by a quarter
+ * every window it is met.
+ */
+static unsigned long throtl_lat_window = HZ/10;	/* 100 ms */
+static unsigned int throtl_lat_miss_ratio = 10;
+#define THROTL_LAT_IOPS_MIN	16
+
 /* A workqueue to queue throttle related work */
 static struct workqueue_struct *kthrotld_workqueue;
 static void throtl_schedule_delayed_work(struct throtl_data *td,
@@ -67,6 +78,9 @@ struct throtl_grp {
 	/* IOPS limits */
 	unsigned int iops[2];
 
+	/* completion latency target in usecs, 0 for none */
+	unsigned int latency_target;
+
 	/* Number of bytes disptached in current slice */
 	uint64_t bytes_disp[2];
 	/* Number of bio's dispatched in current slice */
@@ -105,6 +119,17 @@ struct throtl_data
 	struct delayed_work throtl_work;
 
 	int limits_changed;
+
+	/*
+	 * IOPS cap of the groups without a latency target, 0 for none, and
+	 * the completions seen in the current latency window.
+	 */
+	unsigned int lat_iops;
+	atomic_t lat_missed;
+	atomic_t lat_prot_done;
+	atomic_t lat_bg_done;
+	unsigned long lat_window_start;
+	struct delayed_work lat_work;
 };
 
 enum tg_state_flags {
@@ -258,6 +283,7 @@ static void throtl_init_add_tg_lists(struct throtl_data *td,
 	tg->bps[WRITE] = blkcg_get_write_bps(blkcg, tg->blkg.dev);
 	tg->iops[READ] = blkcg_get_read_iops(blkcg, tg->blkg.dev);
 	tg->iops[WRITE] = blkcg_get_write_iops(blkcg, tg->blkg.dev);
+	tg->latency_target = blkcg->latency_target;
 
 	throtl_add_group_to_td_list(td, tg);
 }
@@ -520,6 +546,20 @@ static inline void throtl_extend_slice(struct throtl_data *td,
 			tg->slice_end[rw], jiffies);
 }
 
+/*
+ * IOPS limit of @tg, including the cap put on the groups without a latency
+ * target while another group misses its own.
+ */
+static inline unsigned int
+tg_iops(struct throtl_data *td, struct throtl_grp *tg, bool rw)
+{
+	unsigned int lat_iops = ACCESS_ONCE(td->lat_iops);
+
+	if (lat_iops && !tg->latency_target)
+		return min(tg->iops[rw], lat_iops);
+	return tg->iops[rw];
+}
+
 /* Determine if previously allocated or extended slice is complete or not */
 static bool
 throtl_slice_used(struct throtl_data *td, struct throtl_grp *tg, bool rw)
@@ -567,7 +607,7 @@ throtl_trim_slice(struct throtl_data *td, struct throtl_grp *tg, bool rw)
 	do_div(tmp, HZ);
 	bytes_trim = tmp;
 
-	io_trim = (tg->iops[rw] * throtl_slice * nr_slices)/HZ;
+	io_trim = (tg_iops(td, tg, rw) * throtl_slice * nr_slices)/HZ;
 
 	if (!bytes_trim && !io_trim)
 		return;
@@ -594,7 +634,7 @@ static bool tg_with_in_iops_limit(struct throtl_data *td, struct throtl_grp *tg,
 		struct bio *bio, unsigned long *wait)
 {
 	bool rw = bio_data_dir(bio);
-	unsigned int io_allowed;
+	unsigned int io_allowed, iops = tg_iops(td, tg, rw);
 	unsigned long jiffy_elapsed, jiffy_wait, jiffy_elapsed_rnd;
 	u64 tmp;
 
@@ -613,7 +653,7 @@ static bool tg_with_in_iops_limit(struct throtl_data *td, struct throtl_grp *tg,
 	 * have been trimmed.
 	 */
 
-	tmp = (u64)tg->iops[rw] * jiffy_elapsed_rnd;
+	tmp = (u64)iops * jiffy_elapsed_rnd;
 	do_div(tmp, HZ);
 
 	if (tmp > UINT_MAX)
@@ -628,7 +668,7 @@ static bool tg_with_in_iops_limit(struct throtl_data *td, struct throtl_grp *tg,
 	}
 
 	/* Calc approx time to dispatch */
-	jiffy_wait = ((tg->io_disp[rw] + 1) * HZ)/tg->iops[rw] + 1;
+	jiffy_wait = ((tg->io_disp[rw] + 1) * HZ)/iops + 1;
 
 	if (jiffy_wait > jiffy_elapsed)
 		jiffy_wait = jiffy_wait - jiffy_elapsed;
@@ -682,8 +722,9 @@ static bool tg_with_in_bps_limit(struct throtl_data *td, struct throtl_grp *tg,
 	return 0;
 }
 
-static bool tg_no_rule_group(struct throtl_grp *tg, bool rw) {
-	if (tg->bps[rw] == -1 && tg->iops[rw] == -1)
+static bool tg_no_rule_group(struct throtl_data *td, struct throtl_grp *tg,
+			bool rw) {
+	if (tg->bps[rw] == -1 && tg_iops(td, tg, rw) == -1)
 		return 1;
 	return 0;
 }
@@ -707,7 +748,7 @@ static bool tg_may_dispatch(struct throtl_data *td, struct throtl_grp *tg,
 	BUG_ON(tg->nr_queued[rw] && bio != bio_list_peek(&tg->bio_lists[rw]));
 
 	/* If tg->bps = -1, then BW is unlimited */
-	if (tg->bps[rw] == -1 && tg->iops[rw] == -1) {
+	if (tg_no_rule_group(td, tg, rw)) {
 		if (wait)
 			*wait = 0;
 		return 1;
@@ -982,6 +1023,65 @@ throtl_schedule_delayed_work(struct throtl_data *td, unsigned long delay)
 	}
 }
 
+/*
+ * End of a latency window: move the IOPS cap of the groups without a latency
+ * target according to how the groups with one fared, see throtl_lat_window.
+ */
+static void throtl_lat_work(struct work_struct *work)
+{
+	struct throtl_data *td = container_of(work, struct throtl_data,
+					lat_work.work);
+	struct request_queue *q = td->queue;
+	unsigned int missed, prot_done, bg_done, bg_iops, iops;
+	unsigned long elapsed;
+	struct throtl_grp *tg;
+	struct hlist_node *pos;
+
+	missed = atomic_xchg(&td->lat_missed, 0);
+	prot_done = atomic_xchg(&td->lat_prot_done, 0);
+	bg_done = atomic_xchg(&td->lat_bg_done, 0);
+
+	spin_lock_irq(q->queue_lock);
+
+	elapsed = max(jiffies - td->lat_window_start, 1UL);
+	td->lat_window_start = jiffies;
+	bg_iops = div_u64((u64)bg_done * HZ, elapsed);
+
+	iops = td->lat_iops;
+	if (missed && missed * throtl_lat_miss_ratio >= prot_done) {
+		if (!iops)
+			iops = bg_iops / 2;
+		else
+			iops /= 2;
+		iops = max_t(unsigned int, iops, THROTL_LAT_IOPS_MIN);
+	} else if (iops) {
+		/* lift the cap once nobody needs it or it no longer binds */
+		if (!prot_done || iops / 2 > bg_iops)
+			iops = 0;
+		else
+			iops += iops / 4 + 1;
+	}
+
+	if (iops != td->lat_iops) {
+		throtl_log(td, "latency missed=%u/%u bg_iops=%u iops=%u",
+				missed, prot_done, bg_iops, iops);
+		td->lat_iops = iops;
+
+		/* restart the slices of the capped groups, like a limit change */
+		hlist_for_each_entry(tg, pos, &td->tg_list, tg_node)
+			if (!tg->latency_target)
+				xchg(&tg->limits_changed, true);
+		xchg(&td->limits_changed, true);
+		throtl_schedule_delayed_work(td, 0);
+	}
+
+	if (prot_done || td->lat_iops)
+		queue_delayed_work(kthrotld_workqueue, &td->lat_work,
+					throtl_lat_window);
+
+	spin_unlock_irq(q->queue_lock);
+}
+
 static void
 throtl_destroy_tg(struct throtl_data *td, struct throtl_grp *tg)
 {
@@ -1101,10 +1201,21 @@ static void throtl_update_blkio_group_write_iops(void *key,
 	throtl_update_blkio_group_common(td, tg);
 }
 
+static void throtl_update_blkio_group_latency_target(void *key,
+			struct blkio_group *blkg, unsigned int latency_target)
+{
+	struct throtl_data *td = key;
+	struct throtl_grp *tg = tg_of_blkg(blkg);
+
+	tg->latency_target = latency_target;
+	throtl_update_blkio_group_common(td, tg);
+}
+
 static void throtl_shutdown_wq(struct request_queue *q)
 {
 	struct throtl_data *td = q->td;
 
+	cancel_delayed_work_sync(&td->lat_work);
 	cancel_delayed_work_sync(&td->throtl_work);
 }
 
@@ -1119,6 +1230,8 @@ static struct blkio_policy_type blkio_policy_throtl = {
 					throtl_update_blkio_group_read_iops,
 		.blkio_update_group_write_iops_fn =
 					throtl_update_blkio_group_write_iops,
+		.blkio_update_group_latency_target_fn =
+					throtl_update_blkio_group_latency_target,
 	},
 	.plid = BLKIO_POLICY_THROTL,
 };
@@ -1148,7 +1261,7 @@ int blk_throtl_bio(struct request_queue *q, struct bio **biop)
 	if (tg) {
 		throtl_tg_fill_dev_details(td, tg);
 
-		if (tg_no_rule_group(tg, rw)) {
+		if (tg_no_rule_group(td, tg, rw)) {
 			blkiocg_update_dispatch_stats(&tg->blkg, bio->bi_size,
 					rw, bio->bi_rw & REQ_SYNC);
 			rcu_read_unlock();
@@ -1208,7 +1321,7 @@ queue_bio:
 			" iodisp=%u iops=%u queued=%d/%d",
 			rw == READ ? 'R' : 'W',
 			tg->bytes_disp[rw], bio->bi_size, tg->bps[rw],
-			tg->io_disp[rw], tg->iops[rw],
+			tg->io_disp[rw], tg_iops(td, tg, rw),
 			tg->nr_queued[READ], tg->nr_queued[WRITE]);
 
 	throtl_add_bio_tg(q->td, tg, bio);
@@ -1224,6 +1337,63 @@ out:
 	return 0;
 }
 
+/*
+ * Requests hold a reference on the group of the task that submitted them,
+ * so that their completion latency can be accounted to it.
+ */
+void blk_throtl_rq_init(struct request *rq)
+{
+	struct throtl_data *td = rq->q->td;
+	struct throtl_grp *tg;
+
+	if (!td)
+		return;
+
+	rcu_read_lock();
+	tg = throtl_find_tg(td, task_blkio_cgroup(current));
+	if (tg && atomic_inc_not_zero(&tg->ref))
+		rq->throtl_grp = tg;
+	rcu_read_unlock();
+}
+
+void blk_throtl_rq_done(struct request *rq)
+{
+	struct throtl_data *td = rq->q->td;
+	struct throtl_grp *tg = rq->throtl_grp;
+	unsigned long long now = sched_clock();
+	u64 latency = 0;
+
+	if (!tg)
+		return;
+
+	if (time_after64(now, rq_start_time_ns(rq)))
+		latency = now - rq_start_time_ns(rq);
+	blkiocg_update_latency_stats(&tg->blkg, latency, rq_data_dir(rq));
+
+	if (!tg->latency_target) {
+		/* only worth counting while some group has a target */
+		if (atomic_read(&td->lat_prot_done) || td->lat_iops)
+			atomic_inc(&td->lat_bg_done);
+		return;
+	}
+
+	if (latency > (u64)tg->latency_target * NSEC_PER_USEC)
+		atomic_inc(&td->lat_missed);
+	/* first completion of a group with a target opens a window */
+	if (atomic_inc_return(&td->lat_prot_done) == 1 &&
+	    queue_delayed_work(kthrotld_workqueue, &td->lat_work,
+				throtl_lat_window))
+		td->lat_window_start = jiffies;
+}
+
+void blk_throtl_rq_free(struct request *rq)
+{
+	if (rq->throtl_grp) {
+		throtl_put_tg(rq->throtl_grp);
+		rq->throtl_grp = NULL;
+	}
+}
+
 int blk_throtl_init(struct request_queue *q)
 {
 	struct throtl_data *td;
@@ -1237,6 +1407,8 @@ int blk_throtl_init(struct request_queue *q)
 	td->tg_service_tree = THROTL_RB_ROOT;
 	td->limits_changed = false;
 	INIT_DELAYED_WORK(&td->throtl_work, blk_throtl_work);
+	INIT_DELAYED_WORK(&td->lat_work, throtl_lat_work);
+	td->lat_window_start = jiffies;
 
 	/* alloc and Init root group. */
 	td->queue = q;
@@ -0,0 +1,357 @@
+/*
+ *  Flash i/o scheduler.
+ *
+ *  An elevator for devices without seek penalty, eMMC and SD in
+ *  particular, where a read stuck behind background writeback is what the
+ *  user notices.  Requests are kept in three FIFOs, reads, sync writes and
+ *  async writes, and there is neither sorting nor idling:
+ *
+ *  - a request whose deadline has passed goes first;
+ *  - otherwise reads go before writes, but only writes_starved times in a
+ *    row while writes wait, after which a batch of write_batch writes is
+ *    dispatched;
+ *  - sync writes go before async writes.
+ *
+ *  The deadline of a request is the expiry of its class, or the latency
+ *  target of the blkio cgroup of the submitter if that is shorter, so
+ *  that the I/O of an interactive group overtakes that of the others.
+ */
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/blkdev.h>
+#include <linux/elevator.h>
+#include <linux/bio.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/init.h>
+#include <linux/compiler.h>
+#include "blk-cgroup.h"
+
+/*
+ * See Documentation/block/flash-iosched.txt
+ */
+static const int read_expire = HZ / 10;		/* max time before a read is submitted */
+static const int sync_write_expire = HZ / 4;	/* ditto for sync writes */
+static const int async_write_expire = 2 * HZ;	/* and writeback */
+static const int writes_starved = 4;		/* max reads in a row while writes wait */
+static const int write_batch = 8;		/* writes dispatched once they starved */
+
+enum flash_class {
+	FLASH_READ,
+	FLASH_SYNC_WRITE,
+	FLASH_ASYNC_WRITE,
+	FLASH_NR_CLASSES,
+};
+
+struct flash_data {
+	/*
+	 * run time data
+	 */
+
+	/* requests of every class, in deadline order */
+	struct list_head fifo_list[FLASH_NR_CLASSES];
+
+	unsigned int starved;		/* reads dispatched while writes waited */
+	unsigned int batching;		/* writes left in the current batch */
+
+	/*
+	 * settings that change how the i/o scheduler behaves
+	 */
+	int fifo_expire[FLASH_NR_CLASSES];
+	int writes_starved;
+	int write_batch;
+	int group_latency;
+};
+
+static inline enum flash_class flash_class(struct request *rq)
+{
+	if (rq_data_dir(rq) == READ)
+		return FLASH_READ;
+	if (rq_is_sync(rq))
+		return FLASH_SYNC_WRITE;
+	return FLASH_ASYNC_WRITE;
+}
+
+/*
+ * Deadlines in a class mostly increase in the order requests arrive, only
+ * a cgroup latency target moves a request ahead, so the insertion point
+ * is looked for from the tail.
+ */
+static void flash_fifo_insert(struct list_head *head, struct request *rq)
+{
+	struct request *pos;
+
+	list_for_each_entry_reverse(pos, head, queuelist)
+		if (!time_before(rq_fifo_time(rq), rq_fifo_time(pos)))
+			break;
+
+	list_add(&rq->queuelist, &pos->queuelist);
+}
+
+static void flash_add_request(struct request_queue *q, struct request *rq)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	const enum flash_class class = flash_class(rq);
+	unsigned long expire = fd->fifo_expire[class];
+	unsigned int target;
+
+	if (fd->group_latency) {
+		target = blkiocg_latency_target(current);
+		if (target && usecs_to_jiffies(target) < expire)
+			expire = usecs_to_jiffies(target);
+	}
+
+	rq_set_fifo_time(rq, jiffies + expire);
+	flash_fifo_insert(&fd->fifo_list[class], rq);
+}
+
+static void flash_merged_requests(struct request_queue *q,
+				  struct request *req, struct request *next)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	/*
+	 * if next expires before rq, give rq its deadline and move it up
+	 * its own fifo accordingly, also when next is a write of the other
+	 * class; next will be deleted
+	 */
+	if (time_before(rq_fifo_time(next), rq_fifo_time(req))) {
+		rq_set_fifo_time(req, rq_fifo_time(next));
+		list_del_init(&req->queuelist);
+		flash_fifo_insert(&fd->fifo_list[flash_class(req)], req);
+	}
+
+	rq_fifo_clear(next);
+}
+
+static inline struct request *flash_fifo_head(struct flash_data *fd,
+					      enum flash_class class)
+{
+	if (list_empty(&fd->fifo_list[class]))
+		return NULL;
+	return rq_entry_fifo(fd->fifo_list[class].next);
+}
+
+/*
+ * The class whose first request has been waiting past its deadline for
+ * the longest time, or -1 if none has.
+ */
+static int flash_expired_class(struct flash_data *fd)
+{
+	struct request *rq, *first = NULL;
+	int class, expired = -1;
+
+	for (class = 0; class < FLASH_NR_CLASSES; class++) {
+		rq = flash_fifo_head(fd, class);
+		if (!rq || !time_after_eq(jiffies, rq_fifo_time(rq)))
+			continue;
+		if (!first || time_before(rq_fifo_time(rq), rq_fifo_time(first))) {
+			first = rq;
+			expired = class;
+		}
+	}
+
+	return expired;
+}
+
+static inline int flash_write_class(struct flash_data *fd)
+{
+	if (!list_empty(&fd->fifo_list[FLASH_SYNC_WRITE]))
+		return FLASH_SYNC_WRITE;
+	return FLASH_ASYNC_WRITE;
+}
+
+/*
+ * flash_dispatch_requests selects the request to go next, see the top
+ * of the file.  It never holds the queue back waiting for more I/O.
+ */
+static int flash_dispatch_requests(struct request_queue *q, int force)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	const int reads = !list_empty(&fd->fifo_list[FLASH_READ]);
+	const int writes = !list_empty(&fd->fifo_list[FLASH_SYNC_WRITE]) ||
+			   !list_empty(&fd->fifo_list[FLASH_ASYNC_WRITE]);
+	struct request *rq;
+	int class;
+
+	if (!reads && !writes)
+		return 0;
+
+	class = flash_expired_class(fd);
+	if (class >= 0)
+		goto dispatch_request;
+
+	/* finish a batch of starved writes */
+	if (fd->batching && writes) {
+		fd->batching--;
+		class = flash_write_class(fd);
+		goto dispatch_request;
+	}
+	fd->batching = 0;
+
+	if (reads) {
+		if (writes && fd->starved >= fd->writes_starved) {
+			fd->batching = fd->write_batch ? fd->write_batch - 1 : 0;
+			class = flash_write_class(fd);
+			goto dispatch_request;
+		}
+
+		class = FLASH_READ;
+		goto dispatch_request;
+	}
+
+	class = flash_write_class(fd);
+
+dispatch_request:
+	if (class == FLASH_READ) {
+		if (writes)
+			fd->starved++;
+	} else
+		fd->starved = 0;
+
+	rq = flash_fifo_head(fd, class);
+	rq_fifo_clear(rq);
+	elv_dispatch_add_tail(q, rq);
+
+	return 1;
+}
+
+static void flash_exit_queue(struct elevator_queue *e)
+{
+	struct flash_data *fd = e->elevator_data;
+	int class;
+
+	for (class = 0; class < FLASH_NR_CLASSES; class++)
+		BUG_ON(!list_empty(&fd->fifo_list[class]));
+
+	kfree(fd);
+}
+
+/*
+ * initialize elevator private data (flash_data).
+ */
+static void *flash_init_queue(struct request_queue *q)
+{
+	struct flash_data *fd;
+	int class;
+
+	fd = kmalloc_node(sizeof(*fd), GFP_KERNEL | __GFP_ZERO, q->node);
+	if (!fd)
+		return NULL;
+
+	for (class = 0; class < FLASH_NR_CLASSES; class++)
+		INIT_LIST_HEAD(&fd->fifo_list[class]);
+	fd->fifo_expire[FLASH_READ] = read_expire;
+	fd->fifo_expire[FLASH_SYNC_WRITE] = sync_write_expire;
+	fd->fifo_expire[FLASH_ASYNC_WRITE] = async_write_expire;
+	fd->writes_starved = writes_starved;
+	fd->write_batch = write_batch;
+	fd->group_latency = 1;
+	return fd;
+}
+
+/*
+ * sysfs parts below
+ */
+
+static ssize_t
+flash_var_show(int var, char *page)
+{
+	return sprintf(page, "%d\n", var);
+}
+
+static ssize_t
+flash_var_store(int *var, const char *page, size_t count)
+{
+	char *p = (char *) page;
+
+	*var = simple_strtol(p, &p, 10);
+	return count;
+}
+
+#define SHOW_FUNCTION(__FUNC, __VAR, __CONV)				\
+static ssize_t __FUNC(struct elevator_queue *e, char *page)		\
+{									\
+	struct flash_data *fd = e->elevator_data;			\
+	int __data = __VAR;						\
+	if (__CONV)							\
+		__data = jiffies_to_msecs(__data);			\
+	return flash_var_show(__data, (page));				\
+}
+SHOW_FUNCTION(flash_read_expire_show, fd->fifo_expire[FLASH_READ], 1);
+SHOW_FUNCTION(flash_sync_write_expire_show, fd->fifo_expire[FLASH_SYNC_WRITE], 1);
+SHOW_FUNCTION(flash_async_write_expire_show, fd->fifo_expire[FLASH_ASYNC_WRITE], 1);
+SHOW_FUNCTION(flash_writes_starved_show, fd->writes_starved, 0);
+SHOW_FUNCTION(flash_write_batch_show, fd->write_batch, 0);
+SHOW_FUNCTION(flash_group_latency_show, fd->group_latency, 0);
+#undef SHOW_FUNCTION
+
+#define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
+static ssize_t __FUNC(struct elevator_queue *e, const char *page, size_t count)	\
+{									\
+	struct flash_data *fd = e->elevator_data;			\
+	int __data;							\
+	int ret = flash_var_store(&__data, (page), count);		\
+	if (__data < (MIN))						\
+		__data = (MIN);						\
+	else if (__data > (MAX))					\
+		__data = (MAX);						\
+	if (__CONV)							\
+		*(__PTR) = msecs_to_jiffies(__data);			\
+	else								\
+		*(__PTR) = __data;					\
+	return ret;							\
+}
+STORE_FUNCTION(flash_read_expire_store, &fd->fifo_expire[FLASH_READ], 0, INT_MAX, 1);
+STORE_FUNCTION(flash_sync_write_expire_store, &fd->fifo_expire[FLASH_SYNC_WRITE], 0, INT_MAX, 1);
+STORE_FUNCTION(flash_async_write_expire_store, &fd->fifo_expire[FLASH_ASYNC_WRITE], 0, INT_MAX, 1);
+STORE_FUNCTION(flash_writes_starved_store, &fd->writes_starved, 0, INT_MAX, 0);
+STORE_FUNCTION(flash_write_batch_store, &fd->write_batch, 1, INT_MAX, 0);
+STORE_FUNCTION(flash_group_latency_store, &fd->group_latency, 0, 1, 0);
+#undef STORE_FUNCTION
+
+#define FD_ATTR(name) \
+	__ATTR(name, S_IRUGO|S_IWUSR, flash_##name##_show, \
+				      flash_##name##_store)
+
+static struct elv_fs_entry flash_attrs[] = {
+	FD_ATTR(read_expire),
+	FD_ATTR(sync_write_expire),
+	FD_ATTR(async_write_expire),
+	FD_ATTR(writes_starved),
+	FD_ATTR(write_batch),
+	FD_ATTR(group_latency),
+	__ATTR_NULL
+};
+
+static struct elevator_type iosched_flash = {
+	.ops = {
+		.elevator_merge_req_fn =	flash_merged_requests,
+		.elevator_dispatch_fn =		flash_dispatch_requests,
+		.elevator_add_req_fn =		flash_add_request,
+		.elevator_init_fn =		flash_init_queue,
+		.elevator_exit_fn =		flash_exit_queue,
+	},
+
+	.elevator_attrs = flash_attrs,
+	.elevator_name = "flash",
+	.elevator_owner = THIS_MODULE,
+};
+
+static int __init flash_init(void)
+{
+	elv_register(&iosched_flash);
+
+	return 0;
+}
+
+static void __exit flash_exit(void)
+{
+	elv_unregister(&iosched_flash);
+}
+
+module_init(flash_init);
+module_exit(flash_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("flash IO scheduler");
@@ -0,0 +1,201 @@
+/*
+ * drivers/gpu/ion/ion_cma_heap.c
+ *
+ * Heap of physically contiguous buffers backed by a CMA area.  Unlike a
+ * carveout, the memory of the area is used for movable pages while no
+ * buffer is allocated from it; cma_alloc() migrates them away on demand.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+#include <linux/cma.h>
+#include <linux/err.h>
+#include <linux/ion.h>
+#include <linux/mm.h>
+#include <linux/scatterlist.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include "ion_priv.h"
+
+#include <asm/cacheflush.h>
+
+struct ion_cma_heap {
+	struct ion_heap heap;
+	struct cma *cma;
+};
+
+static struct cma *to_cma(struct ion_heap *heap)
+{
+	return container_of(heap, struct ion_cma_heap, heap)->cma;
+}
+
+/*
+ * Clean and invalidate the caches over a buffer through its alias in the
+ * cacheable linear map.
+ */
+static void ion_cma_flush(struct page *page, unsigned long count)
+{
+	phys_addr_t phys = page_to_phys(page);
+
+	dmac_flush_range(page_address(page),
+			 page_address(page) + (count << PAGE_SHIFT));
+	outer_flush_range(phys, phys + (count << PAGE_SHIFT));
+}
+
+static int ion_cma_heap_allocate(struct ion_heap *heap,
+				 struct ion_buffer *buffer,
+				 unsigned long size, unsigned long align,
+				 unsigned long flags)
+{
+	unsigned long count = PAGE_ALIGN(size) >> PAGE_SHIFT;
+	unsigned int order = align > PAGE_SIZE ? get_order(align) : 0;
+	struct page *page;
+
+	page = cma_alloc(to_cma(heap), count, order);
+	if (!page)
+		return -ENOMEM;
+
+	/*
+	 * The pages were used by someone else until now and may still have
+	 * dirty lines in the caches which must not be written back over
+	 * what the device or the write-combined mappings put there.
+	 */
+	ion_cma_flush(page, count);
+
+	buffer->priv_virt = page;
+	return 0;
+}
+
+static void ion_cma_heap_free(struct ion_buffer *buffer)
+{
+	unsigned long count = PAGE_ALIGN(buffer->size) >> PAGE_SHIFT;
+
+	/*
+	 * The linear map may have pulled in lines speculatively that are
+	 * stale now, drop them before the pages are used cached again.
+	 */
+	ion_cma_flush(buffer->priv_virt, count);
+	cma_release(to_cma(buffer->heap), buffer->priv_virt, count);
+	buffer->priv_virt = NULL;
+}
+
+static int ion_cma_heap_phys(struct ion_heap *heap,
+			     struct ion_buffer *buffer,
+			     ion_phys_addr_t *addr, size_t *len)
+{
+	struct page *page = buffer->priv_virt;
+
+	*addr = page_to_phys(page);
+	*len = buffer->size;
+	return 0;
+}
+
+static struct scatterlist *ion_cma_heap_map_dma(struct ion_heap *heap,
+						struct ion_buffer *buffer)
+{
+	struct scatterlist *sglist;
+
+	sglist = vmalloc(sizeof(struct scatterlist));
+	if (!sglist)
+		return ERR_PTR(-ENOMEM);
+	sg_init_table(sglist, 1);
+	sg_set_page(sglist, buffer->priv_virt, buffer->size, 0);
+	return sglist;
+}
+
+static void ion_cma_heap_unmap_dma(struct ion_heap *heap,
+				   struct ion_buffer *buffer)
+{
+	if (buffer->sglist)
+		vfree(buffer->sglist);
+}
+
+/*
+ * Buffers are mapped write-combined, so that CPU and device see each
+ * other's writes without any cache maintenance, as with the carveout
+ * heap.  Unlike a strongly-ordered mapping, write-combined is normal
+ * memory like the cacheable linear map alias of the area, which is
+ * never accessed while the buffer is allocated; the caches are flushed
+ * over it on allocation and on free.
+ */
+static void *ion_cma_heap_map_kernel(struct ion_heap *heap,
+				     struct ion_buffer *buffer)
+{
+	unsigned long i, count = PAGE_ALIGN(buffer->size) >> PAGE_SHIFT;
+	struct page *page = buffer->priv_virt;
+	struct page **pages;
+	void *vaddr;
+
+	pages = kmalloc(count * sizeof(*pages), GFP_KERNEL);
+	if (!pages)
+		return NULL;
+	for (i = 0; i < count; i++)
+		pages[i] = page + i;
+
+	vaddr = vmap(pages, count, VM_MAP, pgprot_writecombine(PAGE_KERNEL));
+	kfree(pages);
+	return vaddr;
+}
+
+static void ion_cma_heap_unmap_kernel(struct ion_heap *heap,
+				      struct ion_buffer *buffer)
+{
+	vunmap(buffer->vaddr);
+	buffer->vaddr = NULL;
+}
+
+static int ion_cma_heap_map_user(struct ion_heap *heap,
+				 struct ion_buffer *buffer,
+				 struct vm_area_struct *vma)
+{
+	struct page *page = buffer->priv_virt;
+
+	return remap_pfn_range(vma, vma->vm_start,
+			       page_to_pfn(page) + vma->vm_pgoff,
+			       vma->vm_end - vma->vm_start,
+			       pgprot_writecombine(vma->vm_page_prot));
+}
+
+static struct ion_heap_ops cma_heap_ops = {
+	.allocate = ion_cma_heap_allocate,
+	.free = ion_cma_heap_free,
+	.phys = ion_cma_heap_phys,
+	.map_dma = ion_cma_heap_map_dma,
+	.unmap_dma = ion_cma_heap_unmap_dma,
+	.map_kernel = ion_cma_heap_map_kernel,
+	.unmap_kernel = ion_cma_heap_unmap_kernel,
+	.map_user = ion_cma_heap_map_user,
+};
+
+struct ion_heap *ion_cma_heap_create(struct ion_platform_heap *heap_data)
+{
+	struct ion_cma_heap *cma_heap;
+	struct cma *cma = heap_data->priv;
+
+	if (!cma)
+		cma = cma_find(heap_data->name);
+	if (!cma)
+		return ERR_PTR(-ENODEV);
+
+	cma_heap = kzalloc(sizeof(struct ion_cma_heap), GFP_KERNEL);
+	if (!cma_heap)
+		return ERR_PTR(-ENOMEM);
+
+	cma_heap->cma = cma;
+	cma_heap->heap.ops = &cma_heap_ops;
+	cma_heap->heap.type = ION_HEAP_TYPE_CMA;
+
+	return &cma_heap->heap;
+}
+
+void ion_cma_heap_destroy(struct ion_heap *heap)
+{
+	kfree(container_of(heap, struct ion_cma_heap, heap));
+}
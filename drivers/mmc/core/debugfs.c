@@ -284,6 +284,74 @@ static const struct file_operations mmc_dbg_ext_csd_fops = {
 	.llseek		= default_llseek,
 };
 
+static int mmc_packed_stats_show(struct seq_file *s, void *data)
+{
+	static const char *stop_str[MMC_PACKED_STOP_NR] = {
+		[MMC_PACKED_STOP_EMPTY_QUEUE]	= "empty queue",
+		[MMC_PACKED_STOP_MAX_ENTRIES]	= "max entries",
+		[MMC_PACKED_STOP_MAX_SECTORS]	= "max sectors",
+		[MMC_PACKED_STOP_MAX_SEGMENTS]	= "max segments",
+		[MMC_PACKED_STOP_DATA_DIR]	= "read request",
+		[MMC_PACKED_STOP_FLUSH_DISCARD]	= "flush or discard",
+		[MMC_PACKED_STOP_REL_WRITE]	= "reliable write",
+		[MMC_PACKED_STOP_LARGE_REQ]	= "large request",
+	};
+	struct mmc_card	*card = s->private;
+	struct mmc_packed_stats *stats = &card->packed_stats;
+	unsigned long packed = 0, reqs = 0;
+	int i;
+
+	for (i = 2; i <= MMC_PACKED_MAX_ENTRIES; i++) {
+		packed += stats->entries[i];
+		reqs += stats->entries[i] * i;
+	}
+
+	seq_printf(s, "packed writes:\t\t%lu (%lu requests)\n", packed, reqs);
+	seq_printf(s, "single writes:\t\t%lu\n", stats->entries[1]);
+	seq_printf(s, "not packed, shallow:\t%lu\n", stats->shallow);
+	seq_printf(s, "not packed, large:\t%lu\n", stats->large);
+	seq_printf(s, "failures:\t\t%lu\n", stats->failures);
+	seq_printf(s, "reverted requests:\t%lu\n", stats->reverted);
+
+	seq_printf(s, "\nentries per packed write:\n");
+	for (i = 2; i <= MMC_PACKED_MAX_ENTRIES; i++)
+		if (stats->entries[i])
+			seq_printf(s, "%d:\t%lu\n", i, stats->entries[i]);
+
+	seq_printf(s, "\nstop reasons:\n");
+	for (i = 0; i < MMC_PACKED_STOP_NR; i++)
+		seq_printf(s, "%s:\t%lu\n", stop_str[i], stats->stop[i]);
+
+	return 0;
+}
+
+static int mmc_packed_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, mmc_packed_stats_show, inode->i_private);
+}
+
+/* any write resets the statistics */
+static ssize_t mmc_packed_stats_write(struct file *filp,
+				      const char __user *ubuf, size_t cnt,
+				      loff_t *ppos)
+{
+	struct mmc_card *card = ((struct seq_file *)filp->private_data)->private;
+
+	mmc_claim_host(card->host);
+	memset(&card->packed_stats, 0, sizeof(card->packed_stats));
+	mmc_release_host(card->host);
+
+	return cnt;
+}
+
+static const struct file_operations mmc_dbg_packed_stats_fops = {
+	.open		= mmc_packed_stats_open,
+	.read		= seq_read,
+	.write		= mmc_packed_stats_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 void mmc_add_card_debugfs(struct mmc_card *card)
 {
 	struct mmc_host	*host = card->host;
@@ -316,6 +384,11 @@ void mmc_add_card_debugfs(struct mmc_card *card)
 					&mmc_dbg_ext_csd_fops))
 			goto err;
 
+	if (mmc_card_mmc(card) && card->ext_csd.packed_event_en)
+		if (!debugfs_create_file("packed_stats", S_IRUSR | S_IWUSR,
+					 root, card, &mmc_dbg_packed_stats_fops))
+			goto err;
+
 	return;
 
 err:
@@ -0,0 +1,592 @@
+/*
+ * Simulated eMMC host controller and card.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Notes:
+ *   - The card is an eMMC 4.5 device backed by vmalloc'ed memory, with
+ *     sector addressing, erase and packed writes.  It answers the commands
+ *     the core and the block driver use; SD and SDIO probing times out.
+ *   - A data transfer occupies the "bus" for as long as it would take at
+ *     bus_mbps; the request completes from an hrtimer when that is over.
+ *   - Before a transfer can start, its buffers must be "mapped", which
+ *     takes CPU time as dma_map_sg() and the cache maintenance would on a
+ *     real controller: map_mbps.  pre_req() does it ahead of time, in the
+ *     shadow of the transfer on the bus; a request that was not prepared
+ *     pays for it in request().
+ *
+ * With the mmc_test driver bound to the card, the blocking and non-blocking
+ * performance tests show what double buffering gains for a given ratio of
+ * bus to mapping speed.
+ */
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/scatterlist.h>
+#include <linux/platform_device.h>
+#include <linux/mmc/host.h>
+#include <linux/mmc/card.h>
+#include <linux/mmc/mmc.h>
+
+#define DRIVER_NAME	"mmc_sim"
+
+static unsigned int size_mb = 64;
+module_param(size_mb, uint, 0444);
+MODULE_PARM_DESC(size_mb, "Capacity of the card in MiB");
+
+static unsigned int bus_mbps = 20;
+module_param(bus_mbps, uint, 0644);
+MODULE_PARM_DESC(bus_mbps, "Transfer rate of the bus in MB/s");
+
+static unsigned int map_mbps = 200;
+module_param(map_mbps, uint, 0644);
+MODULE_PARM_DESC(map_mbps, "Rate at which request buffers are mapped in MB/s");
+
+static unsigned int cmd_us = 20;
+module_param(cmd_us, uint, 0644);
+MODULE_PARM_DESC(cmd_us, "Duration of a command on the bus in us");
+
+struct mmc_sim_host {
+	struct mmc_host		*mmc;
+	struct mmc_request	*mrq;
+	struct hrtimer		timer;
+
+	u8			*storage;
+	u64			size;
+
+	/* card registers and state */
+	u32			cid[4];
+	u32			csd[4];
+	u8			ext_csd[512];
+	unsigned int		state;
+	u16			rca;
+	u32			erase_start;
+	u32			erase_end;
+	bool			packed;		/* CMD23 announced a packed write */
+	u8			*packed_buf;
+
+	/* counters of prepared and unprepared data requests */
+	unsigned long		nr_prepared;
+	unsigned long		nr_unprepared;
+	unsigned long		nr_packed;
+};
+
+/* the opposite of UNSTUFF_BITS() in the core */
+static void mmc_sim_stuff_bits(u32 *resp, unsigned int start,
+			       unsigned int size, u32 val)
+{
+	unsigned int i, bit;
+
+	for (i = 0; i < size; i++) {
+		bit = start + i;
+		if (val & (1U << i))
+			resp[3 - bit / 32] |= 1U << (bit % 32);
+	}
+}
+
+static void mmc_sim_init_card(struct mmc_sim_host *host)
+{
+	u32 sectors = host->size >> 9;
+	static const char name[] = "MMCSIM";
+	int i;
+
+	/* CID: manufacturer, OEM, product name, revision, serial, date */
+	mmc_sim_stuff_bits(host->cid, 120, 8, 0xfe);
+	mmc_sim_stuff_bits(host->cid, 104, 16, 0x5349);
+	for (i = 0; i < 6; i++)
+		mmc_sim_stuff_bits(host->cid, 96 - i * 8, 8, name[i]);
+	mmc_sim_stuff_bits(host->cid, 48, 8, 0x10);
+	mmc_sim_stuff_bits(host->cid, 16, 32, 0x12345678);
+	mmc_sim_stuff_bits(host->cid, 12, 4, 1);
+	mmc_sim_stuff_bits(host->cid, 8, 4, 14);
+
+	/* CSD: structure from EXT_CSD, spec version 4, 25MHz, erase */
+	mmc_sim_stuff_bits(host->csd, 126, 2, 3);
+	mmc_sim_stuff_bits(host->csd, 122, 4, 4);
+	mmc_sim_stuff_bits(host->csd, 112, 8, 0x27);
+	mmc_sim_stuff_bits(host->csd, 104, 8, 0x01);
+	mmc_sim_stuff_bits(host->csd, 96, 8, 0x32);
+	mmc_sim_stuff_bits(host->csd, 84, 12, 0x0f5);
+	mmc_sim_stuff_bits(host->csd, 80, 4, 9);
+	mmc_sim_stuff_bits(host->csd, 62, 12, 0xfff);
+	mmc_sim_stuff_bits(host->csd, 47, 3, 7);
+	mmc_sim_stuff_bits(host->csd, 42, 5, 31);
+	mmc_sim_stuff_bits(host->csd, 37, 5, 31);
+	mmc_sim_stuff_bits(host->csd, 26, 3, 2);
+	mmc_sim_stuff_bits(host->csd, 22, 4, 9);
+
+	host->ext_csd[EXT_CSD_STRUCTURE] = 2;
+	host->ext_csd[EXT_CSD_REV] = 6;
+	host->ext_csd[EXT_CSD_CARD_TYPE] = EXT_CSD_CARD_TYPE_26 |
+					   EXT_CSD_CARD_TYPE_52;
+	host->ext_csd[EXT_CSD_SEC_CNT + 0] = sectors >> 0;
+	host->ext_csd[EXT_CSD_SEC_CNT + 1] = sectors >> 8;
+	host->ext_csd[EXT_CSD_SEC_CNT + 2] = sectors >> 16;
+	host->ext_csd[EXT_CSD_SEC_CNT + 3] = sectors >> 24;
+	host->ext_csd[EXT_CSD_S_A_TIMEOUT] = 0x11;
+	host->ext_csd[EXT_CSD_REL_WR_SEC_C] = 1;
+	host->ext_csd[EXT_CSD_WR_REL_PARAM] = EXT_CSD_WR_REL_PARAM_EN;
+	host->ext_csd[EXT_CSD_HC_WP_GRP_SIZE] = 1;
+	host->ext_csd[EXT_CSD_ERASE_TIMEOUT_MULT] = 1;
+	host->ext_csd[EXT_CSD_HC_ERASE_GRP_SIZE] = 1;
+	host->ext_csd[EXT_CSD_TRIM_MULT] = 1;
+	host->ext_csd[EXT_CSD_MAX_PACKED_WRITES] = 32;
+	host->ext_csd[EXT_CSD_MAX_PACKED_READS] = 64;
+
+	host->state = R1_STATE_IDLE;
+}
+
+static u32 mmc_sim_status(struct mmc_sim_host *host)
+{
+	u32 status = host->state << 9;
+
+	if (host->state == R1_STATE_TRAN)
+		status |= R1_READY_FOR_DATA;
+	if (host->ext_csd[EXT_CSD_EXP_EVENTS_STATUS] &
+	    host->ext_csd[EXT_CSD_EXP_EVENTS_CTRL])
+		status |= R1_EXCEPTION_EVENT;
+	return status;
+}
+
+/* burn the CPU time that mapping @bytes for DMA would take */
+static void mmc_sim_map_delay(unsigned int bytes)
+{
+	unsigned int mbps = ACCESS_ONCE(map_mbps);
+	ktime_t end;
+
+	if (!mbps)
+		return;
+	end = ktime_add_ns(ktime_get(), div_u64((u64)bytes * 1000, mbps));
+	while (ktime_to_ns(ktime_sub(end, ktime_get())) > 0)
+		cpu_relax();
+}
+
+static void mmc_sim_pre_req(struct mmc_host *mmc, struct mmc_request *mrq,
+			    bool is_first_req)
+{
+	struct mmc_sim_host *host = mmc_priv(mmc);
+	struct mmc_data *data = mrq->data;
+
+	if (!data || data->host_cookie)
+		return;
+
+	mmc_sim_map_delay(data->blocks * data->blksz);
+	data->host_cookie = 1;
+	host->nr_prepared++;
+}
+
+static void mmc_sim_post_req(struct mmc_host *mmc, struct mmc_request *mrq,
+			     int err)
+{
+	if (mrq->data)
+		mrq->data->host_cookie = 0;
+}
+
+/*
+ * Move the data of a read or write between the sg list and the storage.
+ * Returns the time the transfer takes on the bus, in ns.
+ */
+static u64 mmc_sim_transfer(struct mmc_sim_host *host, struct mmc_command *cmd,
+			    struct mmc_data *data)
+{
+	unsigned int len = data->blocks * data->blksz;
+	u64 addr = (u64)cmd->arg << 9;
+	unsigned int mbps = ACCESS_ONCE(bus_mbps);
+
+	if (addr + len > host->size) {
+		cmd->resp[0] |= R1_OUT_OF_RANGE;
+		return 0;
+	}
+
+	if (data->flags & MMC_DATA_WRITE)
+		sg_copy_to_buffer(data->sg, data->sg_len,
+				  host->storage + addr, len);
+	else
+		sg_copy_from_buffer(data->sg, data->sg_len,
+				    host->storage + addr, len);
+	data->bytes_xfered = len;
+
+	return mbps ? div_u64((u64)len * 1000, mbps) : 0;
+}
+
+/* report entry @idx (1-based, 0 for none) of a packed write as failed */
+static void mmc_sim_packed_failure(struct mmc_sim_host *host,
+				   struct mmc_command *cmd, unsigned int idx)
+{
+	host->ext_csd[EXT_CSD_EXP_EVENTS_STATUS] |= EXT_CSD_PACKED_FAILURE;
+	host->ext_csd[EXT_CSD_PACKED_CMD_STATUS] = EXT_CSD_PACKED_GENERIC_ERROR;
+	if (idx) {
+		host->ext_csd[EXT_CSD_PACKED_CMD_STATUS] |=
+			EXT_CSD_PACKED_INDEXED_ERROR;
+		host->ext_csd[EXT_CSD_PACKED_FAILURE_INDEX] = idx;
+	}
+	cmd->resp[0] |= R1_ERROR;
+}
+
+/*
+ * A packed write: the first block is the header with the CMD23 and CMD25
+ * arguments of every entry, the data of the entries follows it in order.
+ * It occupies the bus as one transfer, header included.
+ */
+static u64 mmc_sim_packed_write(struct mmc_sim_host *host,
+				struct mmc_command *cmd, struct mmc_data *data)
+{
+	unsigned int len = data->blocks * data->blksz;
+	unsigned int mbps = ACCESS_ONCE(bus_mbps);
+	u32 *hdr = (u32 *)host->packed_buf;
+	unsigned int i, nr, off = 512;
+
+	host->ext_csd[EXT_CSD_EXP_EVENTS_STATUS] &= ~EXT_CSD_PACKED_FAILURE;
+	host->ext_csd[EXT_CSD_PACKED_CMD_STATUS] = 0;
+	host->ext_csd[EXT_CSD_PACKED_FAILURE_INDEX] = 0;
+	host->nr_packed++;
+
+	sg_copy_to_buffer(data->sg, data->sg_len, host->packed_buf, len);
+	data->bytes_xfered = len;
+
+	nr = (hdr[0] >> 16) & 0xff;
+	if ((hdr[0] & 0xffff) != ((PACKED_CMD_WR << 8) | PACKED_CMD_VER) ||
+	    !nr || nr > host->ext_csd[EXT_CSD_MAX_PACKED_WRITES]) {
+		mmc_sim_packed_failure(host, cmd, 0);
+		goto out;
+	}
+
+	for (i = 1; i <= nr; i++) {
+		unsigned int bytes = (hdr[2 * i] & 0xffff) << 9;
+		u64 addr = (u64)hdr[2 * i + 1] << 9;
+
+		if (off + bytes > len || addr + bytes > host->size) {
+			mmc_sim_packed_failure(host, cmd, i);
+			break;
+		}
+		memcpy(host->storage + addr, host->packed_buf + off, bytes);
+		off += bytes;
+	}
+out:
+	return mbps ? div_u64((u64)len * 1000, mbps) : 0;
+}
+
+static u64 mmc_sim_command(struct mmc_sim_host *host, struct mmc_command *cmd,
+			   struct mmc_data *data)
+{
+	u64 ns = 0;
+	u8 index, value;
+
+	cmd->resp[0] = 0;
+
+	switch (cmd->opcode) {
+	case MMC_GO_IDLE_STATE:
+		host->state = R1_STATE_IDLE;
+		break;
+	case MMC_SEND_OP_COND:
+		/* powered up, sector addressed, 2.7-3.6V */
+		cmd->resp[0] = MMC_CARD_BUSY | (1 << 30) | 0x00ff8000;
+		if (host->state == R1_STATE_IDLE)
+			host->state = R1_STATE_READY;
+		break;
+	case MMC_ALL_SEND_CID:
+		memcpy(cmd->resp, host->cid, sizeof(host->cid));
+		host->state = R1_STATE_IDENT;
+		break;
+	case MMC_SET_RELATIVE_ADDR:
+		host->rca = cmd->arg >> 16;
+		cmd->resp[0] = mmc_sim_status(host);
+		host->state = R1_STATE_STBY;
+		break;
+	case MMC_SEND_CSD:
+		memcpy(cmd->resp, host->csd, sizeof(host->csd));
+		break;
+	case MMC_SEND_CID:
+		memcpy(cmd->resp, host->cid, sizeof(host->cid));
+		break;
+	case MMC_SELECT_CARD:
+		cmd->resp[0] = mmc_sim_status(host);
+		host->state = (cmd->arg >> 16) == host->rca ?
+			      R1_STATE_TRAN : R1_STATE_STBY;
+		break;
+	case MMC_SEND_EXT_CSD:
+		/* without data phase this is SD's SEND_IF_COND */
+		if (!data) {
+			cmd->error = -ETIMEDOUT;
+			break;
+		}
+		cmd->resp[0] = mmc_sim_status(host);
+		sg_copy_from_buffer(data->sg, data->sg_len, host->ext_csd,
+				    sizeof(host->ext_csd));
+		data->bytes_xfered = sizeof(host->ext_csd);
+		break;
+	case MMC_SWITCH:
+		cmd->resp[0] = mmc_sim_status(host);
+		index = (cmd->arg >> 16) & 0xff;
+		value = (cmd->arg >> 8) & 0xff;
+		switch ((cmd->arg >> 24) & 3) {
+		case MMC_SWITCH_MODE_SET_BITS:
+			host->ext_csd[index] |= value;
+			break;
+		case MMC_SWITCH_MODE_CLEAR_BITS:
+			host->ext_csd[index] &= ~value;
+			break;
+		case MMC_SWITCH_MODE_WRITE_BYTE:
+			host->ext_csd[index] = value;
+			break;
+		}
+		break;
+	case MMC_SET_BLOCK_COUNT:
+		host->packed = !!(cmd->arg & MMC_CMD23_ARG_PACKED);
+		cmd->resp[0] = mmc_sim_status(host);
+		break;
+	case MMC_SEND_STATUS:
+	case MMC_SET_BLOCKLEN:
+	case MMC_STOP_TRANSMISSION:
+		cmd->resp[0] = mmc_sim_status(host);
+		break;
+	case MMC_ERASE_GROUP_START:
+		host->erase_start = cmd->arg;
+		cmd->resp[0] = mmc_sim_status(host);
+		break;
+	case MMC_ERASE_GROUP_END:
+		host->erase_end = cmd->arg;
+		cmd->resp[0] = mmc_sim_status(host);
+		break;
+	case MMC_ERASE:
+		cmd->resp[0] = mmc_sim_status(host);
+		if (host->erase_end < host->erase_start ||
+		    ((u64)host->erase_end + 1) << 9 > host->size) {
+			cmd->resp[0] |= R1_OUT_OF_RANGE;
+			break;
+		}
+		memset(host->storage + ((u64)host->erase_start << 9), 0,
+		       (u64)(host->erase_end - host->erase_start + 1) << 9);
+		break;
+	case MMC_READ_SINGLE_BLOCK:
+	case MMC_READ_MULTIPLE_BLOCK:
+	case MMC_WRITE_BLOCK:
+	case MMC_WRITE_MULTIPLE_BLOCK:
+		cmd->resp[0] = mmc_sim_status(host);
+		if (data && host->packed &&
+		    cmd->opcode == MMC_WRITE_MULTIPLE_BLOCK)
+			ns = mmc_sim_packed_write(host, cmd, data);
+		else if (data)
+			ns = mmc_sim_transfer(host, cmd, data);
+		host->packed = false;
+		break;
+	default:
+		/* SD and SDIO commands: no card of that kind here */
+		cmd->error = -ETIMEDOUT;
+		break;
+	}
+
+	return ns;
+}
+
+static void mmc_sim_request(struct mmc_host *mmc, struct mmc_request *mrq)
+{
+	struct mmc_sim_host *host = mmc_priv(mmc);
+	struct mmc_data *data = mrq->data;
+	u64 ns = cmd_us * NSEC_PER_USEC;
+
+	WARN_ON(host->mrq);
+	host->mrq = mrq;
+
+	if (data && !data->host_cookie) {
+		mmc_sim_map_delay(data->blocks * data->blksz);
+		host->nr_unprepared++;
+	}
+
+	if (mrq->sbc) {
+		ns += mmc_sim_command(host, mrq->sbc, NULL);
+		if (mrq->sbc->error)
+			goto done;
+	}
+	ns += mmc_sim_command(host, mrq->cmd, data);
+	if (mrq->cmd->error)
+		goto done;
+	if (mrq->stop)
+		ns += mmc_sim_command(host, mrq->stop, NULL);
+done:
+	hrtimer_start(&host->timer, ns_to_ktime(ns), HRTIMER_MODE_REL);
+}
+
+/* the transfer is over on the bus */
+static enum hrtimer_restart mmc_sim_timer(struct hrtimer *timer)
+{
+	struct mmc_sim_host *host = container_of(timer, struct mmc_sim_host,
+						 timer);
+	struct mmc_request *mrq = host->mrq;
+
+	host->mrq = NULL;
+	mmc_request_done(host->mmc, mrq);
+
+	return HRTIMER_NORESTART;
+}
+
+static void mmc_sim_set_ios(struct mmc_host *mmc, struct mmc_ios *ios)
+{
+	struct mmc_sim_host *host = mmc_priv(mmc);
+
+	if (ios->power_mode == MMC_POWER_OFF)
+		host->state = R1_STATE_IDLE;
+}
+
+static int mmc_sim_get_ro(struct mmc_host *mmc)
+{
+	return 0;
+}
+
+static int mmc_sim_get_cd(struct mmc_host *mmc)
+{
+	return 1;
+}
+
+static const struct mmc_host_ops mmc_sim_ops = {
+	.pre_req	= mmc_sim_pre_req,
+	.post_req	= mmc_sim_post_req,
+	.request	= mmc_sim_request,
+	.set_ios	= mmc_sim_set_ios,
+	.get_ro		= mmc_sim_get_ro,
+	.get_cd		= mmc_sim_get_cd,
+};
+
+static ssize_t mmc_sim_show_requests(struct device *dev,
+				     struct device_attribute *attr, char *buf)
+{
+	struct mmc_sim_host *host = mmc_priv(dev_get_drvdata(dev));
+
+	return sprintf(buf, "prepared %lu\nunprepared %lu\npacked %lu\n",
+		       host->nr_prepared, host->nr_unprepared,
+		       host->nr_packed);
+}
+
+static DEVICE_ATTR(requests, S_IRUGO, mmc_sim_show_requests, NULL);
+
+static int __devinit mmc_sim_probe(struct platform_device *pdev)
+{
+	struct mmc_sim_host *host;
+	struct mmc_host *mmc;
+	int ret;
+
+	if (!size_mb)
+		return -EINVAL;
+
+	mmc = mmc_alloc_host(sizeof(struct mmc_sim_host), &pdev->dev);
+	if (!mmc)
+		return -ENOMEM;
+
+	host = mmc_priv(mmc);
+	host->mmc = mmc;
+	host->size = (u64)size_mb << 20;
+	host->storage = vzalloc(host->size);
+	if (!host->storage) {
+		ret = -ENOMEM;
+		goto err_free_host;
+	}
+	hrtimer_init(&host->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	host->timer.function = mmc_sim_timer;
+	mmc_sim_init_card(host);
+
+	mmc->ops = &mmc_sim_ops;
+	mmc->f_min = 400000;
+	mmc->f_max = 52000000;
+	mmc->ocr_avail = MMC_VDD_32_33 | MMC_VDD_33_34;
+	mmc->caps = MMC_CAP_NONREMOVABLE | MMC_CAP_MMC_HIGHSPEED |
+		    MMC_CAP_CMD23 | MMC_CAP_ERASE;
+	mmc->caps2 = MMC_CAP2_PACKED_WR;
+
+	mmc->max_segs = 128;
+	mmc->max_blk_size = 512;
+	mmc->max_blk_count = 1024;
+	mmc->max_req_size = mmc->max_blk_count * mmc->max_blk_size;
+	mmc->max_seg_size = mmc->max_req_size;
+
+	host->packed_buf = vmalloc(mmc->max_req_size);
+	if (!host->packed_buf) {
+		ret = -ENOMEM;
+		goto err_free_storage;
+	}
+
+	platform_set_drvdata(pdev, mmc);
+
+	ret = device_create_file(&pdev->dev, &dev_attr_requests);
+	if (ret)
+		goto err_free_storage;
+
+	ret = mmc_add_host(mmc);
+	if (ret)
+		goto err_remove_file;
+
+	dev_info(&pdev->dev, "%u MiB card, bus %u MB/s, mapping %u MB/s\n",
+		 size_mb, bus_mbps, map_mbps);
+	return 0;
+
+err_remove_file:
+	device_remove_file(&pdev->dev, &dev_attr_requests);
+err_free_storage:
+	platform_set_drvdata(pdev, NULL);
+	vfree(host->packed_buf);
+	vfree(host->storage);
+err_free_host:
+	mmc_free_host(mmc);
+	return ret;
+}
+
+static int __devexit mmc_sim_remove(struct platform_device *pdev)
+{
+	struct mmc_host *mmc = platform_get_drvdata(pdev);
+	struct mmc_sim_host *host = mmc_priv(mmc);
+
+	mmc_remove_host(mmc);
+	hrtimer_cancel(&host->timer);
+	device_remove_file(&pdev->dev, &dev_attr_requests);
+	platform_set_drvdata(pdev, NULL);
+	vfree(host->packed_buf);
+	vfree(host->storage);
+	mmc_free_host(mmc);
+
+	return 0;
+}
+
+static struct platform_driver mmc_sim_driver = {
+	.probe		= mmc_sim_probe,
+	.remove		= __devexit_p(mmc_sim_remove),
+	.driver		= {
+		.name	= DRIVER_NAME,
+		.owner	= THIS_MODULE,
+	},
+};
+
+static struct platform_device *mmc_sim_device;
+
+static int __init mmc_sim_init(void)
+{
+	int ret;
+
+	ret = platform_driver_register(&mmc_sim_driver);
+	if (ret)
+		return ret;
+
+	mmc_sim_device = platform_device_register_simple(DRIVER_NAME, -1,
+							 NULL, 0);
+	if (IS_ERR(mmc_sim_device)) {
+		platform_driver_unregister(&mmc_sim_driver);
+		return PTR_ERR(mmc_sim_device);
+	}
+
+	return 0;
+}
+
+static void __exit mmc_sim_exit(void)
+{
+	platform_device_unregister(mmc_sim_device);
+	platform_driver_unregister(&mmc_sim_driver);
+}
+
+module_init(mmc_sim_init);
+module_exit(mmc_sim_exit);
+
+MODULE_DESCRIPTION("Simulated eMMC host controller and card");
+MODULE_LICENSE("GPL");
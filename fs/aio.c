@@ -275,7 +275,6 @@ static struct kioctx *ioctx_alloc(unsigned nr_events)
 
 	atomic_set(&ctx->users, 1);
 	spin_lock_init(&ctx->ctx_lock);
-	spin_lock_init(&ctx->ring_info.ring_lock);
 	init_waitqueue_head(&ctx->wait);
 
 	INIT_LIST_HEAD(&ctx->active_reqs);
@@ -427,10 +426,12 @@ void exit_aio(struct mm_struct *mm)
 	}
 }
 
-/* aio_get_req
- *	Allocate a slot for an aio request.  Increments the users count
- * of the kioctx so that the kioctx stays around until all requests are
- * complete.  Returns NULL if no requests are free.
+static int aio_wake_function(wait_queue_t *wait, unsigned mode, int sync,
+			     void *arg);
+
+/* __aio_get_req
+ *	Allocate and initialize a kiocb.  It is only accounted to the
+ * kioctx once kiocb_batch_refill() found a ring slot for it.
  *
  * Returns with kiocb->users set to 2.  The io submit code path holds
  * an extra reference while submitting the i/o.
@@ -440,8 +441,6 @@ void exit_aio(struct mm_struct *mm)
 static struct kiocb *__aio_get_req(struct kioctx *ctx)
 {
 	struct kiocb *req = NULL;
-	struct aio_ring *ring;
-	int okay = 0;
 
 	req = kmem_cache_alloc(kiocb_cachep, GFP_KERNEL);
 	if (unlikely(!req))
@@ -458,40 +457,133 @@ static struct kiocb *__aio_get_req(struct kioctx *ctx)
 	req->ki_iovec = NULL;
 	INIT_LIST_HEAD(&req->ki_run_list);
 	req->ki_eventfd = NULL;
+	init_waitqueue_func_entry(&req->ki_wait.wait, aio_wake_function);
+	INIT_LIST_HEAD(&req->ki_wait.wait.task_list);
+	req->ki_wait.key.flags = NULL;
 
-	/* Check if the completion queue has enough free space to
-	 * accept an event from this io.
-	 */
+	return req;
+}
+
+/*
+ * kiocbs are allocated in batches, so that io_submit() takes ctx_lock
+ * once to check the completion ring for free space for the whole batch
+ * rather than once per iocb.
+ */
+#define KIOCB_BATCH_SIZE	32L
+struct kiocb_batch {
+	struct list_head head;
+	long count;		/* iocbs still to allocate */
+};
+
+static void kiocb_batch_init(struct kiocb_batch *batch, long total)
+{
+	INIT_LIST_HEAD(&batch->head);
+	batch->count = total;
+}
+
+/* Give back the kiocbs of a batch that io_submit() did not use. */
+static void kiocb_batch_free(struct kioctx *ctx, struct kiocb_batch *batch)
+{
+	struct kiocb *req, *n;
+
+	if (list_empty(&batch->head))
+		return;
+
+	spin_lock_irq(&ctx->ctx_lock);
+	list_for_each_entry_safe(req, n, &batch->head, ki_batch) {
+		list_del(&req->ki_batch);
+		list_del(&req->ki_list);
+		kmem_cache_free(kiocb_cachep, req);
+		ctx->reqs_active--;
+	}
+	if (unlikely(!ctx->reqs_active && ctx->dead))
+		wake_up_all(&ctx->wait);
+	spin_unlock_irq(&ctx->ctx_lock);
+}
+
+/*
+ * Allocate up to KIOCB_BATCH_SIZE kiocbs and account as many of them as
+ * the completion ring has room for.  Returns the number of kiocbs now on
+ * the batch.
+ */
+static long kiocb_batch_refill(struct kioctx *ctx, struct kiocb_batch *batch)
+{
+	long allocated, to_alloc, avail;
+	int called_fput = 0;
+	struct kiocb *req, *n;
+	struct aio_ring *ring;
+
+	to_alloc = min(batch->count, KIOCB_BATCH_SIZE);
+	for (allocated = 0; allocated < to_alloc; allocated++) {
+		req = __aio_get_req(ctx);
+		if (!req)
+			/* allocation failed, go with what we've got */
+			break;
+		list_add(&req->ki_batch, &batch->head);
+	}
+
+	if (allocated == 0)
+		return 0;
+
+retry:
 	spin_lock_irq(&ctx->ctx_lock);
 	ring = kmap_atomic(ctx->ring_info.ring_pages[0], KM_USER0);
-	if (ctx->reqs_active < aio_ring_avail(&ctx->ring_info, ring)) {
+
+	avail = (long)aio_ring_avail(&ctx->ring_info, ring) - ctx->reqs_active;
+	if (avail <= 0 && !called_fput) {
+		/* Handle a potential starvation case -- should be exceedingly
+		 * rare as requests will be stuck on fput_head only if the
+		 * aio_fput_routine is delayed and the requests were the last
+		 * user of the struct file.
+		 */
+		kunmap_atomic(ring, KM_USER0);
+		spin_unlock_irq(&ctx->ctx_lock);
+		aio_fput_routine(NULL);
+		called_fput = 1;
+		goto retry;
+	}
+	if (avail < 0)
+		avail = 0;
+
+	if (avail < allocated) {
+		/* Trim back the number of requests. */
+		list_for_each_entry_safe(req, n, &batch->head, ki_batch) {
+			if (allocated <= avail)
+				break;
+			list_del(&req->ki_batch);
+			kmem_cache_free(kiocb_cachep, req);
+			allocated--;
+		}
+	}
+
+	batch->count -= allocated;
+	list_for_each_entry(req, &batch->head, ki_batch) {
 		list_add(&req->ki_list, &ctx->active_reqs);
 		ctx->reqs_active++;
-		okay = 1;
 	}
+
 	kunmap_atomic(ring, KM_USER0);
 	spin_unlock_irq(&ctx->ctx_lock);
 
-	if (!okay) {
-		kmem_cache_free(kiocb_cachep, req);
-		req = NULL;
-	}
-
-	return req;
+	return allocated;
 }
 
-static inline struct kiocb *aio_get_req(struct kioctx *ctx)
+/* aio_get_req
+ *	Take a slot for an aio request off the batch, refilling it as
+ * needed.  Increments the users count of the kioctx so that the kioctx
+ * stays around until all requests are complete.  Returns NULL if no
+ * requests are free.
+ */
+static inline struct kiocb *aio_get_req(struct kioctx *ctx,
+					struct kiocb_batch *batch)
 {
 	struct kiocb *req;
-	/* Handle a potential starvation case -- should be exceedingly rare as 
-	 * requests will be stuck on fput_head only if the aio_fput_routine is 
-	 * delayed and the requests were the last user of the struct file.
-	 */
-	req = __aio_get_req(ctx);
-	if (unlikely(NULL == req)) {
-		aio_fput_routine(NULL);
-		req = __aio_get_req(ctx);
-	}
+
+	if (list_empty(&batch->head))
+		if (kiocb_batch_refill(ctx, batch) == 0)
+			return NULL;
+	req = list_first_entry(&batch->head, struct kiocb, ki_batch);
+	list_del(&req->ki_batch);
 	return req;
 }
 
@@ -787,17 +879,13 @@ static int __aio_run_iocbs(struct kioctx *ctx)
 
 static void aio_queue_work(struct kioctx * ctx)
 {
-	unsigned long timeout;
 	/*
-	 * if someone is waiting, get the work started right
-	 * away, otherwise, use a longer delay
+	 * Get the work started right away, even with nobody waiting in
+	 * io_getevents(): a kicked iocb is mostly a buffered read whose
+	 * page has come in, and its completion may be reaped straight
+	 * from the ring.
 	 */
-	smp_mb();
-	if (waitqueue_active(&ctx->wait))
-		timeout = 1;
-	else
-		timeout = HZ/10;
-	queue_delayed_work(aio_wq, &ctx->wq, timeout);
+	queue_delayed_work(aio_wq, &ctx->wq, 0);
 }
 
 /*
@@ -889,6 +977,30 @@ void kick_iocb(struct kiocb *iocb)
 }
 EXPORT_SYMBOL(kick_iocb);
 
+/*
+ * aio_wake_function:
+ *	Wait queue callback of kiocb->ki_wait, queued on a page by
+ *	wait_on_page_locked_async().  Like wake_bit_function() but
+ *	kicks the iocb instead of waking a task.
+ */
+static int aio_wake_function(wait_queue_t *wait, unsigned mode, int sync,
+			     void *arg)
+{
+	struct wait_bit_key *key = arg;
+	struct wait_bit_queue *wait_bit
+		= container_of(wait, struct wait_bit_queue, wait);
+	struct kiocb *iocb = container_of(wait_bit, struct kiocb, ki_wait);
+
+	if (wait_bit->key.flags != key->flags ||
+			wait_bit->key.bit_nr != key->bit_nr ||
+			test_bit(key->bit_nr, key->flags))
+		return 0;
+
+	list_del_init(&wait->task_list);
+	kick_iocb(iocb);
+	return 1;
+}
+
 /* aio_complete
  *	Called when the io request on the given iocb is complete.
  *	Returns true if this is the last user of the request.  The 
@@ -999,14 +1111,16 @@ EXPORT_SYMBOL(aio_complete);
 /* aio_read_evt
  *	Pull an event off of the ioctx's event ring.  Returns the number of 
  *	events fetched (0 or 1 ;-)
- *	FIXME: make this use cmpxchg.
- *	TODO: make the ringbuffer user mmap()able (requires FIXME).
+ *	The ring is mapped in userspace, which may be reaping events from
+ *	it at the same time, so head is only ever advanced with cmpxchg,
+ *	see the comment above struct aio_ring.
  */
 static int aio_read_evt(struct kioctx *ioctx, struct io_event *ent)
 {
 	struct aio_ring_info *info = &ioctx->ring_info;
 	struct aio_ring *ring;
-	unsigned long head;
+	struct io_event *evp;
+	unsigned head, tail;
 	int ret = 0;
 
 	ring = kmap_atomic(info->ring_pages[0], KM_USER0);
@@ -1014,27 +1128,25 @@ static int aio_read_evt(struct kioctx *ioctx, struct io_event *ent)
 		 (unsigned long)ring->head, (unsigned long)ring->tail,
 		 (unsigned long)ring->nr);
 
-	if (ring->head == ring->tail)
-		goto out;
-
-	spin_lock(&info->ring_lock);
+	do {
+		head = ACCESS_ONCE(ring->head);
+		tail = ACCESS_ONCE(ring->tail);
+		if (head % info->nr == tail)
+			goto out;
+		smp_rmb(); /* read the tail before the event it covers */
 
-	head = ring->head % info->nr;
-	if (head != ring->tail) {
-		struct io_event *evp = aio_ring_event(info, head, KM_USER1);
+		evp = aio_ring_event(info, head % info->nr, KM_USER1);
 		*ent = *evp;
-		head = (head + 1) % info->nr;
-		smp_mb(); /* finish reading the event before updatng the head */
-		ring->head = head;
-		ret = 1;
 		put_aio_ring_event(evp, KM_USER1);
-	}
-	spin_unlock(&info->ring_lock);
+
+		smp_mb(); /* finish reading the event before updating the head */
+	} while (cmpxchg(&ring->head, head, (head + 1) % info->nr) != head);
+	ret = 1;
 
 out:
-	kunmap_atomic(ring, KM_USER0);
 	dprintk("leaving aio_read_evt: %d  h%lu t%lu\n", ret,
 		 (unsigned long)ring->head, (unsigned long)ring->tail);
+	kunmap_atomic(ring, KM_USER0);
 	return ret;
 }
 
@@ -1331,11 +1443,19 @@ static ssize_t aio_rw_vect_retry(struct kiocb *iocb)
 		return -EINVAL;
 
 	do {
+		loff_t pos = iocb->ki_pos;
+
 		ret = rw_op(iocb, &iocb->ki_iovec[iocb->ki_cur_seg],
 			    iocb->ki_nr_segs - iocb->ki_cur_seg,
 			    iocb->ki_pos);
 		if (ret > 0)
 			aio_advance_iovec(iocb, ret);
+		/*
+		 * A read that stopped to wait for a page returns -EIOCBRETRY
+		 * even after a partial copy, which only shows in ki_pos.
+		 */
+		else if (ret == -EIOCBRETRY && iocb->ki_pos > pos)
+			aio_advance_iovec(iocb, iocb->ki_pos - pos);
 
 	/* retry all partial writes.  retry partial reads as long as its a
 	 * regular file. */
@@ -1358,6 +1478,20 @@ static ssize_t aio_rw_vect_retry(struct kiocb *iocb)
 	return ret;
 }
 
+/*
+ * kiocb_page_wait:
+ *	Returns the wait queue entry with which a read of @iocb waits for
+ *	a page to be read in through wait_on_page_locked_async(), or NULL
+ *	if @iocb is not retried by the aio core and has to block instead.
+ */
+struct wait_bit_queue *kiocb_page_wait(struct kiocb *iocb)
+{
+	if (is_sync_kiocb(iocb) || iocb->ki_retry != aio_rw_vect_retry)
+		return NULL;
+	return &iocb->ki_wait;
+}
+EXPORT_SYMBOL(kiocb_page_wait);
+
 static ssize_t aio_fdsync(struct kiocb *iocb)
 {
 	struct file *file = iocb->ki_filp;
@@ -1515,7 +1649,8 @@ static ssize_t aio_setup_iocb(struct kiocb *kiocb, bool compat)
 }
 
 static int io_submit_one(struct kioctx *ctx, struct iocb __user *user_iocb,
-			 struct iocb *iocb, bool compat)
+			 struct iocb *iocb, struct kiocb_batch *batch,
+			 bool compat)
 {
 	struct kiocb *req;
 	struct file *file;
@@ -1541,7 +1676,7 @@ static int io_submit_one(struct kioctx *ctx, struct iocb __user *user_iocb,
 	if (unlikely(!file))
 		return -EBADF;
 
-	req = aio_get_req(ctx);		/* returns with 2 references to req */
+	req = aio_get_req(ctx, batch);	/* returns with 2 references to req */
 	if (unlikely(!req)) {
 		fput(file);
 		return -EAGAIN;
@@ -1623,6 +1758,7 @@ long do_io_submit(aio_context_t ctx_id, long nr,
 	long ret = 0;
 	int i;
 	struct blk_plug plug;
+	struct kiocb_batch batch;
 
 	if (unlikely(nr < 0))
 		return -EINVAL;
@@ -1639,6 +1775,8 @@ long do_io_submit(aio_context_t ctx_id, long nr,
 		return -EINVAL;
 	}
 
+	kiocb_batch_init(&batch, nr);
+
 	blk_start_plug(&plug);
 
 	/*
@@ -1659,12 +1797,14 @@ long do_io_submit(aio_context_t ctx_id, long nr,
 			break;
 		}
 
-		ret = io_submit_one(ctx, user_iocb, &tmp, compat);
+		ret = io_submit_one(ctx, user_iocb, &tmp, &batch, compat);
 		if (ret)
 			break;
 	}
 	blk_finish_plug(&plug);
 
+	kiocb_batch_free(ctx, &batch);
+
 	put_ioctx(ctx);
 	return i ? i : ret;
 }
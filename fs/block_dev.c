@@ -181,12 +181,112 @@ blkdev_get_blocks(struct inode *inode, sector_t iblock,
 	return 0;
 }
 
+/*
+ * Synchronous direct I/O of a single aligned segment of up to
+ * DIO_SIMPLE_MAX_PAGES pages, the common case of a small O_DIRECT read or
+ * write on a block device, doesn't need the dio state machine of
+ * __blockdev_direct_IO(): there are no blocks to map, so the pinned user
+ * pages go into one bio that is waited for right here.  Returns
+ * -ENOTBLK when the request has to take the general path.
+ */
+#define DIO_SIMPLE_MAX_PAGES	4
+
+static void blkdev_bio_end_io_simple(struct bio *bio, int error)
+{
+	struct task_struct *waiter = bio->bi_private;
+
+	/* pairs with the check of bi_private in blkdev_direct_IO_simple() */
+	smp_wmb();
+	bio->bi_private = NULL;
+	wake_up_process(waiter);
+}
+
+static ssize_t
+blkdev_direct_IO_simple(int rw, struct kiocb *iocb, const struct iovec *iov,
+			loff_t offset)
+{
+	struct block_device *bdev = I_BDEV(iocb->ki_filp->f_mapping->host);
+	unsigned long addr = (unsigned long)iov->iov_base;
+	size_t len = iov->iov_len;
+	unsigned int mask = bdev_logical_block_size(bdev) - 1;
+	struct page *pages[DIO_SIMPLE_MAX_PAGES];
+	unsigned int pgoff, bytes;
+	int nr_pages, pinned, i;
+	struct bio *bio;
+	ssize_t ret;
+
+	if (!len || ((offset | addr | len) & mask) ||
+	    offset + len > i_size_read(bdev->bd_inode))
+		return -ENOTBLK;
+	nr_pages = DIV_ROUND_UP((addr & ~PAGE_MASK) + len, PAGE_SIZE);
+	if (nr_pages > DIO_SIMPLE_MAX_PAGES)
+		return -ENOTBLK;
+
+	pinned = get_user_pages_fast(addr, nr_pages, rw == READ, pages);
+	if (pinned < nr_pages) {
+		ret = -ENOTBLK;
+		goto out_release;
+	}
+
+	bio = bio_alloc(GFP_KERNEL, nr_pages);
+	bio->bi_bdev = bdev;
+	bio->bi_sector = offset >> 9;
+	bio->bi_end_io = blkdev_bio_end_io_simple;
+	bio->bi_private = current;
+
+	pgoff = addr & ~PAGE_MASK;
+	for (i = 0; i < nr_pages; i++) {
+		bytes = min_t(size_t, PAGE_SIZE - pgoff, len);
+		if (bio_add_page(bio, pages[i], bytes, pgoff) != bytes) {
+			/* the queue limits want a smaller bio */
+			bio_put(bio);
+			ret = -ENOTBLK;
+			goto out_release;
+		}
+		len -= bytes;
+		pgoff = 0;
+	}
+	len = bio->bi_size;
+
+	submit_bio(rw == READ ? READ : WRITE_ODIRECT, bio);
+
+	for (;;) {
+		set_current_state(TASK_UNINTERRUPTIBLE);
+		if (!ACCESS_ONCE(bio->bi_private))
+			break;
+		if (!blk_poll(bdev_get_queue(bdev), bio->bi_cookie))
+			io_schedule();
+	}
+	__set_current_state(TASK_RUNNING);
+	smp_rmb();
+
+	ret = test_bit(BIO_UPTODATE, &bio->bi_flags) ? len : -EIO;
+	bio_put(bio);
+
+	if (rw == READ) {
+		for (i = 0; i < nr_pages; i++)
+			if (!PageCompound(pages[i]))
+				set_page_dirty_lock(pages[i]);
+	}
+out_release:
+	for (i = 0; i < pinned; i++)
+		page_cache_release(pages[i]);
+	return ret;
+}
+
 static ssize_t
 blkdev_direct_IO(int rw, struct kiocb *iocb, const struct iovec *iov,
 			loff_t offset, unsigned long nr_segs)
 {
 	struct file *file = iocb->ki_filp;
 	struct inode *inode = file->f_mapping->host;
+	ssize_t ret;
+
+	if (is_sync_kiocb(iocb) && nr_segs == 1) {
+		ret = blkdev_direct_IO_simple(rw, iocb, iov, offset);
+		if (ret != -ENOTBLK)
+			return ret;
+	}
 
 	return __blockdev_direct_IO(rw, iocb, inode, I_BDEV(inode), iov, offset,
 				    nr_segs, blkdev_get_blocks, NULL, NULL, 0);
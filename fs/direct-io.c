@@ -105,6 +105,8 @@ struct dio {
 	unsigned long refcount;		/* direct_io_worker() and bios */
 	struct bio *bio_list;		/* singly linked via bi_private */
 	struct task_struct *waiter;	/* waiting task (NULL if none) */
+	struct request_queue *bio_queue; /* queue and cookie of the last bio, */
+	unsigned int bio_cookie;	/* for polling, sync dio only */
 
 	/* AIO related stuff */
 	struct kiocb *iocb;		/* kiocb */
@@ -372,8 +374,14 @@ static void dio_bio_submit(struct dio *dio)
 	if (dio->submit_io)
 		dio->submit_io(dio->rw, bio, dio->inode,
 			       dio->logical_offset_in_bio);
-	else
+	else {
 		submit_bio(dio->rw, bio);
+		/* a sync dio owns its bios until it reaps them */
+		if (!dio->is_async) {
+			dio->bio_queue = bdev_get_queue(bio->bi_bdev);
+			dio->bio_cookie = bio->bi_cookie;
+		}
+	}
 
 	dio->bio = NULL;
 	dio->boundary = 0;
@@ -412,7 +420,9 @@ static struct bio *dio_await_one(struct dio *dio)
 		__set_current_state(TASK_UNINTERRUPTIBLE);
 		dio->waiter = current;
 		spin_unlock_irqrestore(&dio->bio_lock, flags);
-		io_schedule();
+		if (!dio->bio_queue ||
+		    !blk_poll(dio->bio_queue, dio->bio_cookie))
+			io_schedule();
 		/* wake up sets us TASK_RUNNING */
 		spin_lock_irqsave(&dio->bio_lock, flags);
 		dio->waiter = NULL;
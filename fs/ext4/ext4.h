@@ -110,6 +110,19 @@ typedef unsigned int ext4_group_t;
 #define EXT4_MB_STREAM_ALLOC		0x0800
 /* Use reserved root blocks if needed */
 #define EXT4_MB_USE_ROOT_BLOCKS		0x1000
+/* goal is the region of the data's lifetime class */
+#define EXT4_MB_LIFETIME_ALLOC		0x2000
+
+/*
+ * Expected lifetime of file data, see EXT4_IOC_SETLIFETIME.  With
+ * mb_lifetime_sep set the allocator keeps each class in its own range of
+ * block groups, so that data that dies together is not interleaved with
+ * data that stays.
+ */
+#define EXT4_MB_LIFE_DEFAULT		0	/* application data */
+#define EXT4_MB_LIFE_SHORT		1	/* temporary files */
+#define EXT4_MB_LIFE_LONG		2	/* media, written once */
+#define EXT4_MB_LIFE_NR			3
 
 struct ext4_allocation_request {
 	/* target inode for block we're allocating */
@@ -549,6 +562,8 @@ struct ext4_new_group_data {
  /* note ioctl 11 reserved for filesystem-independent FIEMAP ioctl */
 #define EXT4_IOC_ALLOC_DA_BLKS		_IO('f', 12)
 #define EXT4_IOC_MOVE_EXT		_IOWR('f', 15, struct move_extent)
+#define EXT4_IOC_GETLIFETIME		_IOR('f', 20, __u32)
+#define EXT4_IOC_SETLIFETIME		_IOW('f', 21, __u32)
 
 #if defined(__KERNEL__) && defined(CONFIG_COMPAT)
 /*
@@ -831,6 +846,7 @@ struct ext4_inode_info {
 	/* mballoc */
 	struct list_head i_prealloc_list;
 	spinlock_t i_prealloc_lock;
+	unsigned char i_mb_lifetime;	/* EXT4_MB_LIFE_* */
 
 	/* ialloc */
 	ext4_group_t	i_last_alloc_group;
@@ -1172,9 +1188,13 @@ struct ext4_sb_info {
 	unsigned int s_mb_order2_reqs;
 	unsigned int s_mb_group_prealloc;
 	unsigned int s_max_writeback_mb_bump;
+	unsigned int s_mb_lifetime_sep;
 	/* where last allocation was done - for stream allocation */
 	unsigned long s_mb_last_group;
 	unsigned long s_mb_last_start;
+	/* where last allocation of each lifetime class was done */
+	unsigned long s_mb_lifetime_group[EXT4_MB_LIFE_NR];
+	unsigned long s_mb_lifetime_start[EXT4_MB_LIFE_NR];
 
 	/* stats for buddy allocator */
 	atomic_t s_bal_reqs;	/* number of reqs with len > 1 */
@@ -1191,6 +1211,7 @@ struct ext4_sb_info {
 	atomic_t s_mb_preallocated;
 	atomic_t s_mb_discarded;
 	atomic_t s_lock_busy;
+	struct ext4_mb_lifetime_stats *s_mb_lifetime_stats;
 
 	/* locality groups */
 	struct ext4_locality_group __percpu *s_locality_groups;
@@ -1254,6 +1275,7 @@ enum {
 	EXT4_STATE_DIO_UNWRITTEN,	/* need convert on dio done*/
 	EXT4_STATE_NEWENTRY,		/* File just added to dir */
 	EXT4_STATE_DELALLOC_RESERVED,	/* blks already reserved for delalloc */
+	EXT4_STATE_LIFETIME_SET,	/* i_mb_lifetime set by ioctl */
 };
 
 #define EXT4_INODE_BIT_FNS(name, field, offset)				\
@@ -1786,6 +1808,7 @@ extern int ext4_mb_release(struct super_block *);
 extern ext4_fsblk_t ext4_mb_new_blocks(handle_t *,
 				struct ext4_allocation_request *, int *);
 extern int ext4_mb_reserve_blocks(struct super_block *, int);
+extern void ext4_mb_set_lifetime(struct inode *, const struct qstr *);
 extern void ext4_discard_preallocations(struct inode *);
 extern int __init ext4_init_mballoc(void);
 extern void ext4_exit_mballoc(void);
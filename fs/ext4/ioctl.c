@@ -331,6 +331,27 @@ mext_out:
 		return err;
 	}
 
+	case EXT4_IOC_GETLIFETIME:
+		return put_user(EXT4_I(inode)->i_mb_lifetime,
+				(__u32 __user *) arg);
+
+	case EXT4_IOC_SETLIFETIME:
+	{
+		__u32 lifetime;
+
+		if (!inode_owner_or_capable(inode))
+			return -EACCES;
+		if (get_user(lifetime, (__u32 __user *) arg))
+			return -EFAULT;
+		if (lifetime >= EXT4_MB_LIFE_NR)
+			return -EINVAL;
+
+		/* a hint given here is not overridden by the name */
+		EXT4_I(inode)->i_mb_lifetime = lifetime;
+		ext4_set_inode_state(inode, EXT4_STATE_LIFETIME_SET);
+		return 0;
+	}
+
 	case FITRIM:
 	{
 		struct super_block *sb = inode->i_sb;
@@ -427,6 +448,8 @@ long ext4_compat_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		return err;
 	}
 	case EXT4_IOC_MOVE_EXT:
+	case EXT4_IOC_GETLIFETIME:
+	case EXT4_IOC_SETLIFETIME:
 	case FITRIM:
 		break;
 	default:
@@ -89,7 +89,9 @@
  * ext4_sb_info.s_locality_groups[smp_processor_id()]
  *
  * The reason for having a per cpu locality group is to reduce the contention
- * between CPUs. It is possible to get scheduled at this point.
+ * between CPUs. It is possible to get scheduled at this point.  Each CPU
+ * has one locality group per lifetime class (EXT4_MB_LIFE_*), the ones
+ * past the first are only used with mb_lifetime_sep set.
  *
  * The locality group prealloc space is used looking at whether we have
  * enough free space (pa_free) within the prealloc space.
@@ -1516,6 +1518,47 @@ static int mb_mark_used(struct ext4_buddy *e4b, struct ext4_free_extent *ex)
 	return ret;
 }
 
+/*
+ * With mb_lifetime_sep set, data of each lifetime class is allocated from
+ * its own region, the block groups [*start, *end) of the EXT4_MB_LIFE_NR
+ * equal parts the filesystem is split in.
+ */
+static void ext4_mb_lifetime_region(struct super_block *sb, int lifetime,
+				    ext4_group_t *start, ext4_group_t *end)
+{
+	ext4_group_t ngroups = ext4_get_groups_count(sb);
+	ext4_group_t q = ngroups / EXT4_MB_LIFE_NR;
+	ext4_group_t r = ngroups % EXT4_MB_LIFE_NR;
+
+	*start = q * lifetime + r * lifetime / EXT4_MB_LIFE_NR;
+	*end = q * (lifetime + 1) + r * (lifetime + 1) / EXT4_MB_LIFE_NR;
+}
+
+/*
+ * Where the last allocation of the lifetime class was done, or the start
+ * of its region if that is outside of it.
+ */
+static void ext4_mb_lifetime_goal(struct ext4_allocation_context *ac,
+				  struct ext4_free_extent *ex)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(ac->ac_sb);
+	ext4_group_t start, end, group;
+	ext4_grpblk_t block;
+
+	spin_lock(&sbi->s_md_lock);
+	group = sbi->s_mb_lifetime_group[ac->ac_lifetime];
+	block = sbi->s_mb_lifetime_start[ac->ac_lifetime];
+	spin_unlock(&sbi->s_md_lock);
+
+	ext4_mb_lifetime_region(ac->ac_sb, ac->ac_lifetime, &start, &end);
+	if (group < start || group >= end) {
+		group = start;
+		block = 0;
+	}
+	ex->fe_group = group;
+	ex->fe_start = block;
+}
+
 /*
  * Must be called under group lock!
  */
@@ -1551,6 +1594,13 @@ static void ext4_mb_use_best_found(struct ext4_allocation_context *ac,
 	get_page(ac->ac_bitmap_page);
 	ac->ac_buddy_page = e4b->bd_buddy_page;
 	get_page(ac->ac_buddy_page);
+	/* store last allocated for subsequent allocation of the class */
+	if (ac->ac_flags & EXT4_MB_LIFETIME_ALLOC) {
+		spin_lock(&sbi->s_md_lock);
+		sbi->s_mb_lifetime_group[ac->ac_lifetime] = ac->ac_f_ex.fe_group;
+		sbi->s_mb_lifetime_start[ac->ac_lifetime] = ac->ac_f_ex.fe_start;
+		spin_unlock(&sbi->s_md_lock);
+	}
 	/* store last allocated for subsequent stream allocation */
 	if (ac->ac_flags & EXT4_MB_STREAM_ALLOC) {
 		spin_lock(&sbi->s_md_lock);
@@ -2001,6 +2051,10 @@ ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 			ac->ac_2order = i - 1;
 	}
 
+	/* go on where the last data of the lifetime class went */
+	if (ac->ac_flags & EXT4_MB_LIFETIME_ALLOC)
+		ext4_mb_lifetime_goal(ac, &ac->ac_g_ex);
+
 	/* if stream allocation is enabled, use global goal */
 	if (ac->ac_flags & EXT4_MB_STREAM_ALLOC) {
 		/* TBD: may be hot point */
@@ -2194,6 +2248,83 @@ static const struct file_operations ext4_mb_seq_groups_fops = {
 	.release	= seq_release,
 };
 
+static const char * const ext4_mb_lifetime_names[EXT4_MB_LIFE_NR] = {
+	[EXT4_MB_LIFE_DEFAULT]	= "default",
+	[EXT4_MB_LIFE_SHORT]	= "short",
+	[EXT4_MB_LIFE_LONG]	= "long",
+};
+
+static void ext4_mb_seq_extent(struct seq_file *seq,
+			       struct ext4_free_extent *ex)
+{
+	char buf[25];
+
+	snprintf(buf, sizeof(buf), "%u/%d/%u@%u", ex->fe_group,
+		 ex->fe_start, ex->fe_len, ex->fe_logical);
+	seq_printf(seq, "%-23s ", buf);
+}
+
+static int ext4_mb_seq_lifetime_show(struct seq_file *seq, void *v)
+{
+	struct super_block *sb = seq->private;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_mb_lifetime_stats *ls = sbi->s_mb_lifetime_stats;
+	struct ext4_mb_history *h;
+	ext4_group_t start, end;
+	unsigned int i, n;
+
+	seq_printf(seq, "separation: %s, stats: %s\n",
+		   sbi->s_mb_lifetime_sep ? "on" : "off",
+		   sbi->s_mb_stats ? "on" : "off");
+	seq_printf(seq, "%-8s %10s %12s %12s %12s  %s\n", "class",
+		   "requests", "blocks", "in region", "preallocated",
+		   "groups");
+	for (i = 0; i < EXT4_MB_LIFE_NR; i++) {
+		ext4_mb_lifetime_region(sb, i, &start, &end);
+		seq_printf(seq, "%-8s %10u %12u %12u %12u  %u-%u\n",
+			   ext4_mb_lifetime_names[i],
+			   atomic_read(&ls->ls_reqs[i]),
+			   atomic_read(&ls->ls_blocks[i]),
+			   atomic_read(&ls->ls_in_region[i]),
+			   atomic_read(&ls->ls_prealloc[i]),
+			   start, end ? end - 1 : 0);
+	}
+
+	seq_printf(seq, "\n%-5s %-8s %-7s %-8s %-23s %-23s %-23s %-5s "
+		   "%-5s %-2s %-5s %s\n", "pid", "inode", "class", "op",
+		   "original", "goal", "result", "found", "grps", "cr",
+		   "flags", "in");
+	spin_lock(&sbi->s_bal_lock);
+	n = min_t(unsigned int, ls->ls_history_cur, EXT4_MB_HISTORY_SIZE);
+	for (i = ls->ls_history_cur - n; i != ls->ls_history_cur; i++) {
+		h = &ls->ls_history[i % EXT4_MB_HISTORY_SIZE];
+		seq_printf(seq, "%-5d %-8lu %-7s %-8s ", h->pid, h->ino,
+			   ext4_mb_lifetime_names[h->lifetime],
+			   h->op == EXT4_MB_HISTORY_ALLOC ? "alloc" : "prealloc");
+		ext4_mb_seq_extent(seq, &h->orig);
+		ext4_mb_seq_extent(seq, &h->goal);
+		ext4_mb_seq_extent(seq, &h->result);
+		seq_printf(seq, "%-5u %-5u %-2u 0x%04x %s\n", h->found,
+			   h->groups, h->cr, h->flags,
+			   h->in_region ? "yes" : "no");
+	}
+	spin_unlock(&sbi->s_bal_lock);
+	return 0;
+}
+
+static int ext4_mb_seq_lifetime_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ext4_mb_seq_lifetime_show, PDE(inode)->data);
+}
+
+static const struct file_operations ext4_mb_lifetime_fops = {
+	.owner		= THIS_MODULE,
+	.open		= ext4_mb_seq_lifetime_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 static struct kmem_cache *get_groupinfo_cache(int blocksize_bits)
 {
 	int cache_index = blocksize_bits - EXT4_MIN_BLOCK_LOG_SIZE;
@@ -2473,23 +2604,40 @@ int ext4_mb_init(struct super_block *sb, int needs_recovery)
 	sbi->s_mb_order2_reqs = MB_DEFAULT_ORDER2_REQS;
 	sbi->s_mb_group_prealloc = MB_DEFAULT_GROUP_PREALLOC;
 
-	sbi->s_locality_groups = alloc_percpu(struct ext4_locality_group);
+	sbi->s_mb_lifetime_stats = kzalloc(sizeof(*sbi->s_mb_lifetime_stats),
+					   GFP_KERNEL);
+	if (sbi->s_mb_lifetime_stats == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	sbi->s_locality_groups = __alloc_percpu(EXT4_MB_LIFE_NR *
+					sizeof(struct ext4_locality_group),
+					__alignof__(struct ext4_locality_group));
 	if (sbi->s_locality_groups == NULL) {
+		kfree(sbi->s_mb_lifetime_stats);
 		ret = -ENOMEM;
 		goto out;
 	}
 	for_each_possible_cpu(i) {
 		struct ext4_locality_group *lg;
+		unsigned k;
+
 		lg = per_cpu_ptr(sbi->s_locality_groups, i);
-		mutex_init(&lg->lg_mutex);
-		for (j = 0; j < PREALLOC_TB_SIZE; j++)
-			INIT_LIST_HEAD(&lg->lg_prealloc_list[j]);
-		spin_lock_init(&lg->lg_prealloc_lock);
+		for (k = 0; k < EXT4_MB_LIFE_NR; k++, lg++) {
+			mutex_init(&lg->lg_mutex);
+			for (j = 0; j < PREALLOC_TB_SIZE; j++)
+				INIT_LIST_HEAD(&lg->lg_prealloc_list[j]);
+			spin_lock_init(&lg->lg_prealloc_lock);
+		}
 	}
 
-	if (sbi->s_proc)
+	if (sbi->s_proc) {
 		proc_create_data("mb_groups", S_IRUGO, sbi->s_proc,
 				 &ext4_mb_seq_groups_fops, sb);
+		proc_create_data("mb_lifetime", S_IRUGO, sbi->s_proc,
+				 &ext4_mb_lifetime_fops, sb);
+	}
 
 	if (sbi->s_journal)
 		sbi->s_journal->j_commit_callback = release_blocks_on_commit;
@@ -2575,8 +2723,11 @@ int ext4_mb_release(struct super_block *sb)
 	}
 
 	free_percpu(sbi->s_locality_groups);
-	if (sbi->s_proc)
+	if (sbi->s_proc) {
+		remove_proc_entry("mb_lifetime", sbi->s_proc);
 		remove_proc_entry("mb_groups", sbi->s_proc);
+	}
+	kfree(sbi->s_mb_lifetime_stats);
 
 	return 0;
 }
@@ -3036,6 +3187,43 @@ ext4_mb_normalize_request(struct ext4_allocation_context *ac,
 		(unsigned) orig_size, (unsigned) start);
 }
 
+static void ext4_mb_collect_lifetime_stats(struct ext4_allocation_context *ac)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(ac->ac_sb);
+	struct ext4_mb_lifetime_stats *ls = sbi->s_mb_lifetime_stats;
+	struct ext4_mb_history *h;
+	int lifetime = ac->ac_lifetime;
+	ext4_group_t start, end;
+	int in_region;
+
+	ext4_mb_lifetime_region(ac->ac_sb, lifetime, &start, &end);
+	in_region = ac->ac_b_ex.fe_group >= start &&
+		    ac->ac_b_ex.fe_group < end;
+
+	atomic_inc(&ls->ls_reqs[lifetime]);
+	atomic_add(ac->ac_b_ex.fe_len, &ls->ls_blocks[lifetime]);
+	if (in_region)
+		atomic_add(ac->ac_b_ex.fe_len, &ls->ls_in_region[lifetime]);
+	if (ac->ac_op == EXT4_MB_HISTORY_PREALLOC)
+		atomic_add(ac->ac_b_ex.fe_len, &ls->ls_prealloc[lifetime]);
+
+	spin_lock(&sbi->s_bal_lock);
+	h = &ls->ls_history[ls->ls_history_cur++ % EXT4_MB_HISTORY_SIZE];
+	h->pid = current->pid;
+	h->ino = ac->ac_inode->i_ino;
+	h->orig = ac->ac_o_ex;
+	h->goal = ac->ac_g_ex;
+	h->result = ac->ac_b_ex;
+	h->found = ac->ac_found;
+	h->groups = ac->ac_groups_scanned;
+	h->flags = ac->ac_flags;
+	h->op = ac->ac_op;
+	h->cr = ac->ac_criteria;
+	h->lifetime = lifetime;
+	h->in_region = in_region;
+	spin_unlock(&sbi->s_bal_lock);
+}
+
 static void ext4_mb_collect_stats(struct ext4_allocation_context *ac)
 {
 	struct ext4_sb_info *sbi = EXT4_SB(ac->ac_sb);
@@ -3053,6 +3241,10 @@ static void ext4_mb_collect_stats(struct ext4_allocation_context *ac)
 			atomic_inc(&sbi->s_bal_breaks);
 	}
 
+	if (sbi->s_mb_stats && (ac->ac_flags & EXT4_MB_HINT_DATA) &&
+	    ac->ac_b_ex.fe_len > 0)
+		ext4_mb_collect_lifetime_stats(ac);
+
 	if (ac->ac_op == EXT4_MB_HISTORY_ALLOC)
 		trace_ext4_mballoc_alloc(ac);
 	else
@@ -3907,6 +4099,101 @@ static inline void ext4_mb_show_ac(struct ext4_allocation_context *ac)
 }
 #endif
 
+/*
+ * Suffixes of names of files whose data is expected to be deleted soon,
+ * and of media that is written once and kept
+ */
+static const char * const ext4_mb_short_suffixes[] = {
+	".tmp", ".temp", ".swp", ".part", ".partial", ".crdownload",
+	"-journal", "-wal", "~",
+};
+
+static const char * const ext4_mb_long_suffixes[] = {
+	".jpg", ".jpeg", ".png", ".gif", ".bmp", ".webp",
+	".mp3", ".m4a", ".aac", ".ogg", ".oga", ".flac", ".wav", ".wma",
+	".mp4", ".m4v", ".3gp", ".mkv", ".webm", ".avi", ".mov", ".wmv",
+	".mpg", ".mpeg", ".apk",
+};
+
+static int ext4_mb_name_match(const struct qstr *name,
+			      const char * const *suffixes, int nr)
+{
+	const char *s = (const char *)name->name;
+	int i, len;
+
+	for (i = 0; i < nr; i++) {
+		len = strlen(suffixes[i]);
+		if (name->len > len &&
+		    !strnicmp(s + name->len - len, suffixes[i], len))
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * Guess the lifetime of the data of a regular file from its name.  Called
+ * when the file is created and when it is renamed, so the blocks delayed
+ * allocation has not placed yet go with the final name of a file written
+ * under a temporary one.  A lifetime set with EXT4_IOC_SETLIFETIME stays.
+ */
+void ext4_mb_set_lifetime(struct inode *inode, const struct qstr *name)
+{
+	int lifetime = EXT4_MB_LIFE_DEFAULT;
+
+	if (ext4_test_inode_state(inode, EXT4_STATE_LIFETIME_SET))
+		return;
+
+	if (ext4_mb_name_match(name, ext4_mb_short_suffixes,
+			       ARRAY_SIZE(ext4_mb_short_suffixes)))
+		lifetime = EXT4_MB_LIFE_SHORT;
+	else if (ext4_mb_name_match(name, ext4_mb_long_suffixes,
+				    ARRAY_SIZE(ext4_mb_long_suffixes)))
+		lifetime = EXT4_MB_LIFE_LONG;
+
+	EXT4_I(inode)->i_mb_lifetime = lifetime;
+}
+
+/*
+ * Data of a file that is open but unlinked dies with the last close,
+ * otherwise the lifetime is the one of the inode.  With mb_lifetime_sep
+ * set, data that doesn't continue an extent on disk starts out where the
+ * last data of its class went, and the allocator searches on from there
+ * instead of from the global stream goal.  Small files of each class get
+ * their own locality group.
+ *
+ * One can switch this on via /sys/fs/ext4/<partition>/mb_lifetime_sep
+ */
+static void ext4_mb_lifetime_init(struct ext4_allocation_context *ac,
+				  struct ext4_allocation_request *ar)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(ac->ac_sb);
+	ext4_group_t start, end;
+
+	if (!(ac->ac_flags & EXT4_MB_HINT_DATA))
+		return;
+
+	if (ac->ac_inode->i_nlink == 0)
+		ac->ac_lifetime = EXT4_MB_LIFE_SHORT;
+	else
+		ac->ac_lifetime = EXT4_I(ac->ac_inode)->i_mb_lifetime;
+
+	if (!sbi->s_mb_lifetime_sep ||
+	    (ac->ac_flags & EXT4_MB_HINT_GOAL_ONLY))
+		return;
+
+	/* too few groups to give each class some */
+	ext4_mb_lifetime_region(ac->ac_sb, ac->ac_lifetime, &start, &end);
+	if (start >= end)
+		return;
+
+	ac->ac_flags |= EXT4_MB_LIFETIME_ALLOC;
+	if (!ar->pleft && !ar->pright) {
+		ext4_mb_lifetime_goal(ac, &ac->ac_g_ex);
+		ac->ac_o_ex.fe_group = ac->ac_g_ex.fe_group;
+		ac->ac_o_ex.fe_start = ac->ac_g_ex.fe_start;
+	}
+}
+
 /*
  * We use locality group preallocation for small size file. The size of the
  * file is determined by the current size or the resulting size after
@@ -3940,7 +4227,9 @@ static void ext4_mb_group_or_file(struct ext4_allocation_context *ac)
 	/* don't use group allocation for large files */
 	size = max(size, isize);
 	if (size > sbi->s_mb_stream_request) {
-		ac->ac_flags |= EXT4_MB_STREAM_ALLOC;
+		/* each lifetime class is a stream of its own */
+		if (!(ac->ac_flags & EXT4_MB_LIFETIME_ALLOC))
+			ac->ac_flags |= EXT4_MB_STREAM_ALLOC;
 		return;
 	}
 
@@ -3951,6 +4240,8 @@ static void ext4_mb_group_or_file(struct ext4_allocation_context *ac)
 	 * request from multiple CPUs.
 	 */
 	ac->ac_lg = __this_cpu_ptr(sbi->s_locality_groups);
+	if (ac->ac_flags & EXT4_MB_LIFETIME_ALLOC)
+		ac->ac_lg += ac->ac_lifetime;
 
 	/* we're going to use group allocation */
 	ac->ac_flags |= EXT4_MB_HINT_GROUP_ALLOC;
@@ -4001,6 +4292,8 @@ ext4_mb_initialize_context(struct ext4_allocation_context *ac,
 	ac->ac_g_ex.fe_len = len;
 	ac->ac_flags = ar->flags;
 
+	ext4_mb_lifetime_init(ac, ar);
+
 	/* we have to define context: we'll we work with a file or
 	 * locality group. this is a policy, actually */
 	ext4_mb_group_or_file(ac);
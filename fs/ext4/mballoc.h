@@ -191,12 +191,45 @@ struct ext4_allocation_context {
 	__u8 ac_2order;		/* if request is to allocate 2^N blocks and
 				 * N > 0, the field stores N, otherwise 0 */
 	__u8 ac_op;		/* operation, for history only */
+	__u8 ac_lifetime;	/* EXT4_MB_LIFE_* of the data */
 	struct page *ac_bitmap_page;
 	struct page *ac_buddy_page;
 	struct ext4_prealloc_space *ac_pa;
 	struct ext4_locality_group *ac_lg;
 };
 
+/*
+ * With mb_stats set, the allocations of data are counted per lifetime class
+ * and the last EXT4_MB_HISTORY_SIZE of them kept, both shown in
+ * /proc/fs/ext4/<dev>/mb_lifetime
+ */
+#define EXT4_MB_HISTORY_SIZE	128
+
+struct ext4_mb_history {
+	pid_t pid;
+	unsigned long ino;
+	struct ext4_free_extent orig;	/* original request */
+	struct ext4_free_extent goal;	/* normalized request */
+	struct ext4_free_extent result;	/* result */
+	__u16 found;		/* how many extents have been found */
+	__u16 groups;		/* how many groups have been scanned */
+	__u16 flags;		/* allocation hints */
+	__u8 op;		/* EXT4_MB_HISTORY_* */
+	__u8 cr;		/* which phase the result extent was found at */
+	__u8 lifetime;		/* EXT4_MB_LIFE_* */
+	__u8 in_region;		/* result is in the region of the class */
+};
+
+struct ext4_mb_lifetime_stats {
+	atomic_t ls_reqs[EXT4_MB_LIFE_NR];	/* data allocations */
+	atomic_t ls_blocks[EXT4_MB_LIFE_NR];	/* blocks allocated */
+	atomic_t ls_in_region[EXT4_MB_LIFE_NR];	/* ... of them in region */
+	atomic_t ls_prealloc[EXT4_MB_LIFE_NR];	/* served from prealloc */
+	/* protected by s_bal_lock */
+	unsigned int ls_history_cur;
+	struct ext4_mb_history ls_history[EXT4_MB_HISTORY_SIZE];
+};
+
 #define AC_STATUS_CONTINUE	1
 #define AC_STATUS_FOUND		2
 #define AC_STATUS_BREAK		3
@@ -1765,6 +1765,7 @@ retry:
 		inode->i_op = &ext4_file_inode_operations;
 		inode->i_fop = &ext4_file_operations;
 		ext4_set_aops(inode);
+		ext4_mb_set_lifetime(inode, &dentry->d_name);
 		err = ext4_add_nondir(handle, dentry, inode);
 	}
 	ext4_journal_stop(handle);
@@ -2564,6 +2565,9 @@ static int ext4_rename(struct inode *old_dir, struct dentry *old_dentry,
 		if (!test_opt(new_dir->i_sb, NO_AUTO_DA_ALLOC))
 			force_da_alloc = 1;
 	}
+	/* delayed blocks get allocated for the lifetime of the new name */
+	if (S_ISREG(old_inode->i_mode))
+		ext4_mb_set_lifetime(old_inode, &new_dentry->d_name);
 	retval = 0;
 
 end_rename:
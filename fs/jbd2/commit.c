@@ -20,6 +20,7 @@
 #include <linux/slab.h>
 #include <linux/mm.h>
 #include <linux/pagemap.h>
+#include <linux/pagevec.h>
 #include <linux/jiffies.h>
 #include <linux/crc32.h>
 #include <linux/writeback.h>
@@ -140,6 +141,15 @@ static int journal_submit_commit_record(journal_t *journal,
 	    !JBD2_HAS_INCOMPAT_FEATURE(journal,
 				       JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT))
 		ret = submit_bh(WRITE_SYNC | WRITE_FLUSH_FUA, bh);
+	else if (journal->j_flags & JBD2_BARRIER &&
+		 commit_transaction->t_need_data_flush &&
+		 journal->j_fs_dev == journal->j_dev)
+		/*
+		 * The checksum only covers the log.  The ordered data has
+		 * completed by now but must also reach the media before a
+		 * commit block that makes metadata pointing to it valid.
+		 */
+		ret = submit_bh(WRITE_SYNC | WRITE_FLUSH, bh);
 	else
 		ret = submit_bh(WRITE_SYNC, bh);
 
@@ -167,22 +177,78 @@ static int journal_wait_on_commit_record(journal_t *journal,
 	return ret;
 }
 
+/*
+ * Start writeout of the dirty pages of @mapping for the early data pass
+ * of the running transaction.  Unlike write_cache_pages() this never
+ * sleeps on a page lock: its holder may have a handle on the running
+ * transaction and wait for a buffer this commit still shadows, or for
+ * this commit itself.  Locked pages are skipped, the commit of their
+ * own transaction writes them.
+ */
+static int journal_start_inode_data_writeout(struct address_space *mapping)
+{
+	struct writeback_control wbc = {
+		.sync_mode = WB_SYNC_NONE,
+		.nr_to_write = LONG_MAX,
+		.range_start = 0,
+		.range_end = i_size_read(mapping->host),
+	};
+	pgoff_t index = 0, end = wbc.range_end >> PAGE_CACHE_SHIFT;
+	struct pagevec pvec;
+	int i, nr, ret = 0;
+
+	if (!mapping->a_ops->writepage)
+		return 0;
+
+	pagevec_init(&pvec, 0);
+	while (!ret && index <= end) {
+		nr = pagevec_lookup_tag(&pvec, mapping, &index,
+				PAGECACHE_TAG_DIRTY,
+				min(end - index, (pgoff_t)PAGEVEC_SIZE - 1) + 1);
+		if (!nr)
+			break;
+		for (i = 0; i < nr && !ret; i++) {
+			struct page *page = pvec.pages[i];
+
+			if (page->index > end || !trylock_page(page))
+				continue;
+			if (page->mapping != mapping || PageWriteback(page) ||
+			    !clear_page_dirty_for_io(page)) {
+				unlock_page(page);
+				continue;
+			}
+			ret = mapping->a_ops->writepage(page, &wbc);
+			if (ret == AOP_WRITEPAGE_ACTIVATE) {
+				unlock_page(page);
+				ret = 0;
+			}
+		}
+		pagevec_release(&pvec);
+		cond_resched();
+	}
+	return ret;
+}
+
 /*
  * write the filemap data using writepage() address_space_operations.
  * We don't do block allocation here even for delalloc. We don't
  * use writepages() because with dealyed allocation we may be doing
  * block allocation in writepages().
  */
-static int journal_submit_inode_data_buffers(struct address_space *mapping)
+static int journal_submit_inode_data_buffers(struct address_space *mapping,
+					     enum writeback_sync_modes sync_mode)
 {
 	int ret;
 	struct writeback_control wbc = {
-		.sync_mode =  WB_SYNC_ALL,
+		.sync_mode =  sync_mode,
 		.nr_to_write = mapping->nrpages * 2,
 		.range_start = 0,
 		.range_end = i_size_read(mapping->host),
 	};
 
+	if (sync_mode == WB_SYNC_NONE)
+		return journal_start_inode_data_writeout(mapping);
+
 	ret = generic_writepages(mapping, &wbc);
 	return ret;
 }
@@ -194,9 +260,14 @@ static int journal_submit_inode_data_buffers(struct address_space *mapping)
  * We are in a committing transaction. Therefore no new inode can be added to
  * our inode list. We use JI_COMMIT_RUNNING flag to protect inode we currently
  * operate on from being released while we write out pages.
+ *
+ * The running transaction is passed with WB_SYNC_NONE, to start its data
+ * early while the committing one waits for the log.  Inodes added to its
+ * list meanwhile go to the head and are simply left for its own commit.
  */
 static int journal_submit_data_buffers(journal_t *journal,
-		transaction_t *commit_transaction)
+		transaction_t *commit_transaction,
+		enum writeback_sync_modes sync_mode)
 {
 	struct jbd2_inode *jinode;
 	int err, ret = 0;
@@ -214,7 +285,7 @@ static int journal_submit_data_buffers(journal_t *journal,
 		 * only allocated blocks here.
 		 */
 		trace_jbd2_submit_inode_data(jinode->i_vfs_inode);
-		err = journal_submit_inode_data_buffers(mapping);
+		err = journal_submit_inode_data_buffers(mapping, sync_mode);
 		if (!ret)
 			ret = err;
 		spin_lock(&journal->j_list_lock);
@@ -294,6 +365,19 @@ static __u32 jbd2_checksum_data(__u32 crc32_sum, struct buffer_head *bh)
 	return checksum;
 }
 
+/*
+ * Account the time since *start to a phase of the commit, which is where
+ * the next phase starts.
+ */
+static inline void jbd2_commit_phase(struct transaction_stats_s *stats,
+				     int phase, ktime_t *start)
+{
+	ktime_t now = ktime_get();
+
+	stats->ts_phase[phase] += ktime_to_ns(ktime_sub(now, *start));
+	*start = now;
+}
+
 static void write_tag_block(int tag_bytes, journal_block_tag_t *tag,
 				   unsigned long long block)
 {
@@ -318,7 +402,7 @@ void jbd2_journal_commit_transaction(journal_t *journal)
 	int flags;
 	int err;
 	unsigned long long blocknr;
-	ktime_t start_time;
+	ktime_t start_time, phase_start;
 	u64 commit_time;
 	char *tagp = NULL;
 	journal_header_t *header;
@@ -355,6 +439,9 @@ void jbd2_journal_commit_transaction(journal_t *journal)
 	jbd_debug(1, "JBD: starting commit of transaction %d\n",
 			commit_transaction->t_tid);
 
+	memset(stats.ts_phase, 0, sizeof(stats.ts_phase));
+	phase_start = ktime_get();
+
 	write_lock(&journal->j_state_lock);
 	commit_transaction->t_state = T_LOCKED;
 
@@ -446,6 +533,7 @@ void jbd2_journal_commit_transaction(journal_t *journal)
 	commit_transaction->t_log_start = journal->j_head;
 	wake_up(&journal->j_wait_transaction_locked);
 	write_unlock(&journal->j_state_lock);
+	jbd2_commit_phase(&stats, JBD2_PHASE_LOCK, &phase_start);
 
 	jbd_debug (3, "JBD: commit phase 2\n");
 
@@ -453,7 +541,8 @@ void jbd2_journal_commit_transaction(journal_t *journal)
 	 * Now start flushing things to disk, in the order they appear
 	 * on the transaction lists.  Data blocks go first.
 	 */
-	err = journal_submit_data_buffers(journal, commit_transaction);
+	err = journal_submit_data_buffers(journal, commit_transaction,
+					  WB_SYNC_ALL);
 	if (err)
 		jbd2_journal_abort(journal, err);
 
@@ -473,6 +562,8 @@ void jbd2_journal_commit_transaction(journal_t *journal)
 	commit_transaction->t_state = T_COMMIT;
 	write_unlock(&journal->j_state_lock);
 
+	jbd2_commit_phase(&stats, JBD2_PHASE_DATA, &phase_start);
+
 	trace_jbd2_commit_logging(journal, commit_transaction);
 	stats.run.rs_logging = jiffies;
 	stats.run.rs_flushing = jbd2_time_diff(stats.run.rs_flushing,
@@ -661,6 +752,8 @@ start_journal_io:
 		}
 	}
 
+	jbd2_commit_phase(&stats, JBD2_PHASE_LOG, &phase_start);
+
 	err = journal_finish_inode_data_buffers(journal, commit_transaction);
 	if (err) {
 		printk(KERN_WARNING
@@ -684,6 +777,7 @@ start_journal_io:
 	    (journal->j_fs_dev != journal->j_dev) &&
 	    (journal->j_flags & JBD2_BARRIER))
 		blkdev_issue_flush(journal->j_fs_dev, GFP_KERNEL, NULL);
+	jbd2_commit_phase(&stats, JBD2_PHASE_DATA_WAIT, &phase_start);
 
 	/* Done it all: now write the commit record asynchronously. */
 	if (JBD2_HAS_INCOMPAT_FEATURE(journal,
@@ -695,6 +789,29 @@ start_journal_io:
 	}
 
 	blk_finish_plug(&plug);
+	jbd2_commit_phase(&stats, JBD2_PHASE_COMMIT, &phase_start);
+
+	/*
+	 * With the log writes, and the commit block of an asynchronous
+	 * commit, in flight, start writing the ordered data of the running
+	 * transaction.  Its commit then mostly waits for data that is
+	 * already on the way instead of submitting all of it itself.  The
+	 * running transaction can't go away, only we commit it.  This must
+	 * not block on page locks, see journal_start_inode_data_writeout().
+	 */
+	if (JBD2_HAS_INCOMPAT_FEATURE(journal,
+				      JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT) &&
+	    !is_journal_aborted(journal)) {
+		transaction_t *next_transaction;
+
+		read_lock(&journal->j_state_lock);
+		next_transaction = journal->j_running_transaction;
+		read_unlock(&journal->j_state_lock);
+		if (next_transaction)
+			journal_submit_data_buffers(journal, next_transaction,
+						    WB_SYNC_NONE);
+		jbd2_commit_phase(&stats, JBD2_PHASE_NEXT_DATA, &phase_start);
+	}
 
 	/* Lo and behold: we have just managed to send a transaction to
            the log.  Before we can commit it, wait for the IO so far to
@@ -797,6 +914,7 @@ wait_for_iobuf:
 		__brelse(bh);		/* One for getblk */
 		/* AKPM: bforget here */
 	}
+	jbd2_commit_phase(&stats, JBD2_PHASE_LOG_WAIT, &phase_start);
 
 	if (err)
 		jbd2_journal_abort(journal, err);
@@ -816,11 +934,13 @@ wait_for_iobuf:
 	}
 	if (cbh)
 		err = journal_wait_on_commit_record(journal, cbh);
+	jbd2_commit_phase(&stats, JBD2_PHASE_COMMIT, &phase_start);
 	if (JBD2_HAS_INCOMPAT_FEATURE(journal,
 				      JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT) &&
 	    journal->j_flags & JBD2_BARRIER) {
 		blkdev_issue_flush(journal->j_dev, GFP_KERNEL, NULL);
 	}
+	jbd2_commit_phase(&stats, JBD2_PHASE_FLUSH, &phase_start);
 
 	if (err)
 		jbd2_journal_abort(journal, err);
@@ -971,6 +1091,7 @@ restart_loop:
 	commit_transaction->t_start = jiffies;
 	stats.run.rs_logging = jbd2_time_diff(stats.run.rs_logging,
 					      commit_transaction->t_start);
+	jbd2_commit_phase(&stats, JBD2_PHASE_FORGET, &phase_start);
 
 	/*
 	 * File the transaction statistics
@@ -994,6 +1115,12 @@ restart_loop:
 	journal->j_stats.run.rs_handle_count += stats.run.rs_handle_count;
 	journal->j_stats.run.rs_blocks += stats.run.rs_blocks;
 	journal->j_stats.run.rs_blocks_logged += stats.run.rs_blocks_logged;
+	for (i = 0; i < JBD2_NR_PHASES; i++) {
+		journal->j_stats.ts_phase[i] += stats.ts_phase[i];
+		journal->j_stats.ts_phase_last[i] = stats.ts_phase[i];
+		if (stats.ts_phase[i] > journal->j_stats.ts_phase_max[i])
+			journal->j_stats.ts_phase_max[i] = stats.ts_phase[i];
+	}
 	spin_unlock(&journal->j_history_lock);
 
 	commit_transaction->t_state = T_FINISHED;
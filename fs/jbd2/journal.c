@@ -761,9 +761,22 @@ static void *jbd2_seq_info_next(struct seq_file *seq, void *v, loff_t *pos)
 	return NULL;
 }
 
+static const char * const jbd2_phase_names[JBD2_NR_PHASES] = {
+	[JBD2_PHASE_LOCK]	= "locking",
+	[JBD2_PHASE_DATA]	= "data",
+	[JBD2_PHASE_LOG]	= "logging",
+	[JBD2_PHASE_DATA_WAIT]	= "data wait",
+	[JBD2_PHASE_NEXT_DATA]	= "next data",
+	[JBD2_PHASE_LOG_WAIT]	= "logging wait",
+	[JBD2_PHASE_COMMIT]	= "commit block",
+	[JBD2_PHASE_FLUSH]	= "cache flush",
+	[JBD2_PHASE_FORGET]	= "checkpointing",
+};
+
 static int jbd2_seq_info_show(struct seq_file *seq, void *v)
 {
 	struct jbd2_stats_proc_session *s = seq->private;
+	int i;
 
 	if (v != SEQ_START_TOKEN)
 		return 0;
@@ -790,6 +803,15 @@ static int jbd2_seq_info_show(struct seq_file *seq, void *v)
 	    s->stats->run.rs_blocks / s->stats->ts_tid);
 	seq_printf(seq, "  %lu logged blocks per transaction\n",
 	    s->stats->run.rs_blocks_logged / s->stats->ts_tid);
+	seq_printf(seq, "commit phases:  %12s %12s %12s\n",
+		   "average us", "last us", "max us");
+	for (i = 0; i < JBD2_NR_PHASES; i++)
+		seq_printf(seq, "  %-13s %12llu %12llu %12llu\n",
+			   jbd2_phase_names[i],
+			   div_u64(div_u64(s->stats->ts_phase[i],
+					   s->stats->ts_tid), 1000),
+			   div_u64(s->stats->ts_phase_last[i], 1000),
+			   div_u64(s->stats->ts_phase_max[i], 1000));
 	return 0;
 }
 
@@ -6,6 +6,7 @@
 #include <linux/aio_abi.h>
 #include <linux/uio.h>
 #include <linux/rcupdate.h>
+#include <linux/wait.h>
 
 #include <asm/atomic.h>
 
@@ -78,11 +79,12 @@ struct kioctx;
  * If ki_retry returns -EIOCBRETRY it has made a promise that kick_iocb()
  * will be called on the kiocb pointer in the future.  This may happen
  * through generic helpers that associate kiocb->ki_wait with a wait
- * queue head that ki_retry uses via current->io_wait.  It can also happen
- * with custom tracking and manual calls to kick_iocb(), though that is
- * discouraged.  In either case, kick_iocb() must be called once and only
- * once.  ki_retry must ensure forward progress, the AIO core will wait
- * indefinitely for kick_iocb() to be called.
+ * queue head, as generic_file_aio_read() does with kiocb_page_wait() for
+ * pages that are being read in.  It can also happen with custom tracking
+ * and manual calls to kick_iocb(), though that is discouraged.  In either
+ * case, kick_iocb() must be called once and only once.  ki_retry must
+ * ensure forward progress, the AIO core will wait indefinitely for
+ * kick_iocb() to be called.
  */
 struct kiocb {
 	struct list_head	ki_run_list;
@@ -117,6 +119,13 @@ struct kiocb {
 
 	struct list_head	ki_list;	/* the aio core uses this
 						 * for cancellation */
+	struct list_head	ki_batch;	/* batch allocation */
+
+	/*
+	 * Waits on a page bit, PG_locked, that ki_retry returned
+	 * -EIOCBRETRY for.  The wakeup kicks the iocb.
+	 */
+	struct wait_bit_queue	ki_wait;
 
 	/*
 	 * If the aio_resfd field of the userspace iocb is not zero,
@@ -141,6 +150,14 @@ struct kiocb {
 		(x)->ki_user_data = 0;                  \
 	} while (0)
 
+/*
+ * The completion ring is mapped at the aio_context_t address, so events can
+ * be reaped from userspace without io_getevents(): load tail, read barrier,
+ * copy the events from head up to tail, full barrier, then advance head with
+ * a compare-and-swap, as aio_read_evt() does in the kernel.  The kernel
+ * never moves head itself other than through io_getevents(), and only
+ * writes tail after the event it covers.
+ */
 #define AIO_RING_MAGIC			0xa10a10a1
 #define AIO_RING_COMPAT_FEATURES	1
 #define AIO_RING_INCOMPAT_FEATURES	0
@@ -167,7 +184,6 @@ struct aio_ring_info {
 	unsigned long		mmap_size;
 
 	struct page		**ring_pages;
-	spinlock_t		ring_lock;
 	long			nr_pages;
 
 	unsigned		nr, tail;
@@ -210,6 +226,7 @@ extern ssize_t wait_on_sync_kiocb(struct kiocb *iocb);
 extern int aio_put_req(struct kiocb *iocb);
 extern void kick_iocb(struct kiocb *iocb);
 extern int aio_complete(struct kiocb *iocb, long res, long res2);
+extern struct wait_bit_queue *kiocb_page_wait(struct kiocb *iocb);
 struct mm_struct;
 extern void exit_aio(struct mm_struct *mm);
 extern long do_io_submit(aio_context_t ctx_id, long nr,
@@ -219,6 +236,7 @@ static inline ssize_t wait_on_sync_kiocb(struct kiocb *iocb) { return 0; }
 static inline int aio_put_req(struct kiocb *iocb) { return 0; }
 static inline void kick_iocb(struct kiocb *iocb) { }
 static inline int aio_complete(struct kiocb *iocb, long res, long res2) { return 0; }
+static inline struct wait_bit_queue *kiocb_page_wait(struct kiocb *iocb) { return NULL; }
 struct mm_struct;
 static inline void exit_aio(struct mm_struct *mm) { }
 static inline long do_io_submit(aio_context_t ctx_id, long nr,
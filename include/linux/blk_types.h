@@ -61,6 +61,8 @@ struct bio {
 
 	unsigned int		bi_comp_cpu;	/* completion CPU */
 
+	unsigned int		bi_cookie;	/* request, for blk_poll() */
+
 	atomic_t		bi_cnt;		/* pin count */
 
 	struct bio_vec		*bi_io_vec;	/* the actual vec list */
@@ -151,6 +153,7 @@ enum rq_flag_bits {
 	__REQ_IO_STAT,		/* account I/O stat */
 	__REQ_MIXED_MERGE,	/* merge of different types, fail separately */
 	__REQ_SECURE,		/* secure discard (used with __REQ_DISCARD) */
+	__REQ_POLL_SLEPT,	/* poller already slept on this request */
 	__REQ_NR_BITS,		/* stops here */
 };
 
@@ -191,5 +194,6 @@ enum rq_flag_bits {
 #define REQ_IO_STAT		(1 << __REQ_IO_STAT)
 #define REQ_MIXED_MERGE		(1 << __REQ_MIXED_MERGE)
 #define REQ_SECURE		(1 << __REQ_SECURE)
+#define REQ_POLL_SLEPT		(1 << __REQ_POLL_SLEPT)
 
 #endif /* __LINUX_BLK_TYPES_H */
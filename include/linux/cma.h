@@ -0,0 +1,75 @@
+#ifndef __CMA_H__
+#define __CMA_H__
+
+/*
+ * Contiguous Memory Allocator
+ *
+ * A contiguous memory area is set aside at boot, but instead of lying
+ * idle until a device needs it, its pageblocks are given to the page
+ * allocator as MIGRATE_CMA.  Movable allocations may use them as long as
+ * nobody else does; cma_alloc() migrates those pages elsewhere when a
+ * physically contiguous buffer is wanted from the area.
+ */
+
+#include <linux/types.h>
+#include <linux/errno.h>
+
+struct cma;
+struct page;
+
+#ifdef CONFIG_CMA
+
+/* Number of areas the board files may declare */
+#define MAX_CMA_AREAS	CONFIG_CMA_AREAS
+
+extern int cma_declare_contiguous(phys_addr_t base, phys_addr_t size,
+				  phys_addr_t limit, const char *name,
+				  struct cma **res_cma);
+extern struct cma *cma_find(const char *name);
+extern phys_addr_t cma_get_base(struct cma *cma);
+extern unsigned long cma_get_size(struct cma *cma);
+
+extern struct page *cma_alloc(struct cma *cma, unsigned long count,
+			      unsigned int align);
+extern bool cma_release(struct cma *cma, struct page *pages,
+			unsigned long count);
+
+#else
+
+static inline int cma_declare_contiguous(phys_addr_t base, phys_addr_t size,
+					 phys_addr_t limit, const char *name,
+					 struct cma **res_cma)
+{
+	return -ENOSYS;
+}
+
+static inline struct cma *cma_find(const char *name)
+{
+	return NULL;
+}
+
+static inline phys_addr_t cma_get_base(struct cma *cma)
+{
+	return 0;
+}
+
+static inline unsigned long cma_get_size(struct cma *cma)
+{
+	return 0;
+}
+
+static inline struct page *cma_alloc(struct cma *cma, unsigned long count,
+				     unsigned int align)
+{
+	return NULL;
+}
+
+static inline bool cma_release(struct cma *cma, struct page *pages,
+			       unsigned long count)
+{
+	return false;
+}
+
+#endif
+
+#endif
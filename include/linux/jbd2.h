@@ -682,9 +682,28 @@ struct transaction_run_stats_s {
 	__u32			rs_blocks_logged;
 };
 
+/*
+ * Phases of jbd2_journal_commit_transaction(), timed in nanoseconds
+ */
+enum {
+	JBD2_PHASE_LOCK,	/* waiting for the handles to stop */
+	JBD2_PHASE_DATA,	/* submitting ordered data and revoke records */
+	JBD2_PHASE_LOG,		/* submitting the metadata to the log */
+	JBD2_PHASE_DATA_WAIT,	/* waiting for the ordered data */
+	JBD2_PHASE_NEXT_DATA,	/* submitting the next transaction's data */
+	JBD2_PHASE_LOG_WAIT,	/* waiting for the log writes */
+	JBD2_PHASE_COMMIT,	/* writing the commit block */
+	JBD2_PHASE_FLUSH,	/* flushing the cache of the journal device */
+	JBD2_PHASE_FORGET,	/* filing the buffers for checkpointing */
+	JBD2_NR_PHASES
+};
+
 struct transaction_stats_s {
 	unsigned long		ts_tid;
 	struct transaction_run_stats_s run;
+	u64			ts_phase[JBD2_NR_PHASES];	/* summed up */
+	u64			ts_phase_max[JBD2_NR_PHASES];
+	u64			ts_phase_last[JBD2_NR_PHASES];
 };
 
 static inline unsigned long
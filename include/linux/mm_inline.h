@@ -21,10 +21,192 @@ static inline int page_is_file_cache(struct page *page)
 	return !PageSwapBacked(page);
 }
 
+#ifdef CONFIG_LRU_GEN
+
+static inline bool lru_gen_enabled(void)
+{
+	return true;
+}
+
+static inline int lru_gen_from_seq(unsigned long seq)
+{
+	return seq % MAX_NR_GENS;
+}
+
+/* generation of @page, -1 if it is not on a multi-gen LRU list */
+static inline int page_lru_gen(struct page *page)
+{
+	unsigned long flags = ACCESS_ONCE(page->flags);
+
+	return ((flags & LRU_GEN_MASK) >> LRU_GEN_PGOFF) - 1;
+}
+
+/*
+ * Set the generation of @page to @new_gen, or take it off the multi-gen
+ * LRU if @new_gen is -1.  Page table walks move pages between generations
+ * without the lru_lock, so this has to be atomic against the other users
+ * of page->flags.  Returns the previous generation, or -1 if @page was
+ * not on a list, in which case @page is left alone unless @add is set.
+ */
+static inline int page_xchg_lru_gen(struct page *page, int new_gen, bool add)
+{
+	unsigned long old_flags, new_flags;
+	int old_gen;
+
+	do {
+		old_flags = ACCESS_ONCE(page->flags);
+		old_gen = ((old_flags & LRU_GEN_MASK) >> LRU_GEN_PGOFF) - 1;
+		if (old_gen < 0 && !add)
+			return -1;
+		new_flags = (old_flags & ~LRU_GEN_MASK) |
+			    ((unsigned long)(new_gen + 1) << LRU_GEN_PGOFF);
+	} while (cmpxchg(&page->flags, old_flags, new_flags) != old_flags);
+
+	return old_gen;
+}
+
+static inline bool lru_gen_is_active(struct zone *zone, int gen)
+{
+	unsigned long max_seq = zone->lrugen.max_seq;
+
+	return gen == lru_gen_from_seq(max_seq) ||
+	       gen == lru_gen_from_seq(max_seq - 1);
+}
+
+/* account @nr_pages of @type moving from @old_gen to @new_gen */
+static inline void lru_gen_update_size(struct zone *zone, int type,
+				       int old_gen, int new_gen, long nr_pages)
+{
+	struct lru_gen_struct *lrugen = &zone->lrugen;
+	enum lru_list lru = type ? LRU_INACTIVE_FILE : LRU_INACTIVE_ANON;
+
+	if (old_gen >= 0) {
+		lrugen->nr_pages[old_gen][type] -= nr_pages;
+		__mod_zone_page_state(zone, NR_LRU_BASE + lru +
+			(lru_gen_is_active(zone, old_gen) ? LRU_ACTIVE : 0),
+			-nr_pages);
+	}
+	if (new_gen >= 0) {
+		lrugen->nr_pages[new_gen][type] += nr_pages;
+		__mod_zone_page_state(zone, NR_LRU_BASE + lru +
+			(lru_gen_is_active(zone, new_gen) ? LRU_ACTIVE : 0),
+			nr_pages);
+	}
+}
+
+/*
+ * Pick the generation for a page entering the multi-gen LRU: activated
+ * pages go to the youngest generation, freshly faulted anon pages and
+ * pages under writeback for reclaim to the second youngest, everything
+ * else to the second oldest so that it is not scanned again right away.
+ * PageActive is only a hint for this and is never set on pages sitting
+ * on the lists.
+ */
+static inline bool lru_gen_add_page(struct zone *zone, struct page *page,
+				    enum lru_list l)
+{
+	struct lru_gen_struct *lrugen = &zone->lrugen;
+	int type = page_is_file_cache(page);
+	unsigned long seq;
+	int gen;
+
+	if (is_unevictable_lru(l) || PageUnevictable(page))
+		return false;
+
+	if (PageActive(page))
+		seq = lrugen->max_seq;
+	else if ((!type && !PageSwapCache(page)) ||
+		 (PageReclaim(page) &&
+		  (PageDirty(page) || PageWriteback(page))))
+		seq = lrugen->max_seq - 1;
+	else if (lrugen->min_seq[type] + MIN_NR_GENS >= lrugen->max_seq)
+		seq = lrugen->min_seq[type];
+	else
+		seq = lrugen->min_seq[type] + 1;
+
+	gen = lru_gen_from_seq(seq);
+	ClearPageActive(page);
+	page_xchg_lru_gen(page, gen, true);
+	lru_gen_update_size(zone, type, -1, gen, hpage_nr_pages(page));
+	list_add(&page->lru, &lrugen->lists[gen][type]);
+
+	return true;
+}
+
+/*
+ * Take @page off the multi-gen LRU.  Unless it is being reclaimed or
+ * freed, pages from the two youngest generations get PageActive so that
+ * whoever puts them back, e.g. after migration, keeps them young.
+ */
+static inline bool lru_gen_del_page(struct zone *zone, struct page *page,
+				    bool reclaiming)
+{
+	int gen = page_xchg_lru_gen(page, -1, false);
+
+	if (gen < 0)
+		return false;
+
+	VM_BUG_ON(PageActive(page) || PageUnevictable(page));
+	lru_gen_update_size(zone, page_is_file_cache(page), gen, -1,
+			    hpage_nr_pages(page));
+	list_del(&page->lru);
+	if (!reclaiming && lru_gen_is_active(zone, gen))
+		SetPageActive(page);
+
+	return true;
+}
+
+/* move @page to the tail of the oldest generation, to be reclaimed next */
+static inline bool lru_gen_rotate_page(struct zone *zone, struct page *page)
+{
+	struct lru_gen_struct *lrugen = &zone->lrugen;
+	int type = page_is_file_cache(page);
+	int gen = lru_gen_from_seq(lrugen->min_seq[type]);
+	int old_gen;
+
+	old_gen = page_xchg_lru_gen(page, gen, false);
+	if (old_gen < 0)
+		return false;
+
+	lru_gen_update_size(zone, type, old_gen, gen, hpage_nr_pages(page));
+	list_move_tail(&page->lru, &lrugen->lists[gen][type]);
+
+	return true;
+}
+
+#else /* !CONFIG_LRU_GEN */
+
+static inline bool lru_gen_enabled(void)
+{
+	return false;
+}
+
+static inline bool lru_gen_add_page(struct zone *zone, struct page *page,
+				    enum lru_list l)
+{
+	return false;
+}
+
+static inline bool lru_gen_del_page(struct zone *zone, struct page *page,
+				    bool reclaiming)
+{
+	return false;
+}
+
+static inline bool lru_gen_rotate_page(struct zone *zone, struct page *page)
+{
+	return false;
+}
+
+#endif /* CONFIG_LRU_GEN */
+
 static inline void
 __add_page_to_lru_list(struct zone *zone, struct page *page, enum lru_list l,
 		       struct list_head *head)
 {
+	if (lru_gen_add_page(zone, page, l))
+		return;
+
 	list_add(&page->lru, head);
 	__mod_zone_page_state(zone, NR_LRU_BASE + l, hpage_nr_pages(page));
 	mem_cgroup_add_lru_list(page, l);
@@ -39,6 +221,9 @@ add_page_to_lru_list(struct zone *zone, struct page *page, enum lru_list l)
 static inline void
 del_page_from_lru_list(struct zone *zone, struct page *page, enum lru_list l)
 {
+	if (lru_gen_del_page(zone, page, false))
+		return;
+
 	list_del(&page->lru);
 	__mod_zone_page_state(zone, NR_LRU_BASE + l, -hpage_nr_pages(page));
 	mem_cgroup_del_lru_list(page, l);
@@ -64,6 +249,9 @@ del_page_from_lru(struct zone *zone, struct page *page)
 {
 	enum lru_list l;
 
+	if (lru_gen_del_page(zone, page, true))
+		return;
+
 	list_del(&page->lru);
 	if (PageUnevictable(page)) {
 		__ClearPageUnevictable(page);
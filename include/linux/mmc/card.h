@@ -64,6 +64,9 @@ struct mmc_ext_csd {
 	unsigned long long	enhanced_area_offset;	/* Units: Byte */
 	unsigned int		enhanced_area_size;	/* Units: KB */
 	unsigned int		boot_size;		/* in bytes */
+	u8			max_packed_writes;
+	u8			max_packed_reads;
+	bool			packed_event_en;	/* exception event on packed failure */
 	u8			raw_partition_support;	/* 160 */
 	u8			raw_erased_mem_count;	/* 181 */
 	u8			raw_ext_csd_structure;	/* 194 */
@@ -79,6 +82,35 @@ struct mmc_ext_csd {
 	u8			raw_sectors[4];		/* 212 - 4 bytes */
 };
 
+/* Entries in a packed command with a 512 byte header */
+#define MMC_PACKED_MAX_ENTRIES	63
+
+/* Why the block driver stopped adding requests to a packed write */
+enum mmc_packed_stop {
+	MMC_PACKED_STOP_EMPTY_QUEUE,
+	MMC_PACKED_STOP_MAX_ENTRIES,
+	MMC_PACKED_STOP_MAX_SECTORS,
+	MMC_PACKED_STOP_MAX_SEGMENTS,
+	MMC_PACKED_STOP_DATA_DIR,
+	MMC_PACKED_STOP_FLUSH_DISCARD,
+	MMC_PACKED_STOP_REL_WRITE,
+	MMC_PACKED_STOP_LARGE_REQ,
+	MMC_PACKED_STOP_NR,
+};
+
+/*
+ * Packed write statistics, updated with the host claimed and shown in
+ * debugfs.
+ */
+struct mmc_packed_stats {
+	unsigned long		entries[MMC_PACKED_MAX_ENTRIES + 1];
+	unsigned long		stop[MMC_PACKED_STOP_NR];
+	unsigned long		shallow;	/* writes not packed: queue too short */
+	unsigned long		large;		/* writes not packed: too large */
+	unsigned long		failures;	/* packed writes that failed */
+	unsigned long		reverted;	/* requests sent again on their own */
+};
+
 struct sd_scr {
 	unsigned char		sda_vsn;
 	unsigned char		sda_spec3;
@@ -216,6 +248,8 @@ struct mmc_card {
 
 	unsigned int		sd_bus_speed;	/* Bus Speed Mode set for the card */
 
+	struct mmc_packed_stats	packed_stats;	/* packed write statistics */
+
 	struct dentry		*debugfs_root;
 };
 
@@ -40,8 +40,26 @@
 #define MIGRATE_MOVABLE       2
 #define MIGRATE_PCPTYPES      3 /* the number of types on the pcp lists */
 #define MIGRATE_RESERVE       3
+#ifdef CONFIG_CMA
+/*
+ * MIGRATE_CMA pageblocks belong to a contiguous memory area.  Only
+ * movable allocations fall back to them and they never change their
+ * type, so that cma_alloc() can always migrate their pages away and hand
+ * out the range.
+ */
+#define MIGRATE_CMA           4
+#define MIGRATE_ISOLATE       5 /* can't allocate from here */
+#define MIGRATE_TYPES         6
+#else
 #define MIGRATE_ISOLATE       4 /* can't allocate from here */
 #define MIGRATE_TYPES         5
+#endif
+
+#ifdef CONFIG_CMA
+#  define is_migrate_cma(migratetype) unlikely((migratetype) == MIGRATE_CMA)
+#else
+#  define is_migrate_cma(migratetype) false
+#endif
 
 #define for_each_migratetype_order(order, type) \
 	for (order = 0; order < MAX_ORDER; order++) \
@@ -106,6 +124,8 @@ enum zone_stat_item {
 	NR_SHMEM,		/* shmem pages (included tmpfs/GEM pages) */
 	NR_DIRTIED,		/* page dirtyings since bootup */
 	NR_WRITTEN,		/* page writings since bootup */
+	WORKINGSET_REFAULT,	/* evicted file pages faulted back in */
+	WORKINGSET_ACTIVATE,	/* refaults activated right away */
 #ifdef CONFIG_NUMA
 	NUMA_HIT,		/* allocated in intended node */
 	NUMA_MISS,		/* allocated in non intended node */
@@ -169,13 +189,20 @@ enum zone_watermarks {
 #define low_wmark_pages(z) (z->watermark[WMARK_LOW])
 #define high_wmark_pages(z) (z->watermark[WMARK_HIGH])
 
+/*
+ * The pcp-lists cache pages of every order up to PAGE_ALLOC_COSTLY_ORDER,
+ * with one list per order and migrate type.
+ */
+#define NR_PCP_ORDERS		(PAGE_ALLOC_COSTLY_ORDER + 1)
+#define NR_PCP_LISTS		(MIGRATE_PCPTYPES * NR_PCP_ORDERS)
+
 struct per_cpu_pages {
-	int count;		/* number of pages in the list */
+	int count;		/* number of base pages in the lists */
 	int high;		/* high watermark, emptying needed */
-	int batch;		/* chunk size for buddy add/remove */
+	int batch;		/* chunk size for buddy add/remove, in pages */
 
-	/* Lists of pages, one per migrate type stored on the pcp-lists */
-	struct list_head lists[MIGRATE_PCPTYPES];
+	/* Lists of pages, one per order and migrate type */
+	struct list_head lists[NR_PCP_LISTS];
 };
 
 struct per_cpu_pageset {
@@ -262,6 +289,34 @@ enum zone_type {
 #error ZONES_SHIFT -- too many zones configured adjust calculation
 #endif
 
+#ifdef CONFIG_LRU_GEN
+/*
+ * The multi-gen LRU sorts evictable pages into generations by the time
+ * they were last found accessed.  Each generation is identified by a
+ * sequence number; max_seq is the youngest and min_seq[] the oldest one
+ * still holding anon [0] and file [1] pages.  A page records its
+ * generation, seq % MAX_NR_GENS, in page->flags.  Aging creates a new
+ * generation and moves the pages found young in page tables there,
+ * eviction works on the oldest one.  The two youngest generations are
+ * accounted as active, the others as inactive.
+ */
+#define MIN_NR_GENS		2UL
+#define MAX_NR_GENS		4UL
+
+struct lru_gen_struct {
+	unsigned long		max_seq;
+	unsigned long		min_seq[2];
+	/* jiffies when each generation was created */
+	unsigned long		timestamps[MAX_NR_GENS];
+	/* pages are sorted onto the list of their generation lazily */
+	struct list_head	lists[MAX_NR_GENS][2];
+	/* may drift transiently as page table walks update pages locklessly */
+	long			nr_pages[MAX_NR_GENS][2];
+	/* credit for scanning anon when both types are equally old */
+	unsigned int		anon_credit;
+};
+#endif
+
 struct zone_reclaim_stat {
 	/*
 	 * The pageout code in vmscan.c keeps track of how many of the
@@ -346,6 +401,12 @@ struct zone {
 
 	struct zone_reclaim_stat reclaim_stat;
 
+	/* Evictions & activations on the inactive file list, see workingset.c */
+	atomic_long_t		inactive_age;
+#ifdef CONFIG_LRU_GEN
+	struct lru_gen_struct	lrugen;		/* protected by lru_lock */
+#endif
+
 	unsigned long		pages_scanned;	   /* since last reclaim */
 	unsigned long		flags;		   /* zone flags, see below */
 
@@ -636,6 +697,13 @@ typedef struct pglist_data {
 	struct task_struct *kswapd;
 	int kswapd_max_order;
 	enum zone_type classzone_idx;
+#ifdef CONFIG_COMPACTION
+	int kcompactd_max_order;
+	enum zone_type kcompactd_classzone_idx;
+	wait_queue_head_t kcompactd_wait;
+	struct task_struct *kcompactd;
+	bool proactive_compact_trigger;
+#endif
 } pg_data_t;
 
 #define node_present_pages(nid)	(NODE_DATA(nid)->node_present_pages)
@@ -20,6 +20,7 @@ enum {
 
 #ifdef CONFIG_CGROUP_MEM_RES_CTLR
 #include <linux/bit_spinlock.h>
+#include <linux/mm.h>
 
 /*
  * Page Cgroup can be considered as an extended mem_map.
@@ -48,7 +49,33 @@ static inline void __init page_cgroup_init(void)
 }
 #endif
 
-struct page_cgroup *lookup_page_cgroup(struct page *page);
+/*
+ * The memcg LRU hooks look up the page_cgroup of every page that is added
+ * to, moved on or taken off an LRU list with the lru_lock held, so the
+ * lookup is kept inline.
+ */
+#ifdef CONFIG_SPARSEMEM
+static inline struct page_cgroup *lookup_page_cgroup(struct page *page)
+{
+	unsigned long pfn = page_to_pfn(page);
+	struct mem_section *section = __pfn_to_section(pfn);
+
+	if (!section->page_cgroup)
+		return NULL;
+	return section->page_cgroup + pfn;
+}
+#else
+static inline struct page_cgroup *lookup_page_cgroup(struct page *page)
+{
+	pg_data_t *pgdat = NODE_DATA(page_to_nid(page));
+
+	if (unlikely(!pgdat->node_page_cgroup))
+		return NULL;
+	return pgdat->node_page_cgroup + page_to_pfn(page) -
+		pgdat->node_start_pfn;
+}
+#endif
+
 struct page *lookup_cgroup_page(struct page_cgroup *pc);
 
 #define TESTPCGFLAG(uname, lname)			\
@@ -227,6 +227,11 @@ static inline struct page *page_cache_alloc_readahead(struct address_space *x)
 
 typedef int filler_t(void *, struct page *);
 
+pgoff_t page_cache_next_hole(struct address_space *mapping,
+			     pgoff_t index, unsigned long max_scan);
+pgoff_t page_cache_prev_hole(struct address_space *mapping,
+			     pgoff_t index, unsigned long max_scan);
+
 extern struct page * find_get_page(struct address_space *mapping,
 				pgoff_t index);
 extern struct page * find_lock_page(struct address_space *mapping,
@@ -372,6 +377,9 @@ static inline int wait_on_page_locked_killable(struct page *page)
 	return 0;
 }
 
+extern int wait_on_page_locked_async(struct page *page,
+				     struct wait_bit_queue *wait);
+
 /* 
  * Wait for a page to be unlocked.
  *
@@ -459,7 +467,9 @@ int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
 int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 				pgoff_t index, gfp_t gfp_mask);
 extern void delete_from_page_cache(struct page *page);
-extern void __delete_from_page_cache(struct page *page);
+extern void __delete_from_page_cache(struct page *page, void *shadow);
+int page_cache_tree_insert(struct address_space *mapping, struct page *page,
+			   void **shadowp);
 int replace_page_cache_page(struct page *old, struct page *new, gfp_t gfp_mask);
 
 /*
@@ -360,6 +360,8 @@ extern signed long schedule_timeout_killable(signed long timeout);
 extern signed long schedule_timeout_uninterruptible(signed long timeout);
 asmlinkage void schedule(void);
 extern int mutex_spin_on_owner(struct mutex *lock, struct task_struct *owner);
+extern int rwsem_spin_on_owner(struct rw_semaphore *sem,
+			       struct task_struct *owner);
 
 struct nsproxy;
 struct user_namespace;
@@ -21,9 +21,15 @@
 
 #define FOR_ALL_ZONES(xx) DMA_ZONE(xx) DMA32_ZONE(xx) xx##_NORMAL HIGHMEM_ZONE(xx) , xx##_MOVABLE
 
+/* one item per order cached on the pcp-lists, see NR_PCP_ORDERS */
+#define FOR_PCP_ORDERS(xx) xx##_ORDER0, xx##_ORDER1, xx##_ORDER2, xx##_ORDER3
+
 enum vm_event_item { PGPGIN, PGPGOUT, PSWPIN, PSWPOUT,
 		FOR_ALL_ZONES(PGALLOC),
 		PGFREE, PGACTIVATE, PGDEACTIVATE,
+		FOR_PCP_ORDERS(PCP_HIT),	/* served from the pcp-lists */
+		FOR_PCP_ORDERS(PCP_REFILL),	/* pcp-list refilled from buddy */
+		PCP_DRAIN,			/* pcp batch returned to buddy */
 		PGFAULT, PGMAJFAULT,
 		FOR_ALL_ZONES(PGREFILL),
 		FOR_ALL_ZONES(PGSTEAL),
@@ -36,9 +42,17 @@ enum vm_event_item { PGPGIN, PGPGOUT, PSWPIN, PSWPOUT,
 		KSWAPD_LOW_WMARK_HIT_QUICKLY, KSWAPD_HIGH_WMARK_HIT_QUICKLY,
 		KSWAPD_SKIP_CONGESTION_WAIT,
 		PAGEOUTRUN, ALLOCSTALL, PGROTATED,
+		WORKINGSET_NODERECLAIM,	/* shadow-only tree blocks reclaimed */
+		READAHEAD_SYNC,		/* readahead started by a cache miss */
+		READAHEAD_ASYNC,	/* readahead started by a marked page */
+		READAHEAD_STRIDE, READAHEAD_BACKWARD,
+		READAHEAD_PAGES,	/* pages read by readahead */
 #ifdef CONFIG_COMPACTION
 		COMPACTBLOCKS, COMPACTPAGES, COMPACTPAGEFAILED,
 		COMPACTSTALL, COMPACTFAIL, COMPACTSUCCESS,
+		COMPACTSTALL_US,	/* time spent in direct compaction */
+		KCOMPACTD_WAKE, KCOMPACTD_SUCCESS, KCOMPACTD_FAIL,
+		KCOMPACTD_PROACTIVE,
 #endif
 #ifdef CONFIG_HUGETLB_PAGE
 		HTLB_BUDDY_PGALLOC, HTLB_BUDDY_PGALLOC_FAIL,
@@ -51,6 +65,11 @@ enum vm_event_item { PGPGIN, PGPGOUT, PSWPIN, PSWPOUT,
 		UNEVICTABLE_PGCLEARED,	/* on COW, page truncate */
 		UNEVICTABLE_PGSTRANDED,	/* unable to isolate on unlock */
 		UNEVICTABLE_MLOCKFREED,
+#ifdef CONFIG_LRU_GEN
+		LRU_GEN_AGING,		/* generations created */
+		LRU_GEN_WALK,		/* page table walks */
+		LRU_GEN_YOUNG,		/* pages found young by the walks */
+#endif
 #ifdef CONFIG_TRANSPARENT_HUGEPAGE
 		THP_FAULT_ALLOC,
 		THP_FAULT_FALLBACK,
@@ -0,0 +1,120 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM readahead
+
+#if !defined(_TRACE_READAHEAD_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_READAHEAD_H
+
+#include <linux/types.h>
+#include <linux/fs.h>
+#include <linux/tracepoint.h>
+
+#define RA_PATTERN_INITIAL	0	/* start of file, or oversize read */
+#define RA_PATTERN_SEQUENTIAL	1	/* expected offset of the window */
+#define RA_PATTERN_MARKER	2	/* marker hit without valid state */
+#define RA_PATTERN_CONTEXT	3	/* history pages in the page cache */
+#define RA_PATTERN_STRIDE	4	/* constant distance between misses */
+#define RA_PATTERN_BACKWARD	5	/* reading backwards */
+#define RA_PATTERN_RANDOM	6	/* none of the above */
+
+#define show_ra_pattern(pattern)					\
+	__print_symbolic(pattern,					\
+		{RA_PATTERN_INITIAL,	"initial"},			\
+		{RA_PATTERN_SEQUENTIAL,	"sequential"},			\
+		{RA_PATTERN_MARKER,	"marker"},			\
+		{RA_PATTERN_CONTEXT,	"context"},			\
+		{RA_PATTERN_STRIDE,	"stride"},			\
+		{RA_PATTERN_BACKWARD,	"backward"},			\
+		{RA_PATTERN_RANDOM,	"random"})
+
+/*
+ * Every range read from disk through the readahead code, including
+ * read-around for mmap faults and readahead(2).  The pages already in
+ * the page cache are skipped, so the @actual pages are the ones that
+ * would have been needed from a cold cache.
+ */
+TRACE_EVENT(mm_readahead,
+
+	TP_PROTO(struct address_space *mapping, pgoff_t offset,
+		unsigned long nr_to_read, int actual),
+
+	TP_ARGS(mapping, offset, nr_to_read, actual),
+
+	TP_STRUCT__entry(
+		__field(dev_t, dev)
+		__field(unsigned long, ino)
+		__field(pgoff_t, offset)
+		__field(unsigned long, nr_to_read)
+		__field(int, actual)
+	),
+
+	TP_fast_assign(
+		__entry->dev = mapping->host->i_sb->s_dev;
+		__entry->ino = mapping->host->i_ino;
+		__entry->offset = offset;
+		__entry->nr_to_read = nr_to_read;
+		__entry->actual = actual;
+	),
+
+	TP_printk("dev=%d:%d ino=%lu offset=%lu nr_to_read=%lu actual=%d",
+		MAJOR(__entry->dev), MINOR(__entry->dev),
+		__entry->ino,
+		(unsigned long)__entry->offset,
+		__entry->nr_to_read,
+		__entry->actual)
+);
+
+/*
+ * The decision of ondemand_readahead().  Calls with async=1 come from a
+ * PG_readahead marker, i.e. an earlier readahead that was hit; the ratio
+ * of those to the async=0 ones, which are cache misses, tells how well
+ * the reads of a file are predicted.
+ */
+TRACE_EVENT(mm_readahead_pattern,
+
+	TP_PROTO(struct address_space *mapping, pgoff_t offset,
+		unsigned long req_size, bool async, int pattern,
+		struct file_ra_state *ra),
+
+	TP_ARGS(mapping, offset, req_size, async, pattern, ra),
+
+	TP_STRUCT__entry(
+		__field(dev_t, dev)
+		__field(unsigned long, ino)
+		__field(pgoff_t, offset)
+		__field(unsigned long, req_size)
+		__field(bool, async)
+		__field(int, pattern)
+		__field(pgoff_t, start)
+		__field(unsigned int, size)
+		__field(long, stride)
+	),
+
+	TP_fast_assign(
+		__entry->dev = mapping->host->i_sb->s_dev;
+		__entry->ino = mapping->host->i_ino;
+		__entry->offset = offset;
+		__entry->req_size = req_size;
+		__entry->async = async;
+		__entry->pattern = pattern;
+		__entry->start = ra->start;
+		__entry->size = ra->size;
+		__entry->stride = ra->stride;
+	),
+
+	TP_printk("dev=%d:%d ino=%lu offset=%lu req_size=%lu async=%d "
+		"pattern=%s start=%lu size=%u stride=%ld",
+		MAJOR(__entry->dev), MINOR(__entry->dev),
+		__entry->ino,
+		(unsigned long)__entry->offset,
+		__entry->req_size,
+		__entry->async,
+		show_ra_pattern(__entry->pattern),
+		(unsigned long)__entry->start,
+		__entry->size,
+		__entry->stride)
+);
+
+#endif /* _TRACE_READAHEAD_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
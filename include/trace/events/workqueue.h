@@ -54,7 +54,7 @@ TRACE_EVENT(workqueue_queue_work,
 		__entry->function	= work->func;
 		__entry->workqueue	= cwq->wq;
 		__entry->req_cpu	= req_cpu;
-		__entry->cpu		= cwq->gcwq->cpu;
+		__entry->cpu		= cwq->pool->gcwq->cpu;
 	),
 
 	TP_printk("work struct=%p function=%pf workqueue=%p req_cpu=%u cpu=%u",
@@ -102,6 +102,37 @@ TRACE_EVENT(workqueue_execute_start,
 	TP_printk("work struct %p: function %pf", __entry->work, __entry->function)
 );
 
+/**
+ * workqueue_execute_latency - time a work spent queued before execution
+ * @work:	pointer to struct work_struct
+ * @latency:	nanoseconds from queueing to the start of execution
+ *
+ * Only available with CONFIG_WQ_LATENCY_STATS, fired right before
+ * workqueue_execute_start.
+ */
+TRACE_EVENT(workqueue_execute_latency,
+
+	TP_PROTO(struct work_struct *work, u64 latency),
+
+	TP_ARGS(work, latency),
+
+	TP_STRUCT__entry(
+		__field( void *,	work	)
+		__field( void *,	function)
+		__field( u64,		latency	)
+	),
+
+	TP_fast_assign(
+		__entry->work		= work;
+		__entry->function	= work->func;
+		__entry->latency	= latency;
+	),
+
+	TP_printk("work struct %p: function %pf latency %llu ns",
+		  __entry->work, __entry->function,
+		  (unsigned long long)__entry->latency)
+);
+
 /**
  * workqueue_execute_end - called immediately before the workqueue callback
  * @work:	pointer to struct work_struct
@@ -59,6 +59,8 @@
 #include <linux/magic.h>
 #include <linux/pid.h>
 #include <linux/nsproxy.h>
+#include <linux/bootmem.h>
+#include <linux/log2.h>
 
 #include <asm/futex.h>
 
@@ -66,7 +68,15 @@
 
 int __read_mostly futex_cmpxchg_enabled;
 
-#define FUTEX_HASHBITS (CONFIG_BASE_SMALL ? 4 : 8)
+/*
+ * Both hash tables are sized by the number of possible cpus at boot:
+ * the global one holds all shared futexes, each mm lazily gets its own
+ * (smaller, bounded) one for PROCESS_PRIVATE futexes so that unrelated
+ * processes never contend on the same bucket locks.
+ */
+#define FUTEX_HASH_PER_CPU		(CONFIG_BASE_SMALL ? 16 : 256)
+#define FUTEX_PRIVATE_HASH_PER_CPU	(CONFIG_BASE_SMALL ? 4 : 16)
+#define FUTEX_PRIVATE_HASH_MAX		256
 
 /*
  * Futex flags used to encode options to functions and preserve them across
@@ -147,17 +157,80 @@ struct futex_hash_bucket {
 	struct plist_head chain;
 };
 
-static struct futex_hash_bucket futex_queues[1<<FUTEX_HASHBITS];
+static struct futex_hash_bucket *futex_queues __read_mostly;
+static unsigned long futex_hashsize __read_mostly;
+static unsigned long futex_private_hashsize __read_mostly;
+
+static void futex_init_buckets(struct futex_hash_bucket *fh, unsigned long n)
+{
+	unsigned long i;
+
+	for (i = 0; i < n; i++) {
+		plist_head_init(&fh[i].chain);
+		spin_lock_init(&fh[i].lock);
+	}
+}
+
+static void futex_hash_free(struct futex_hash_bucket *fh)
+{
+	if (fh != futex_queues)
+		kfree(fh);
+}
+
+/*
+ * Make sure @mm has its private futex hash. It is installed once and
+ * only freed with the mm, so every private key of @mm hashes to the same
+ * table for the whole lifetime of the mm. If no memory can be found for
+ * it, @mm uses the first buckets of the global table instead, which is
+ * at least as large; private keys still compare by mm.
+ */
+static void futex_mm_hash_alloc(struct mm_struct *mm)
+{
+	struct futex_hash_bucket *fh;
+
+	if (likely(ACCESS_ONCE(mm->futex_hash)))
+		return;
+
+	fh = kmalloc(futex_private_hashsize * sizeof(*fh),
+		     GFP_KERNEL | __GFP_NOWARN);
+	if (fh)
+		futex_init_buckets(fh, futex_private_hashsize);
+	else
+		fh = futex_queues;
+
+	/* cmpxchg() orders the bucket initialization before publication */
+	if (cmpxchg(&mm->futex_hash, NULL, fh) != NULL)
+		futex_hash_free(fh);
+}
+
+void futex_mm_init(struct mm_struct *mm)
+{
+	mm->futex_hash = NULL;
+}
+
+void futex_mm_free(struct mm_struct *mm)
+{
+	futex_hash_free(mm->futex_hash);
+}
 
 /*
  * We hash on the keys returned from get_futex_key (see below).
+ * PROCESS_PRIVATE keys (neither FUT_OFF_INODE nor FUT_OFF_MMSHARED)
+ * go to the per-mm table which get_futex_key() has set up.
  */
 static struct futex_hash_bucket *hash_futex(union futex_key *key)
 {
 	u32 hash = jhash2((u32*)&key->both.word,
 			  (sizeof(key->both.word)+sizeof(key->both.ptr))/4,
 			  key->both.offset);
-	return &futex_queues[hash & ((1 << FUTEX_HASHBITS)-1)];
+
+	if (!(key->both.offset & (FUT_OFF_INODE|FUT_OFF_MMSHARED))) {
+		struct futex_hash_bucket *fh = key->private.mm->futex_hash;
+
+		smp_read_barrier_depends();
+		return &fh[hash & (futex_private_hashsize - 1)];
+	}
+	return &futex_queues[hash & (futex_hashsize - 1)];
 }
 
 /*
@@ -256,6 +329,7 @@ get_futex_key(u32 __user *uaddr, int fshared, union futex_key *key, int rw)
 	if (!fshared) {
 		if (unlikely(!access_ok(VERIFY_WRITE, uaddr, sizeof(u32))))
 			return -EFAULT;
+		futex_mm_hash_alloc(mm);
 		key->private.mm = mm;
 		key->private.address = address;
 		get_futex_key_refs(key);
@@ -2711,7 +2785,7 @@ SYSCALL_DEFINE6(futex, u32 __user *, uaddr, int, op, u32, val,
 static int __init futex_init(void)
 {
 	u32 curval;
-	int i;
+	unsigned int futex_shift;
 
 	/*
 	 * This will fail and we want it. Some arch implementations do
@@ -2726,10 +2800,19 @@ static int __init futex_init(void)
 	if (cmpxchg_futex_value_locked(&curval, NULL, 0, 0) == -EFAULT)
 		futex_cmpxchg_enabled = 1;
 
-	for (i = 0; i < ARRAY_SIZE(futex_queues); i++) {
-		plist_head_init(&futex_queues[i].chain);
-		spin_lock_init(&futex_queues[i].lock);
-	}
+	futex_hashsize = roundup_pow_of_two(FUTEX_HASH_PER_CPU *
+					    num_possible_cpus());
+	futex_queues = alloc_large_system_hash("futex", sizeof(*futex_queues),
+					       futex_hashsize, 0, 0,
+					       &futex_shift, NULL,
+					       futex_hashsize);
+	futex_hashsize = 1UL << futex_shift;
+	futex_init_buckets(futex_queues, futex_hashsize);
+
+	futex_private_hashsize = min3(futex_hashsize,
+			(unsigned long)FUTEX_PRIVATE_HASH_MAX,
+			roundup_pow_of_two(FUTEX_PRIVATE_HASH_PER_CPU *
+					   num_possible_cpus()));
 
 	return 0;
 }
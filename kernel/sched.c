@@ -4373,6 +4373,61 @@ int mutex_spin_on_owner(struct mutex *lock, struct task_struct *owner)
 }
 #endif
 
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+
+static inline bool rwsem_owner_running(struct rw_semaphore *sem,
+				       struct task_struct *owner)
+{
+	bool ret = false;
+
+	rcu_read_lock();
+	if (sem->owner != owner)
+		goto fail;
+
+	/*
+	 * Same as owner_running(): only dereference owner->on_cpu once
+	 * we know sem->owner still points at it, the rcu_read_lock()
+	 * keeps the task_struct around.
+	 */
+	barrier();
+
+	ret = owner->on_cpu;
+fail:
+	rcu_read_unlock();
+
+	return ret;
+}
+
+/*
+ * Spin while the writer owning @sem is running on another cpu.
+ * Returns 1 if the owner released the lock, 0 if the caller should
+ * stop spinning and queue itself. Like mutex_spin_on_owner(), "owner"
+ * is speculative: readers never set it, the callers check for a
+ * reader-owned rwsem themselves.
+ */
+int rwsem_spin_on_owner(struct rw_semaphore *sem, struct task_struct *owner)
+{
+	if (!sched_feat(OWNER_SPIN))
+		return 0;
+
+	while (rwsem_owner_running(sem, owner)) {
+		if (need_resched())
+			return 0;
+
+		arch_mutex_cpu_relax();
+	}
+
+	/*
+	 * If the owner changed to another writer there is likely heavy
+	 * contention, stop spinning.
+	 */
+	if (ACCESS_ONCE(sem->owner))
+		return 0;
+
+	return 1;
+}
+#endif
+
 #ifdef CONFIG_PREEMPT
 /*
  * this is the entry point to schedule() from in-kernel preemption
@@ -0,0 +1,241 @@
+/*
+ * Spinlock contention benchmark
+ *
+ * Starts one kernel thread per CPU (or nthreads of them), all hammering
+ * a single spinlock for a fixed time, and reports per-thread acquisition
+ * counts and acquisition latencies together with a fairness index.  It is
+ * meant to compare arch spinlock implementations, e.g. with and without
+ * CONFIG_ARM_TICKET_LOCKS:
+ *
+ *	insmod spinlock_bench.ko duration=10 hold_loops=200
+ *
+ * The results are printed to the kernel log when the run completes.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/types.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/kthread.h>
+#include <linux/err.h>
+#include <linux/spinlock.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/cpu.h>
+#include <linux/completion.h>
+#include <linux/jiffies.h>
+#include <asm/atomic.h>
+#include <asm/div64.h>
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Spinlock contention benchmark");
+
+static int nthreads;		/* # threads, defaults to one per online cpu */
+static int duration = 5;	/* Length of the run, in seconds */
+static int hold_loops = 100;	/* cpu_relax() loops with the lock held */
+static int delay_loops = 100;	/* cpu_relax() loops between acquisitions */
+
+module_param(nthreads, int, 0444);
+MODULE_PARM_DESC(nthreads, "Number of contending threads (0 = one per cpu)");
+module_param(duration, int, 0444);
+MODULE_PARM_DESC(duration, "Duration of the run in seconds");
+module_param(hold_loops, int, 0444);
+MODULE_PARM_DESC(hold_loops, "Busy loops inside the critical section");
+module_param(delay_loops, int, 0444);
+MODULE_PARM_DESC(delay_loops, "Busy loops between two acquisitions");
+
+struct bench_thread {
+	struct task_struct *task;
+	int cpu;
+	unsigned long acquisitions;
+	u64 total_ns;		/* sum of acquisition latencies */
+	u64 max_ns;		/* worst acquisition latency */
+} ____cacheline_aligned_in_smp;
+
+static DEFINE_SPINLOCK(bench_lock);
+static unsigned long bench_shared;	/* protected by bench_lock */
+static unsigned long bench_errors;	/* mutual exclusion violations */
+
+static atomic_t bench_ready;
+static atomic_t bench_running;
+static int bench_go;
+static unsigned long bench_end;
+static DECLARE_COMPLETION(bench_done);
+
+static void bench_delay(int loops)
+{
+	while (loops-- > 0)
+		cpu_relax();
+}
+
+static int bench_thread_fn(void *arg)
+{
+	struct bench_thread *bt = arg;
+	unsigned long seen;
+	u64 t0, t1;
+
+	/* wait until every thread is bound and ready to go */
+	atomic_inc(&bench_ready);
+	while (!ACCESS_ONCE(bench_go))
+		schedule_timeout_uninterruptible(1);
+	smp_rmb();
+
+	while (time_before(jiffies, bench_end)) {
+		t0 = local_clock();
+		spin_lock(&bench_lock);
+		t1 = local_clock();
+
+		seen = ++bench_shared;
+		bench_delay(hold_loops);
+		if (bench_shared != seen)
+			bench_errors++;
+		spin_unlock(&bench_lock);
+
+		t1 -= t0;
+		bt->total_ns += t1;
+		if (t1 > bt->max_ns)
+			bt->max_ns = t1;
+		if ((++bt->acquisitions & 1023) == 0)
+			cond_resched();
+
+		bench_delay(delay_loops);
+	}
+
+	if (atomic_dec_and_test(&bench_running))
+		complete(&bench_done);
+
+	/* keep the task around until the results have been collected */
+	set_current_state(TASK_INTERRUPTIBLE);
+	while (!kthread_should_stop()) {
+		schedule();
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+
+	return 0;
+}
+
+static void bench_report(struct bench_thread *threads, int n)
+{
+	unsigned long min = ULONG_MAX, max = 0;
+	u64 sum = 0, sum_sq = 0, total_ns = 0, worst_ns = 0, fairness, avg;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		struct bench_thread *bt = &threads[i];
+
+		avg = bt->total_ns;
+		if (bt->acquisitions)
+			do_div(avg, bt->acquisitions);
+		printk(KERN_INFO "spinlock_bench: cpu %d: %lu acquisitions, "
+		       "avg %llu ns, max %llu ns\n", bt->cpu, bt->acquisitions,
+		       (unsigned long long)avg,
+		       (unsigned long long)bt->max_ns);
+
+		min = min(min, bt->acquisitions);
+		max = max(max, bt->acquisitions);
+		sum += bt->acquisitions;
+		sum_sq += (u64)bt->acquisitions * bt->acquisitions;
+		total_ns += bt->total_ns;
+		worst_ns = max(worst_ns, bt->max_ns);
+	}
+
+	/* Jain's fairness index (sum x)^2 / (n * sum x^2), scaled by 1000 */
+	fairness = 0;
+	if (sum_sq) {
+		u64 scaled = sum * 1000;
+
+		do_div(scaled, n);
+		fairness = scaled * sum;
+		do_div(fairness, sum_sq);
+	}
+
+	avg = total_ns;
+	if (sum)
+		do_div(avg, sum);
+
+	printk(KERN_INFO "spinlock_bench: %d threads, %llu acquisitions in "
+	       "%d s, avg %llu ns, max %llu ns, min/max per cpu %lu/%lu, "
+	       "fairness %llu.%03llu, %lu errors\n", n,
+	       (unsigned long long)sum, duration, (unsigned long long)avg,
+	       (unsigned long long)worst_ns, min, max,
+	       (unsigned long long)fairness / 1000,
+	       (unsigned long long)fairness % 1000, bench_errors);
+}
+
+static int __init spinlock_bench_init(void)
+{
+	struct bench_thread *threads;
+	int i, n, cpu, ret = 0;
+
+	get_online_cpus();
+
+	n = nthreads > 0 ? nthreads : num_online_cpus();
+	threads = kcalloc(n, sizeof(*threads), GFP_KERNEL);
+	if (!threads) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	atomic_set(&bench_ready, 0);
+	atomic_set(&bench_running, n);
+
+	cpu = cpumask_first(cpu_online_mask);
+	for (i = 0; i < n; i++) {
+		struct bench_thread *bt = &threads[i];
+
+		bt->cpu = cpu;
+		bt->task = kthread_create(bench_thread_fn, bt,
+					  "spinlock_bench/%d", i);
+		if (IS_ERR(bt->task)) {
+			ret = PTR_ERR(bt->task);
+			bt->task = NULL;
+			break;
+		}
+		kthread_bind(bt->task, cpu);
+
+		cpu = cpumask_next(cpu, cpu_online_mask);
+		if (cpu >= nr_cpu_ids)
+			cpu = cpumask_first(cpu_online_mask);
+	}
+
+	if (ret) {
+		/* threads that were never woken never ran bench_thread_fn */
+		for (i = 0; i < n && threads[i].task; i++)
+			kthread_stop(threads[i].task);
+		goto out_free;
+	}
+
+	for (i = 0; i < n; i++)
+		wake_up_process(threads[i].task);
+	while (atomic_read(&bench_ready) < n)
+		schedule_timeout_uninterruptible(1);
+
+	bench_end = jiffies + duration * HZ;
+	smp_wmb();
+	bench_go = 1;
+
+	wait_for_completion(&bench_done);
+
+	for (i = 0; i < n; i++)
+		kthread_stop(threads[i].task);
+
+	bench_report(threads, n);
+
+out_free:
+	kfree(threads);
+out:
+	put_online_cpus();
+	return ret;
+}
+
+static void __exit spinlock_bench_exit(void)
+{
+}
+
+module_init(spinlock_bench_init);
+module_exit(spinlock_bench_exit);
@@ -46,6 +46,9 @@ void __init_rwsem(struct rw_semaphore *sem, const char *name,
 	sem->activity = 0;
 	spin_lock_init(&sem->wait_lock);
 	INIT_LIST_HEAD(&sem->wait_list);
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+	sem->owner = NULL;
+#endif
 }
 EXPORT_SYMBOL(__init_rwsem);
 
@@ -56,7 +59,9 @@ EXPORT_SYMBOL(__init_rwsem);
  *   - the 'waiting count' is non-zero
  * - the spinlock must be held by the caller
  * - woken process blocks are discarded from the list after having task zeroed
- * - writers are only woken if wakewrite is non-zero
+ * - writers are only woken if wakewrite is non-zero, and are not granted
+ *   the lock: they take it themselves, so that a running writer may steal
+ *   it from a sleeping one
  */
 static inline struct rw_semaphore *
 __rwsem_do_wake(struct rw_semaphore *sem, int wakewrite)
@@ -73,20 +78,11 @@ __rwsem_do_wake(struct rw_semaphore *sem, int wakewrite)
 		goto dont_wake_writers;
 	}
 
-	/* if we are allowed to wake writers try to grant a single write lock
-	 * if there's a writer at the front of the queue
-	 * - we leave the 'waiting count' incremented to signify potential
-	 *   contention
+	/* if we are allowed to wake writers, wake the writer at the front of
+	 * the queue but leave it to retake the lock itself
 	 */
 	if (waiter->flags & RWSEM_WAITING_FOR_WRITE) {
-		sem->activity = -1;
-		list_del(&waiter->list);
-		tsk = waiter->task;
-		/* Don't touch waiter after ->task has been NULLed */
-		smp_mb();
-		waiter->task = NULL;
-		wake_up_process(tsk);
-		put_task_struct(tsk);
+		wake_up_process(waiter->task);
 		goto out;
 	}
 
@@ -121,18 +117,10 @@ static inline struct rw_semaphore *
 __rwsem_wake_one_writer(struct rw_semaphore *sem)
 {
 	struct rwsem_waiter *waiter;
-	struct task_struct *tsk;
-
-	sem->activity = -1;
 
 	waiter = list_entry(sem->wait_list.next, struct rwsem_waiter, list);
-	list_del(&waiter->list);
+	wake_up_process(waiter->task);
 
-	tsk = waiter->task;
-	smp_mb();
-	waiter->task = NULL;
-	wake_up_process(tsk);
-	put_task_struct(tsk);
 	return sem;
 }
 
@@ -202,9 +190,72 @@ int __down_read_trylock(struct rw_semaphore *sem)
 	return ret;
 }
 
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+/*
+ * Optimistic spinning.
+ *
+ * If the lock is held by a writer that is running on another CPU, spin
+ * until it releases the lock and then steal it rather than queueing and
+ * sleeping. Readers don't record an owner: a semaphore with no owner and
+ * a positive activity count is read owned, and is not spun on.
+ */
+static int rwsem_optimistic_spin(struct rw_semaphore *sem)
+{
+	struct task_struct *owner;
+	unsigned long flags;
+	int taken = 0;
+
+	preempt_disable();
+
+	owner = ACCESS_ONCE(sem->owner);
+	if (!owner)
+		goto out;
+
+	for (;;) {
+		owner = ACCESS_ONCE(sem->owner);
+		if (owner && !rwsem_spin_on_owner(sem, owner))
+			break;
+
+		/* readers may hold it for a long time, don't spin on them */
+		if (!owner && ACCESS_ONCE(sem->activity) > 0)
+			break;
+
+		if (ACCESS_ONCE(sem->activity) == 0) {
+			spin_lock_irqsave(&sem->wait_lock, flags);
+			if (sem->activity == 0) {
+				sem->activity = -1;
+				taken = 1;
+			}
+			spin_unlock_irqrestore(&sem->wait_lock, flags);
+			if (taken)
+				break;
+		}
+
+		/*
+		 * When there's no owner, we might have preempted between the
+		 * owner acquiring the lock and setting the owner field. An RT
+		 * task would live-lock here.
+		 */
+		if (!owner && (need_resched() || rt_task(current)))
+			break;
+
+		arch_mutex_cpu_relax();
+	}
+ out:
+	preempt_enable();
+	return taken;
+}
+#else
+static inline int rwsem_optimistic_spin(struct rw_semaphore *sem)
+{
+	return 0;
+}
+#endif
+
 /*
  * get a write lock on the semaphore
- * - we increment the waiting count anyway to indicate an exclusive lock
+ * - a waiting writer takes the lock itself once it is released, so a
+ *   writer already running on a CPU may steal it ahead of queued ones
  */
 void __sched __down_write_nested(struct rw_semaphore *sem, int subclass)
 {
@@ -221,28 +272,35 @@ void __sched __down_write_nested(struct rw_semaphore *sem, int subclass)
 		goto out;
 	}
 
+	spin_unlock_irqrestore(&sem->wait_lock, flags);
+
+	if (rwsem_optimistic_spin(sem))
+		goto out;
+
 	tsk = current;
-	set_task_state(tsk, TASK_UNINTERRUPTIBLE);
 
 	/* set up my own style of waitqueue */
 	waiter.task = tsk;
 	waiter.flags = RWSEM_WAITING_FOR_WRITE;
-	get_task_struct(tsk);
 
+	spin_lock_irqsave(&sem->wait_lock, flags);
 	list_add_tail(&waiter.list, &sem->wait_list);
 
-	/* we don't need to touch the semaphore struct anymore */
-	spin_unlock_irqrestore(&sem->wait_lock, flags);
-
-	/* wait to be given the lock */
+	/* wait for someone to release the lock */
 	for (;;) {
-		if (!waiter.task)
+		if (sem->activity == 0)
 			break;
-		schedule();
 		set_task_state(tsk, TASK_UNINTERRUPTIBLE);
+		spin_unlock_irqrestore(&sem->wait_lock, flags);
+		schedule();
+		spin_lock_irqsave(&sem->wait_lock, flags);
 	}
 
-	tsk->state = TASK_RUNNING;
+	/* got the lock */
+	sem->activity = -1;
+	list_del(&waiter.list);
+
+	spin_unlock_irqrestore(&sem->wait_lock, flags);
  out:
 	;
 }
@@ -0,0 +1,389 @@
+/*
+ * linux/mm/cma.c
+ *
+ * Contiguous Memory Allocator
+ *
+ * Board code declares an area with cma_declare_contiguous() while memblock
+ * is still in charge.  Once the page allocator is up, its pageblocks are
+ * handed over as MIGRATE_CMA, which only movable allocations fall back to.
+ * cma_alloc() finds a free range in the area's bitmap and has
+ * alloc_contig_range() migrate whatever movable pages have been placed
+ * there, so the memory is only unavailable to the rest of the system
+ * while a buffer is actually allocated from it.
+ *
+ * The time cma_alloc() takes depends on how many pages it has to migrate;
+ * it is accounted per area and shown in debugfs under cma/<name>.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/mm.h>
+#include <linux/memblock.h>
+#include <linux/bitmap.h>
+#include <linux/mutex.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/module.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/cma.h>
+#include <asm/div64.h>
+
+struct cma {
+	unsigned long	base_pfn;
+	unsigned long	count;
+	unsigned long	*bitmap;
+	struct mutex	lock;		/* protects the bitmap and stats */
+	const char	*name;
+
+	/* statistics */
+	unsigned long	used;		/* pages currently allocated */
+	unsigned long	nr_allocs;
+	unsigned long	nr_fails;
+	unsigned long	nr_retries;	/* ranges that could not be freed */
+	unsigned long	nr_releases;
+	u64		alloc_ns;	/* total time spent in cma_alloc */
+	u64		alloc_ns_max;
+};
+
+static struct cma cma_areas[MAX_CMA_AREAS];
+static unsigned cma_area_count;
+
+/* serializes the pageblock type changes of alloc_contig_range() */
+static DEFINE_MUTEX(cma_mutex);
+
+phys_addr_t cma_get_base(struct cma *cma)
+{
+	return PFN_PHYS(cma->base_pfn);
+}
+EXPORT_SYMBOL_GPL(cma_get_base);
+
+unsigned long cma_get_size(struct cma *cma)
+{
+	return cma->count << PAGE_SHIFT;
+}
+EXPORT_SYMBOL_GPL(cma_get_size);
+
+/**
+ * cma_find() - look up a contiguous memory area by name
+ * @name: the name it was declared with
+ */
+struct cma *cma_find(const char *name)
+{
+	unsigned i;
+
+	for (i = 0; i < cma_area_count; i++)
+		if (!strcmp(cma_areas[i].name, name))
+			return &cma_areas[i];
+	return NULL;
+}
+EXPORT_SYMBOL_GPL(cma_find);
+
+static int __init cma_activate_area(struct cma *cma)
+{
+	int bitmap_size = BITS_TO_LONGS(cma->count) * sizeof(long);
+	unsigned long base_pfn = cma->base_pfn, pfn = base_pfn;
+	unsigned i = cma->count >> pageblock_order;
+	struct zone *zone;
+
+	cma->bitmap = kzalloc(bitmap_size, GFP_KERNEL);
+	if (!cma->bitmap)
+		return -ENOMEM;
+
+	WARN_ON_ONCE(!pfn_valid(pfn));
+	zone = page_zone(pfn_to_page(pfn));
+
+	do {
+		unsigned j;
+
+		base_pfn = pfn;
+		for (j = pageblock_nr_pages; j; --j, pfn++) {
+			WARN_ON_ONCE(!pfn_valid(pfn));
+			/*
+			 * alloc_contig_range requires the pfn range
+			 * specified to be in the same zone. Make this
+			 * simple by forcing the entire CMA resv range
+			 * to be in the same zone.
+			 */
+			if (page_zone(pfn_to_page(pfn)) != zone)
+				goto err;
+		}
+		init_cma_reserved_pageblock(pfn_to_page(base_pfn));
+	} while (--i);
+
+	mutex_init(&cma->lock);
+	return 0;
+
+err:
+	kfree(cma->bitmap);
+	cma->bitmap = NULL;
+	return -EINVAL;
+}
+
+static int __init cma_init_reserved_areas(void)
+{
+	unsigned i;
+
+	for (i = 0; i < cma_area_count; i++) {
+		int ret = cma_activate_area(&cma_areas[i]);
+
+		if (ret)
+			pr_err("CMA: area %s could not be activated: %d\n",
+			       cma_areas[i].name, ret);
+	}
+	return 0;
+}
+core_initcall(cma_init_reserved_areas);
+
+/**
+ * cma_declare_contiguous() - reserve custom contiguous area
+ * @base: Base address of the reserved area optional, use 0 for any
+ * @size: Size of the reserved area (in bytes),
+ * @limit: End address of the reserved memory (optional, 0 for any).
+ * @name: Name of the area, used to find it and for debugging.
+ * @res_cma: Pointer to store the created cma region.
+ *
+ * This function reserves memory from early allocator. It should be
+ * called by arch specific code once the early allocator (memblock) has
+ * been activated and all other subsystems have already allocated or
+ * reserved memory.  The area is aligned to the larger of a pageblock and
+ * MAX_ORDER_NR_PAGES so that its pageblocks can be isolated on their own.
+ */
+int __init cma_declare_contiguous(phys_addr_t base, phys_addr_t size,
+				  phys_addr_t limit, const char *name,
+				  struct cma **res_cma)
+{
+	struct cma *cma = &cma_areas[cma_area_count];
+	phys_addr_t alignment;
+
+	pr_debug("%s(size %lx, base %08lx, limit %08lx)\n", __func__,
+		 (unsigned long)size, (unsigned long)base,
+		 (unsigned long)limit);
+
+	if (cma_area_count == ARRAY_SIZE(cma_areas)) {
+		pr_err("CMA: not enough space for area %s\n", name);
+		return -ENOSPC;
+	}
+
+	if (!size)
+		return -EINVAL;
+
+	alignment = PAGE_SIZE << max(MAX_ORDER - 1, pageblock_order);
+	base = ALIGN(base, alignment);
+	size = ALIGN(size, alignment);
+	limit &= ~(alignment - 1);
+
+	/* Reserve memory */
+	if (base) {
+		if (memblock_is_region_reserved(base, size) ||
+		    memblock_reserve(base, size) < 0)
+			return -EBUSY;
+	} else {
+		/*
+		 * Use __memblock_alloc_base() since
+		 * memblock_alloc_base() panic()s.
+		 */
+		phys_addr_t addr = __memblock_alloc_base(size, alignment,
+				limit ? limit : MEMBLOCK_ALLOC_ACCESSIBLE);
+		if (!addr)
+			return -ENOMEM;
+		base = addr;
+	}
+
+	cma->base_pfn = PFN_DOWN(base);
+	cma->count = size >> PAGE_SHIFT;
+	cma->name = name;
+	*res_cma = cma;
+	cma_area_count++;
+
+	pr_info("CMA: reserved %ld MiB at %08lx for %s\n",
+		(unsigned long)size >> 20, (unsigned long)base, name);
+	return 0;
+}
+
+/**
+ * cma_alloc() - allocate pages from contiguous area
+ * @cma:   Contiguous memory region for which the allocation is performed.
+ * @count: Requested number of pages.
+ * @align: Requested alignment of pages (in PAGE_SIZE order).
+ *
+ * This function allocates part of contiguous memory on specific
+ * contiguous memory area.  It may sleep while the pages in the way are
+ * migrated.
+ */
+struct page *cma_alloc(struct cma *cma, unsigned long count,
+		       unsigned int align)
+{
+	unsigned long mask, pfn, pageno, start = 0;
+	struct page *page = NULL;
+	u64 t0, elapsed;
+	int ret;
+
+	if (!cma || !cma->count || !cma->bitmap)
+		return NULL;
+
+	pr_debug("%s(cma %p, count %lu, align %u)\n", __func__, (void *)cma,
+		 count, align);
+
+	if (!count)
+		return NULL;
+
+	mask = (1UL << align) - 1;
+	t0 = local_clock();
+
+	for (;;) {
+		mutex_lock(&cma->lock);
+		pageno = bitmap_find_next_zero_area(cma->bitmap, cma->count,
+						    start, count, mask);
+		if (pageno >= cma->count) {
+			mutex_unlock(&cma->lock);
+			break;
+		}
+		bitmap_set(cma->bitmap, pageno, count);
+		/*
+		 * It's safe to drop the lock here. We've marked this region
+		 * for our exclusive use. If the migration fails we will take
+		 * the lock again and unmark it.
+		 */
+		mutex_unlock(&cma->lock);
+
+		pfn = cma->base_pfn + pageno;
+		mutex_lock(&cma_mutex);
+		ret = alloc_contig_range(pfn, pfn + count, MIGRATE_CMA);
+		mutex_unlock(&cma_mutex);
+		if (ret == 0) {
+			page = pfn_to_page(pfn);
+			break;
+		}
+
+		mutex_lock(&cma->lock);
+		bitmap_clear(cma->bitmap, pageno, count);
+		cma->nr_retries++;
+		mutex_unlock(&cma->lock);
+		if (ret != -EBUSY)
+			break;
+
+		pr_debug("%s(): memory range at %p is busy, retrying\n",
+			 __func__, pfn_to_page(pfn));
+		/* try again with a bit different memory target */
+		start = pageno + mask + 1;
+	}
+
+	elapsed = local_clock() - t0;
+
+	mutex_lock(&cma->lock);
+	if (page) {
+		cma->nr_allocs++;
+		cma->used += count;
+	} else
+		cma->nr_fails++;
+	cma->alloc_ns += elapsed;
+	if (elapsed > cma->alloc_ns_max)
+		cma->alloc_ns_max = elapsed;
+	mutex_unlock(&cma->lock);
+
+	pr_debug("%s(): returned %p\n", __func__, page);
+	return page;
+}
+EXPORT_SYMBOL_GPL(cma_alloc);
+
+/**
+ * cma_release() - release allocated pages
+ * @cma:   Contiguous memory region for which the allocation is performed.
+ * @pages: Allocated pages.
+ * @count: Number of allocated pages.
+ *
+ * This function releases memory allocated by cma_alloc().
+ * It returns false when provided pages do not belong to contiguous area and
+ * true otherwise.
+ */
+bool cma_release(struct cma *cma, struct page *pages, unsigned long count)
+{
+	unsigned long pfn;
+
+	if (!cma || !pages)
+		return false;
+
+	pr_debug("%s(page %p)\n", __func__, (void *)pages);
+
+	pfn = page_to_pfn(pages);
+
+	if (pfn < cma->base_pfn || pfn >= cma->base_pfn + cma->count)
+		return false;
+
+	VM_BUG_ON(pfn + count > cma->base_pfn + cma->count);
+
+	free_contig_range(pfn, count);
+
+	mutex_lock(&cma->lock);
+	bitmap_clear(cma->bitmap, pfn - cma->base_pfn, count);
+	cma->nr_releases++;
+	cma->used -= count;
+	mutex_unlock(&cma->lock);
+
+	return true;
+}
+EXPORT_SYMBOL_GPL(cma_release);
+
+#ifdef CONFIG_DEBUG_FS
+static int cma_stats_show(struct seq_file *m, void *v)
+{
+	struct cma *cma = m->private;
+	u64 avg_us, max_us;
+
+	mutex_lock(&cma->lock);
+	avg_us = cma->alloc_ns;
+	if (cma->nr_allocs + cma->nr_fails)
+		do_div(avg_us, cma->nr_allocs + cma->nr_fails);
+	do_div(avg_us, NSEC_PER_USEC);
+	max_us = cma->alloc_ns_max;
+	do_div(max_us, NSEC_PER_USEC);
+
+	seq_printf(m, "base:          0x%llx\n",
+		   (unsigned long long)cma_get_base(cma));
+	seq_printf(m, "pages:         %lu\n", cma->count);
+	seq_printf(m, "used:          %lu\n", cma->used);
+	seq_printf(m, "allocs:        %lu\n", cma->nr_allocs);
+	seq_printf(m, "alloc_fails:   %lu\n", cma->nr_fails);
+	seq_printf(m, "busy_retries:  %lu\n", cma->nr_retries);
+	seq_printf(m, "releases:      %lu\n", cma->nr_releases);
+	seq_printf(m, "alloc_avg_us:  %llu\n", (unsigned long long)avg_us);
+	seq_printf(m, "alloc_max_us:  %llu\n", (unsigned long long)max_us);
+	mutex_unlock(&cma->lock);
+	return 0;
+}
+
+static int cma_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, cma_stats_show, inode->i_private);
+}
+
+static const struct file_operations cma_stats_fops = {
+	.open		= cma_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init cma_debugfs_init(void)
+{
+	struct dentry *root;
+	unsigned i;
+
+	if (!cma_area_count)
+		return 0;
+
+	root = debugfs_create_dir("cma", NULL);
+	if (!root)
+		return -ENOMEM;
+
+	for (i = 0; i < cma_area_count; i++)
+		if (cma_areas[i].bitmap)
+			debugfs_create_file(cma_areas[i].name, 0444, root,
+					    &cma_areas[i], &cma_stats_fops);
+	return 0;
+}
+late_initcall(cma_debugfs_init);
+#endif /* CONFIG_DEBUG_FS */
@@ -0,0 +1,164 @@
+/*
+ * Contiguous memory allocator test
+ *
+ * Fills memory with shmem page cache until the given share of a CMA
+ * area is occupied by movable pages, then allocates the whole area with
+ * cma_alloc() in chunks and reports how long the allocations took, how
+ * many of them failed and how much of the area had to be migrated:
+ *
+ *	insmod cma_test.ko area=large_surfaces fill=75 chunk=256
+ *
+ * The results are printed to the kernel log when the run completes and
+ * everything is freed again.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/types.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/err.h>
+#include <linux/fs.h>
+#include <linux/file.h>
+#include <linux/mm.h>
+#include <linux/vmstat.h>
+#include <linux/shmem_fs.h>
+#include <linux/pagemap.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/cma.h>
+#include <asm/div64.h>
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Contiguous memory allocator test");
+
+static char *area;		/* name of the area to test */
+static int fill = 50;		/* percentage of the area to occupy */
+static unsigned long chunk = 256;	/* pages per cma_alloc */
+static unsigned long reserve = 1024;	/* free pages never to be filled */
+
+module_param(area, charp, 0444);
+MODULE_PARM_DESC(area, "Name of the CMA area to test");
+module_param(fill, int, 0444);
+MODULE_PARM_DESC(fill, "Percentage of the area filled with page cache");
+module_param(chunk, ulong, 0444);
+MODULE_PARM_DESC(chunk, "Number of pages allocated at once");
+module_param(reserve, ulong, 0444);
+MODULE_PARM_DESC(reserve, "Free pages left to the rest of the system");
+
+/* pages of the area that are on the LRU and would have to be migrated */
+static unsigned long cma_test_occupied(struct cma *cma)
+{
+	unsigned long pfn = PFN_DOWN(cma_get_base(cma));
+	unsigned long end = pfn + (cma_get_size(cma) >> PAGE_SHIFT);
+	unsigned long nr = 0;
+
+	for (; pfn < end; pfn++)
+		if (PageLRU(pfn_to_page(pfn)))
+			nr++;
+	return nr;
+}
+
+/*
+ * Movable allocations only fall back to MIGRATE_CMA pageblocks once the
+ * MIGRATE_MOVABLE ones are used up, so keep adding page cache until
+ * enough of the area is taken or memory is about to run out.
+ */
+static unsigned long cma_test_fill(struct cma *cma, struct file *file,
+				   unsigned long target)
+{
+	struct address_space *mapping = file->f_mapping;
+	unsigned long index = 0;
+	struct page *page;
+
+	while (!fatal_signal_pending(current)) {
+		if (!(index % 1024) && cma_test_occupied(cma) >= target)
+			break;
+		if (global_page_state(NR_FREE_PAGES) < reserve)
+			break;
+
+		page = shmem_read_mapping_page(mapping, index);
+		if (IS_ERR(page))
+			break;
+		set_page_dirty(page);
+		page_cache_release(page);
+		index++;
+		cond_resched();
+	}
+	return index;
+}
+
+static int __init cma_test_init(void)
+{
+	unsigned long count, occupied, filled, nr_chunks, i, ok = 0;
+	u64 t0, ns, total_ns = 0, max_ns = 0;
+	struct page **pages;
+	struct file *file;
+	struct cma *cma;
+
+	cma = area ? cma_find(area) : NULL;
+	if (!cma) {
+		printk(KERN_ERR "cma_test: no CMA area \"%s\"\n",
+		       area ? area : "");
+		return -ENODEV;
+	}
+	if (fill < 0 || fill > 100 || !chunk)
+		return -EINVAL;
+
+	count = cma_get_size(cma) >> PAGE_SHIFT;
+	nr_chunks = count / chunk;
+	if (!nr_chunks)
+		return -EINVAL;
+
+	pages = kcalloc(nr_chunks, sizeof(*pages), GFP_KERNEL);
+	if (!pages)
+		return -ENOMEM;
+
+	file = shmem_file_setup("cma_test", MAX_LFS_FILESIZE, VM_NORESERVE);
+	if (IS_ERR(file)) {
+		kfree(pages);
+		return PTR_ERR(file);
+	}
+
+	filled = cma_test_fill(cma, file, count * fill / 100);
+	occupied = cma_test_occupied(cma);
+
+	for (i = 0; i < nr_chunks; i++) {
+		t0 = local_clock();
+		pages[i] = cma_alloc(cma, chunk, 0);
+		ns = local_clock() - t0;
+
+		total_ns += ns;
+		if (ns > max_ns)
+			max_ns = ns;
+		if (pages[i])
+			ok++;
+	}
+
+	for (i = 0; i < nr_chunks; i++)
+		if (pages[i])
+			cma_release(cma, pages[i], chunk);
+
+	do_div(total_ns, nr_chunks * NSEC_PER_USEC);
+	do_div(max_ns, NSEC_PER_USEC);
+	printk(KERN_INFO "cma_test: %s: %lu pages, %lu of them occupied "
+	       "after adding %lu pages of page cache\n", area, count,
+	       occupied, filled);
+	printk(KERN_INFO "cma_test: %lu of %lu allocations of %lu pages, "
+	       "avg %llu us, max %llu us\n", ok, nr_chunks, chunk,
+	       (unsigned long long)total_ns, (unsigned long long)max_ns);
+
+	fput(file);
+	kfree(pages);
+	return 0;
+}
+
+static void __exit cma_test_exit(void)
+{
+}
+
+module_init(cma_test_init);
+module_exit(cma_test_exit);
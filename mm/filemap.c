@@ -108,14 +108,72 @@
  *  (code doesn't rely on that order, so you could switch it around)
  *  ->tasklist_lock             (memory_failure, collect_procs_ao)
  *    ->i_mmap_mutex
+ *
+ *  ->tree_lock
+ *    ->shadow_lock		(workingset_shadow_add/del)
+ */
+
+static void page_cache_tree_delete(struct address_space *mapping,
+				   struct page *page, void *shadow)
+{
+	if (shadow) {
+		void **slot;
+		int tag;
+
+		/*
+		 * Leave the shadow entry in the slot of the page, but
+		 * without any of its tags: lookups by tag only ever
+		 * want to see pages.
+		 */
+		slot = radix_tree_lookup_slot(&mapping->page_tree, page->index);
+		radix_tree_replace_slot(slot, shadow);
+		for (tag = 0; tag < RADIX_TREE_MAX_TAGS; tag++)
+			radix_tree_tag_clear(&mapping->page_tree, page->index,
+					     tag);
+		workingset_shadow_add(mapping);
+	} else
+		radix_tree_delete(&mapping->page_tree, page->index);
+}
+
+/**
+ * page_cache_tree_insert - insert a page into the page cache radix tree
+ * @mapping: the page's address_space, its tree_lock must be held
+ * @page: page to insert at @page->index
+ * @shadowp: if not NULL, returns the shadow entry that was replaced
+ *
+ * A shadow entry left by an evicted page is replaced, any other entry
+ * makes this fail with -EEXIST.
  */
+int page_cache_tree_insert(struct address_space *mapping,
+			   struct page *page, void **shadowp)
+{
+	void **slot;
+	void *p;
+
+	slot = radix_tree_lookup_slot(&mapping->page_tree, page->index);
+	if (slot) {
+		p = radix_tree_deref_slot_protected(slot, &mapping->tree_lock);
+		if (p) {
+			if (!radix_tree_exceptional_entry(p))
+				return -EEXIST;
+			radix_tree_replace_slot(slot, page);
+			workingset_shadow_del(mapping);
+			if (shadowp)
+				*shadowp = p;
+			return 0;
+		}
+	}
+	return radix_tree_insert(&mapping->page_tree, page->index, page);
+}
+EXPORT_SYMBOL_GPL(page_cache_tree_insert);
 
 /*
  * Delete a page from the page cache and free it. Caller has to make
  * sure the page is locked and that nobody else uses it - or that usage
- * is safe.  The caller must hold the mapping's tree_lock.
+ * is safe.  The caller must hold the mapping's tree_lock.  A non-NULL
+ * @shadow, see workingset_eviction(), is left in the page's slot.
  */
-void __delete_from_page_cache(struct page *page)
+void __delete_from_page_cache(struct page *page, void *shadow)
 {
 	struct address_space *mapping = page->mapping;
 
@@ -129,7 +187,7 @@ void __delete_from_page_cache(struct page *page)
 	else
 		cleancache_flush_page(mapping, page);
 
-	radix_tree_delete(&mapping->page_tree, page->index);
+	page_cache_tree_delete(mapping, page, shadow);
 	page->mapping = NULL;
 	mapping->nrpages--;
 	__dec_zone_page_state(page, NR_FILE_PAGES);
@@ -167,7 +225,7 @@ void delete_from_page_cache(struct page *page)
 
 	freepage = mapping->a_ops->freepage;
 	spin_lock_irq(&mapping->tree_lock);
-	__delete_from_page_cache(page);
+	__delete_from_page_cache(page, NULL);
 	spin_unlock_irq(&mapping->tree_lock);
 	mem_cgroup_uncharge_cache_page(page);
 
@@ -427,7 +485,7 @@ int replace_page_cache_page(struct page *old, struct page *new, gfp_t gfp_mask)
 		new->index = offset;
 
 		spin_lock_irq(&mapping->tree_lock);
-		__delete_from_page_cache(old);
+		__delete_from_page_cache(old, NULL);
 		error = radix_tree_insert(&mapping->page_tree, offset, new);
 		BUG_ON(error);
 		mapping->nrpages++;
@@ -448,18 +506,10 @@ int replace_page_cache_page(struct page *old, struct page *new, gfp_t gfp_mask)
 }
 EXPORT_SYMBOL_GPL(replace_page_cache_page);
 
-/**
- * add_to_page_cache_locked - add a locked page to the pagecache
- * @page:	page to add
- * @mapping:	the page's address_space
- * @offset:	page index
- * @gfp_mask:	page allocation mode
- *
- * This function is used to add a page to the pagecache. It must be locked.
- * This function does not add the page to the LRU.  The caller must do that.
- */
-int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
-		pgoff_t offset, gfp_t gfp_mask)
+static int __add_to_page_cache_locked(struct page *page,
+				     struct address_space *mapping,
+				     pgoff_t offset, gfp_t gfp_mask,
+				     void **shadowp)
 {
 	int error;
 
@@ -477,7 +527,7 @@ int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
 		page->index = offset;
 
 		spin_lock_irq(&mapping->tree_lock);
-		error = radix_tree_insert(&mapping->page_tree, offset, page);
+		error = page_cache_tree_insert(mapping, page, shadowp);
 		if (likely(!error)) {
 			mapping->nrpages++;
 			__inc_zone_page_state(page, NR_FILE_PAGES);
@@ -496,11 +546,29 @@ int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
 out:
 	return error;
 }
+
+/**
+ * add_to_page_cache_locked - add a locked page to the pagecache
+ * @page:	page to add
+ * @mapping:	the page's address_space
+ * @offset:	page index
+ * @gfp_mask:	page allocation mode
+ *
+ * This function is used to add a page to the pagecache. It must be locked.
+ * This function does not add the page to the LRU.  The caller must do that.
+ */
+int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
+		pgoff_t offset, gfp_t gfp_mask)
+{
+	return __add_to_page_cache_locked(page, mapping, offset,
+					  gfp_mask, NULL);
+}
 EXPORT_SYMBOL(add_to_page_cache_locked);
 
 int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 				pgoff_t offset, gfp_t gfp_mask)
 {
+	void *shadow = NULL;
 	int ret;
 
 	/*
@@ -512,14 +580,28 @@ int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 	if (mapping_cap_swap_backed(mapping))
 		SetPageSwapBacked(page);
 
-	ret = add_to_page_cache(page, mapping, offset, gfp_mask);
-	if (ret == 0) {
-		if (page_is_file_cache(page))
-			lru_cache_add_file(page);
-		else
-			lru_cache_add_anon(page);
+	__set_page_locked(page);
+	ret = __add_to_page_cache_locked(page, mapping, offset,
+					 gfp_mask, &shadow);
+	if (unlikely(ret)) {
+		__clear_page_locked(page);
+		return ret;
 	}
-	return ret;
+
+	if (page_is_file_cache(page)) {
+		/*
+		 * A page that was evicted recently enough to have been
+		 * kept in memory, had the active list given up the space,
+		 * is part of the workingset: start it off on the active list.
+		 */
+		if (shadow && workingset_refault(shadow)) {
+			workingset_activation(page);
+			lru_cache_add_lru(page, LRU_ACTIVE_FILE);
+		} else
+			lru_cache_add_file(page);
+	} else
+		lru_cache_add_anon(page);
+	return 0;
 }
 EXPORT_SYMBOL_GPL(add_to_page_cache_lru);
 
@@ -584,6 +666,38 @@ int wait_on_page_bit_killable(struct page *page, int bit_nr)
 			     sleep_on_page_killable, TASK_KILLABLE);
 }
 
+/**
+ * wait_on_page_locked_async - queue an aio waiter for a page to be unlocked
+ * @page: the page
+ * @wait: the wait queue entry of the kiocb, see kiocb_page_wait()
+ *
+ * Returns 0 if @page is not locked, or -EIOCBRETRY once @wait is queued on
+ * it.  In that case the unlock_page() calls the wake function of @wait,
+ * which kicks the kiocb to be retried, and the caller has to let go.
+ */
+int wait_on_page_locked_async(struct page *page, struct wait_bit_queue *wait)
+{
+	wait_queue_head_t *q = page_waitqueue(page);
+	unsigned long flags;
+	int ret = -EIOCBRETRY;
+
+	wait->key.flags = &page->flags;
+	wait->key.bit_nr = PG_locked;
+
+	spin_lock_irqsave(&q->lock, flags);
+	__add_wait_queue_tail(q, &wait->wait);
+	/* pairs with the barrier between clearing the bit and the wakeup */
+	smp_mb();
+	if (!PageLocked(page)) {
+		list_del_init(&wait->wait.task_list);
+		ret = 0;
+	}
+	spin_unlock_irqrestore(&q->lock, flags);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(wait_on_page_locked_async);
+
 /**
  * add_page_wait_queue - Add an arbitrary waiter to a page's wait queue
  * @page: Page defining the wait queue of interest
@@ -694,6 +808,66 @@ int __lock_page_or_retry(struct page *page, struct mm_struct *mm,
 	}
 }
 
+/**
+ * page_cache_next_hole - find the next hole (not-present entry)
+ * @mapping: mapping
+ * @index: index
+ * @max_scan: maximum range to search
+ *
+ * Like radix_tree_next_hole() on the page cache of @mapping, except that
+ * the shadow entries of evicted pages count as holes as well.  Must be
+ * called under rcu_read_lock().
+ */
+pgoff_t page_cache_next_hole(struct address_space *mapping,
+			     pgoff_t index, unsigned long max_scan)
+{
+	unsigned long i;
+
+	for (i = 0; i < max_scan; i++) {
+		struct page *page;
+
+		page = radix_tree_lookup(&mapping->page_tree, index);
+		if (!page || radix_tree_exceptional_entry(page))
+			break;
+		index++;
+		if (index == 0)
+			break;
+	}
+
+	return index;
+}
+EXPORT_SYMBOL(page_cache_next_hole);
+
+/**
+ * page_cache_prev_hole - find the prev hole (not-present entry)
+ * @mapping: mapping
+ * @index: index
+ * @max_scan: maximum range to search
+ *
+ * Like radix_tree_prev_hole() on the page cache of @mapping, except that
+ * the shadow entries of evicted pages count as holes as well.  Must be
+ * called under rcu_read_lock().
+ */
+pgoff_t page_cache_prev_hole(struct address_space *mapping,
+			     pgoff_t index, unsigned long max_scan)
+{
+	unsigned long i;
+
+	for (i = 0; i < max_scan; i++) {
+		struct page *page;
+
+		page = radix_tree_lookup(&mapping->page_tree, index);
+		if (!page || radix_tree_exceptional_entry(page))
+			break;
+		index--;
+		if (index == ULONG_MAX)
+			break;
+	}
+
+	return index;
+}
+EXPORT_SYMBOL(page_cache_prev_hole);
+
 /**
  * find_get_page - find and get a page reference
  * @mapping: the address_space to search
@@ -715,8 +889,13 @@ repeat:
 		page = radix_tree_deref_slot(pagep);
 		if (unlikely(!page))
 			goto out;
-		if (radix_tree_deref_retry(page))
-			goto repeat;
+		if (radix_tree_exception(page)) {
+			if (radix_tree_deref_retry(page))
+				goto repeat;
+			/* the shadow entry of an evicted page */
+			page = NULL;
+			goto out;
+		}
 
 		if (!page_cache_get_speculative(page))
 			goto repeat;
@@ -815,6 +994,9 @@ repeat:
 }
 EXPORT_SYMBOL(find_or_create_page);
 
+/* slots looked up at a time by find_get_pages() */
+#define FIND_GET_PAGES_BATCH	16
+
 /**
  * find_get_pages - gang pagecache lookup
  * @mapping:	The address_space to search
@@ -827,57 +1009,71 @@ EXPORT_SYMBOL(find_or_create_page);
  * find_get_pages() takes a reference against the returned pages.
  *
  * The search returns a group of mapping-contiguous pages with ascending
- * indexes.  There may be holes in the indices due to not-present pages.
+ * indexes.  There may be holes in the indices due to not-present pages,
+ * shadow entries of evicted pages are skipped over like holes.
  *
  * find_get_pages() returns the number of pages which were found.
  */
 unsigned find_get_pages(struct address_space *mapping, pgoff_t start,
 			    unsigned int nr_pages, struct page **pages)
 {
+	void **slots[FIND_GET_PAGES_BATCH];
+	unsigned long indices[FIND_GET_PAGES_BATCH];
 	unsigned int i;
-	unsigned int ret;
-	unsigned int nr_found;
+	unsigned int ret = 0;
+	unsigned int nr, nr_found;
 
 	rcu_read_lock();
+	while (ret < nr_pages) {
+		nr = min_t(unsigned int, nr_pages - ret, FIND_GET_PAGES_BATCH);
 restart:
-	nr_found = radix_tree_gang_lookup_slot(&mapping->page_tree,
-				(void ***)pages, start, nr_pages);
-	ret = 0;
-	for (i = 0; i < nr_found; i++) {
-		struct page *page;
+		nr_found = radix_tree_gang_lookup_slot(&mapping->page_tree,
+					slots, indices, start, nr);
+		for (i = 0; i < nr_found; i++) {
+			struct page *page;
 repeat:
-		page = radix_tree_deref_slot((void **)pages[i]);
-		if (unlikely(!page))
-			continue;
+			page = radix_tree_deref_slot(slots[i]);
+			if (unlikely(!page))
+				continue;
 
-		/*
-		 * This can only trigger when the entry at index 0 moves out
-		 * of or back to the root: none yet gotten, safe to restart.
-		 */
-		if (radix_tree_deref_retry(page)) {
-			WARN_ON(start | i);
-			goto restart;
-		}
+			if (radix_tree_exception(page)) {
+				/*
+				 * This can only trigger when the entry at
+				 * index 0 moves out of or back to the root:
+				 * none yet gotten, safe to restart.
+				 */
+				if (radix_tree_deref_retry(page)) {
+					WARN_ON(start | i);
+					goto restart;
+				}
+				/* a shadow entry, nothing to return */
+				continue;
+			}
 
-		if (!page_cache_get_speculative(page))
-			goto repeat;
+			if (!page_cache_get_speculative(page))
+				goto repeat;
 
-		/* Has the page moved? */
-		if (unlikely(page != *((void **)pages[i]))) {
-			page_cache_release(page);
-			goto repeat;
+			/* Has the page moved? */
+			if (unlikely(page != *slots[i])) {
+				page_cache_release(page);
+				goto repeat;
+			}
+
+			pages[ret] = page;
+			ret++;
 		}
 
-		pages[ret] = page;
-		ret++;
+		/*
+		 * Entries that were removed before we could secure them
+		 * and shadow entries don't count, keep looking behind them
+		 * because callers stop trying once 0 is returned.
+		 */
+		if (nr_found < nr)
+			break;
+		start = indices[nr_found - 1] + 1;
+		if (!start)
+			break;
 	}
-
-	/*
-	 * If all entries were removed before we could secure them,
-	 * try again, because callers stop trying once 0 is returned.
-	 */
-	if (unlikely(!ret && nr_found))
-		goto restart;
 	rcu_read_unlock();
 	return ret;
 }
@@ -904,7 +1100,7 @@ unsigned find_get_pages_contig(struct address_space *mapping, pgoff_t index,
 	rcu_read_lock();
 restart:
 	nr_found = radix_tree_gang_lookup_slot(&mapping->page_tree,
-				(void ***)pages, index, nr_pages);
+				(void ***)pages, NULL, index, nr_pages);
 	ret = 0;
 	for (i = 0; i < nr_found; i++) {
 		struct page *page;
@@ -913,12 +1109,17 @@ repeat:
 		if (unlikely(!page))
 			continue;
 
-		/*
-		 * This can only trigger when the entry at index 0 moves out
-		 * of or back to the root: none yet gotten, safe to restart.
-		 */
-		if (radix_tree_deref_retry(page))
-			goto restart;
+		if (radix_tree_exception(page)) {
+			/*
+			 * This can only trigger when the entry at index 0
+			 * moves out of or back to the root: none yet gotten,
+			 * safe to restart.
+			 */
+			if (radix_tree_deref_retry(page))
+				goto restart;
+			/* a shadow entry is a hole in the range */
+			break;
+		}
 
 		if (!page_cache_get_speculative(page))
 			goto repeat;
@@ -1073,15 +1274,21 @@ static void shrink_readahead_size_eio(struct file *filp,
  * @ppos:	current file position
  * @desc:	read_descriptor
  * @actor:	read method
+ * @wait:	wait queue entry of an aio read, or NULL
  *
  * This is a generic file read routine, and uses the
  * mapping->a_ops->readpage() function for the actual low-level stuff.
  *
+ * With @wait, the read doesn't sleep on pages that are being read in:
+ * it queues @wait on the page and stops with desc->error = -EIOCBRETRY,
+ * the wakeup retries the kiocb from where it stopped.
+ *
  * This is really ugly. But the goto's actually try to clarify some
  * of the logic when it comes to error handling etc.
  */
 static void do_generic_file_read(struct file *filp, loff_t *ppos,
-		read_descriptor_t *desc, read_actor_t actor)
+		read_descriptor_t *desc, read_actor_t actor,
+		struct wait_bit_queue *wait)
 {
 	struct address_space *mapping = filp->f_mapping;
 	struct inode *inode = mapping->host;
@@ -1201,9 +1408,17 @@ page_ok:
 
 page_not_up_to_date:
 		/* Get exclusive access to the page ... */
-		error = lock_page_killable(page);
-		if (unlikely(error))
-			goto readpage_error;
+		if (wait) {
+			while (!trylock_page(page)) {
+				error = wait_on_page_locked_async(page, wait);
+				if (error)
+					goto readpage_error;
+			}
+		} else {
+			error = lock_page_killable(page);
+			if (unlikely(error))
+				goto readpage_error;
+		}
 
 page_not_up_to_date_locked:
 		/* Did it get truncated before we got the lock? */
@@ -1219,6 +1434,19 @@ page_not_up_to_date_locked:
 			goto page_ok;
 		}
 
+		/*
+		 * An aio read retried after waiting for the read of this
+		 * very page failed, where a sync read would have found out
+		 * below.
+		 */
+		if (wait && wait->key.flags == &page->flags &&
+		    PageError(page)) {
+			unlock_page(page);
+			shrink_readahead_size_eio(filp, ra);
+			error = -EIO;
+			goto readpage_error;
+		}
+
 readpage:
 		/*
 		 * A previous I/O error may have been due to temporary
@@ -1238,6 +1466,11 @@ readpage:
 		}
 
 		if (!PageUptodate(page)) {
+			if (wait) {
+				error = wait_on_page_locked_async(page, wait);
+				if (error)
+					goto readpage_error;
+			}
 			error = lock_page_killable(page);
 			if (unlikely(error))
 				goto readpage_error;
@@ -1464,8 +1697,18 @@ generic_file_aio_read(struct kiocb *iocb, const struct iovec *iov,
 		if (desc.count == 0)
 			continue;
 		desc.error = 0;
-		do_generic_file_read(filp, ppos, &desc, file_read_actor);
+		do_generic_file_read(filp, ppos, &desc, file_read_actor,
+				     kiocb_page_wait(iocb));
 		retval += desc.written;
+		if (desc.error == -EIOCBRETRY) {
+			/*
+			 * The kiocb is queued on a page now and must not be
+			 * completed before it is kicked: the retry goes on
+			 * from *ppos, whatever was copied already.
+			 */
+			retval = -EIOCBRETRY;
+			break;
+		}
 		if (desc.error) {
 			retval = retval ?: desc.error;
 			break;
@@ -115,11 +115,13 @@ struct ksm_scan {
  * @node: rb node of this ksm page in the stable tree
  * @hlist: hlist head of rmap_items using this ksm page
  * @kpfn: page frame number of this ksm page
+ * @checksum: checksum of the ksm page, the primary key of the stable tree
  */
 struct stable_node {
 	struct rb_node node;
 	struct hlist_head hlist;
 	unsigned long kpfn;
+	u32 checksum;
 };
 
 /**
@@ -129,6 +131,8 @@ struct stable_node {
  * @mm: the memory structure this rmap_item is pointing into
  * @address: the virtual address this rmap_item tracks (+ flags in low bits)
  * @oldchecksum: previous checksum of the page at that virtual address
+ * @age: number of scans in a row the page stayed unique and unchanged
+ * @remaining_skips: number of scans still to skip the page for
  * @node: rb node of this rmap_item in the unstable tree
  * @head: pointer to stable_node heading this list in the stable tree
  * @hlist: link into hlist of rmap_items hanging off that stable_node
@@ -139,6 +143,8 @@ struct rmap_item {
 	struct mm_struct *mm;
 	unsigned long address;		/* + low bits used for flags below */
 	unsigned int oldchecksum;	/* when unstable */
+	unsigned char age;
+	unsigned char remaining_skips;
 	union {
 		struct rb_node node;	/* when node of unstable tree */
 		struct {		/* when listed from stable tree */
@@ -189,6 +195,26 @@ static unsigned int ksm_thread_pages_to_scan = 100;
 /* Milliseconds ksmd should sleep between batches */
 static unsigned int ksm_thread_sleep_millisecs = 20;
 
+/* The number of pages scanned, and of those skipped as long unique */
+static unsigned long ksm_pages_scanned;
+static unsigned long ksm_pages_skipped;
+
+/* The number of times a page joined a ksm page, i.e. was saved */
+static unsigned long ksm_pages_merged;
+
+/*
+ * With ksm_auto_scan set, pages_to_scan follows the merge yield of the
+ * last full scan, in pages merged per thousand scanned: it is doubled
+ * while the yield meets ksm_merge_yield_target and halved when the yield
+ * falls below half of it, within pages_to_scan_min and pages_to_scan_max.
+ */
+static bool ksm_auto_scan;
+static unsigned int ksm_pages_to_scan_min = 20;
+static unsigned int ksm_pages_to_scan_max = 2000;
+static unsigned int ksm_merge_yield_target = 10;
+static unsigned int ksm_merge_yield;
+static unsigned long ksm_scan_start_scanned, ksm_scan_start_merged;
+
 #define KSM_RUN_STOP	0
 #define KSM_RUN_MERGE	1
 #define KSM_RUN_UNMERGE	2
@@ -983,7 +1009,7 @@ static struct page *try_to_merge_two_pages(struct rmap_item *rmap_item,
  * This function returns the stable tree node of identical content if found,
  * NULL otherwise.
  */
-static struct page *stable_tree_search(struct page *page)
+static struct page *stable_tree_search(struct page *page, u32 checksum)
 {
 	struct rb_node *node = root_stable_tree.rb_node;
 	struct stable_node *stable_node;
@@ -1000,6 +1026,16 @@ static struct page *stable_tree_search(struct page *page)
 
 		cond_resched();
 		stable_node = rb_entry(node, struct stable_node, node);
+
+		/* only pages with the same checksum need to be compared */
+		if (checksum < stable_node->checksum) {
+			node = node->rb_left;
+			continue;
+		} else if (checksum > stable_node->checksum) {
+			node = node->rb_right;
+			continue;
+		}
+
 		tree_page = get_ksm_page(stable_node);
 		if (!tree_page)
 			return NULL;
@@ -1031,6 +1067,10 @@ static struct stable_node *stable_tree_insert(struct page *kpage)
 	struct rb_node **new = &root_stable_tree.rb_node;
 	struct rb_node *parent = NULL;
 	struct stable_node *stable_node;
+	u32 checksum;
+
+	/* kpage is write-protected now, its checksum cannot change anymore */
+	checksum = calc_checksum(kpage);
 
 	while (*new) {
 		struct page *tree_page;
@@ -1038,6 +1078,16 @@ static struct stable_node *stable_tree_insert(struct page *kpage)
 
 		cond_resched();
 		stable_node = rb_entry(*new, struct stable_node, node);
+
+		parent = *new;
+		if (checksum < stable_node->checksum) {
+			new = &parent->rb_left;
+			continue;
+		} else if (checksum > stable_node->checksum) {
+			new = &parent->rb_right;
+			continue;
+		}
+
 		tree_page = get_ksm_page(stable_node);
 		if (!tree_page)
 			return NULL;
@@ -1045,7 +1095,6 @@ static struct stable_node *stable_tree_insert(struct page *kpage)
 		ret = memcmp_pages(kpage, tree_page);
 		put_page(tree_page);
 
-		parent = *new;
 		if (ret < 0)
 			new = &parent->rb_left;
 		else if (ret > 0)
@@ -1070,6 +1119,7 @@ static struct stable_node *stable_tree_insert(struct page *kpage)
 	INIT_HLIST_HEAD(&stable_node->hlist);
 
 	stable_node->kpfn = page_to_pfn(kpage);
+	stable_node->checksum = checksum;
 	set_page_stable_node(kpage, stable_node);
 
 	return stable_node;
@@ -1117,7 +1167,17 @@ struct rmap_item *unstable_tree_search_insert(struct rmap_item *rmap_item,
 			return NULL;
 		}
 
-		ret = memcmp_pages(page, tree_page);
+		/*
+		 * The checksums of both pages were the same in two scans in
+		 * a row, so they are ordered by those and only pages with
+		 * equal checksums are compared in full.
+		 */
+		if (rmap_item->oldchecksum < tree_rmap_item->oldchecksum)
+			ret = -1;
+		else if (rmap_item->oldchecksum > tree_rmap_item->oldchecksum)
+			ret = 1;
+		else
+			ret = memcmp_pages(page, tree_page);
 
 		parent = *new;
 		if (ret < 0) {
@@ -1151,14 +1211,32 @@ static void stable_tree_append(struct rmap_item *rmap_item,
 {
 	rmap_item->head = stable_node;
 	rmap_item->address |= STABLE_FLAG;
+	rmap_item->age = 0;
+	rmap_item->remaining_skips = 0;
 	hlist_add_head(&rmap_item->hlist, &stable_node->hlist);
 
-	if (rmap_item->hlist.next)
+	if (rmap_item->hlist.next) {
 		ksm_pages_sharing++;
-	else
+		ksm_pages_merged++;
+	} else
 		ksm_pages_shared++;
 }
 
+/*
+ * Pages that stay unique and unchanged scan after scan are unlikely to
+ * find a partner in the next one either: after KSM_SKIP_AGE such scans
+ * a page is skipped for 1, 2, 4 and then 8 scans each time.
+ */
+#define KSM_SKIP_AGE		3
+#define KSM_SKIP_MAX_SHIFT	3
+
+static unsigned char ksm_skip_scans(unsigned char age)
+{
+	if (age < KSM_SKIP_AGE)
+		return 0;
+	return 1 << min(age - KSM_SKIP_AGE, KSM_SKIP_MAX_SHIFT);
+}
+
 /*
  * cmp_and_merge_page - first see if page can be merged into the stable tree;
  * if not, compare checksum to previous and if it's the same, see if page can
@@ -1179,8 +1257,10 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 
 	remove_rmap_item_from_tree(rmap_item);
 
+	checksum = calc_checksum(page);
+
 	/* We first start with searching the page inside the stable tree */
-	kpage = stable_tree_search(page);
+	kpage = stable_tree_search(page, checksum);
 	if (kpage) {
 		err = try_to_merge_with_ksm_page(rmap_item, page, kpage);
 		if (!err) {
@@ -1202,15 +1282,20 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 	 * don't want to insert it in the unstable tree, and we don't want
 	 * to waste our time searching for something identical to it there.
 	 */
-	checksum = calc_checksum(page);
 	if (rmap_item->oldchecksum != checksum) {
 		rmap_item->oldchecksum = checksum;
+		rmap_item->age = 0;
 		return;
 	}
 
 	tree_rmap_item =
 		unstable_tree_search_insert(rmap_item, page, &tree_page);
-	if (tree_rmap_item) {
+	if (!tree_rmap_item && (rmap_item->address & UNSTABLE_FLAG)) {
+		/* unique for now: look at it less often the longer it is */
+		if (rmap_item->age < (unsigned char)~0)
+			rmap_item->age++;
+		rmap_item->remaining_skips = ksm_skip_scans(rmap_item->age);
+	} else if (tree_rmap_item) {
 		kpage = try_to_merge_two_pages(rmap_item, page,
 						tree_rmap_item, tree_page);
 		put_page(tree_page);
@@ -1272,6 +1357,34 @@ static struct rmap_item *get_next_rmap_item(struct mm_slot *mm_slot,
 	return rmap_item;
 }
 
+/*
+ * Called at the end of every full scan, to recompute the merge yield and,
+ * in auto_scan mode, to pick the scan rate for the next one.
+ */
+static void ksm_adapt_scan_rate(void)
+{
+	unsigned long scanned = ksm_pages_scanned - ksm_scan_start_scanned;
+	unsigned long merged = ksm_pages_merged - ksm_scan_start_merged;
+	unsigned int nr = ksm_thread_pages_to_scan;
+
+	ksm_scan_start_scanned = ksm_pages_scanned;
+	ksm_scan_start_merged = ksm_pages_merged;
+	if (!scanned)
+		return;
+
+	ksm_merge_yield = min_t(unsigned long, merged * 1000 / scanned, 1000);
+	if (!ksm_auto_scan)
+		return;
+
+	if (ksm_merge_yield >= ksm_merge_yield_target)
+		nr = nr > ksm_pages_to_scan_max / 2 ? ksm_pages_to_scan_max :
+						      nr * 2;
+	else if (ksm_merge_yield < ksm_merge_yield_target / 2)
+		nr = nr / 2;
+	ksm_thread_pages_to_scan = clamp(nr, ksm_pages_to_scan_min,
+					 ksm_pages_to_scan_max);
+}
+
 static struct rmap_item *scan_get_next_rmap_item(struct page **page)
 {
 	struct mm_struct *mm;
@@ -1400,6 +1513,7 @@ next_mm:
 		goto next_mm;
 
 	ksm_scan.seqnr++;
+	ksm_adapt_scan_rate();
 	return NULL;
 }
 
@@ -1417,7 +1531,14 @@ static void ksm_do_scan(unsigned int scan_npages)
 		rmap_item = scan_get_next_rmap_item(&page);
 		if (!rmap_item)
 			return;
-		if (!PageKsm(page) || !in_stable_tree(rmap_item))
+		ksm_pages_scanned++;
+		if (rmap_item->remaining_skips && !PageKsm(page) &&
+		    !in_stable_tree(rmap_item)) {
+			rmap_item->remaining_skips--;
+			ksm_pages_skipped++;
+			/* it must not stay in an unstable tree over scans */
+			remove_rmap_item_from_tree(rmap_item);
+		} else if (!PageKsm(page) || !in_stable_tree(rmap_item))
 			cmp_and_merge_page(page, rmap_item);
 		put_page(page);
 	}
@@ -1872,6 +1993,98 @@ static ssize_t pages_to_scan_store(struct kobject *kobj,
 }
 KSM_ATTR(pages_to_scan);
 
+static ssize_t auto_scan_show(struct kobject *kobj,
+			      struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_auto_scan);
+}
+
+static ssize_t auto_scan_store(struct kobject *kobj,
+			       struct kobj_attribute *attr,
+			       const char *buf, size_t count)
+{
+	int err;
+	unsigned long val;
+
+	err = strict_strtoul(buf, 10, &val);
+	if (err || val > 1)
+		return -EINVAL;
+
+	ksm_auto_scan = val;
+
+	return count;
+}
+KSM_ATTR(auto_scan);
+
+static ssize_t pages_to_scan_min_show(struct kobject *kobj,
+				      struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_pages_to_scan_min);
+}
+
+static ssize_t pages_to_scan_min_store(struct kobject *kobj,
+				       struct kobj_attribute *attr,
+				       const char *buf, size_t count)
+{
+	int err;
+	unsigned long nr_pages;
+
+	err = strict_strtoul(buf, 10, &nr_pages);
+	if (err || !nr_pages || nr_pages > ksm_pages_to_scan_max)
+		return -EINVAL;
+
+	ksm_pages_to_scan_min = nr_pages;
+
+	return count;
+}
+KSM_ATTR(pages_to_scan_min);
+
+static ssize_t pages_to_scan_max_show(struct kobject *kobj,
+				      struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_pages_to_scan_max);
+}
+
+static ssize_t pages_to_scan_max_store(struct kobject *kobj,
+				       struct kobj_attribute *attr,
+				       const char *buf, size_t count)
+{
+	int err;
+	unsigned long nr_pages;
+
+	err = strict_strtoul(buf, 10, &nr_pages);
+	if (err || nr_pages > UINT_MAX || nr_pages < ksm_pages_to_scan_min)
+		return -EINVAL;
+
+	ksm_pages_to_scan_max = nr_pages;
+
+	return count;
+}
+KSM_ATTR(pages_to_scan_max);
+
+static ssize_t merge_yield_target_show(struct kobject *kobj,
+				 struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_merge_yield_target);
+}
+
+static ssize_t merge_yield_target_store(struct kobject *kobj,
+				  struct kobj_attribute *attr,
+				  const char *buf, size_t count)
+{
+	int err;
+	unsigned long val;
+
+	err = strict_strtoul(buf, 10, &val);
+	if (err || val > 1000)
+		return -EINVAL;
+
+	ksm_merge_yield_target = val;
+
+	return count;
+}
+KSM_ATTR(merge_yield_target);
+
 static ssize_t run_show(struct kobject *kobj, struct kobj_attribute *attr,
 			char *buf)
 {
@@ -1966,15 +2179,43 @@ static ssize_t full_scans_show(struct kobject *kobj,
 }
 KSM_ATTR_RO(full_scans);
 
+static ssize_t pages_scanned_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_pages_scanned);
+}
+KSM_ATTR_RO(pages_scanned);
+
+static ssize_t pages_skipped_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_pages_skipped);
+}
+KSM_ATTR_RO(pages_skipped);
+
+static ssize_t merge_yield_show(struct kobject *kobj,
+			  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_merge_yield);
+}
+KSM_ATTR_RO(merge_yield);
+
 static struct attribute *ksm_attrs[] = {
 	&sleep_millisecs_attr.attr,
 	&pages_to_scan_attr.attr,
+	&auto_scan_attr.attr,
+	&pages_to_scan_min_attr.attr,
+	&pages_to_scan_max_attr.attr,
+	&merge_yield_target_attr.attr,
 	&run_attr.attr,
 	&pages_shared_attr.attr,
 	&pages_sharing_attr.attr,
 	&pages_unshared_attr.attr,
 	&pages_volatile_attr.attr,
 	&full_scans_attr.attr,
+	&pages_scanned_attr.attr,
+	&pages_skipped_attr.attr,
+	&merge_yield_attr.attr,
 	NULL,
 };
 
@@ -0,0 +1,330 @@
+/*
+ * Page allocator microbenchmark
+ *
+ * Starts one kernel thread per CPU (or nthreads of them) which allocate
+ * batches of pages of mixed orders, 0 up to max_order, and free them
+ * again.  With remote_free set every thread frees the batch allocated by
+ * its neighbour instead of its own, so pages move between the pcp-lists
+ * of different CPUs.  The average cost of an allocation and a free is
+ * reported per order, together with how many allocations the per-cpu
+ * page lists served without taking zone->lock:
+ *
+ *	insmod page_alloc_bench.ko duration=10 max_order=3 remote_free=1
+ *
+ * The results are printed to the kernel log when the run completes.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/types.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/kthread.h>
+#include <linux/err.h>
+#include <linux/gfp.h>
+#include <linux/mm.h>
+#include <linux/vmstat.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/cpu.h>
+#include <linux/completion.h>
+#include <linux/jiffies.h>
+#include <asm/atomic.h>
+#include <asm/div64.h>
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Page allocator microbenchmark");
+
+#define BENCH_MAX_ORDER		(NR_PCP_ORDERS - 1)
+
+static int nthreads;		/* # threads, defaults to one per online cpu */
+static int duration = 5;	/* Length of the run, in seconds */
+static int batch = 64;		/* allocations per round */
+static int max_order = BENCH_MAX_ORDER;	/* orders 0..max_order are mixed */
+static bool remote_free;	/* free the neighbour's batch */
+
+module_param(nthreads, int, 0444);
+MODULE_PARM_DESC(nthreads, "Number of threads (0 = one per cpu)");
+module_param(duration, int, 0444);
+MODULE_PARM_DESC(duration, "Duration of the run in seconds");
+module_param(batch, int, 0444);
+MODULE_PARM_DESC(batch, "Allocations done before freeing them again");
+module_param(max_order, int, 0444);
+MODULE_PARM_DESC(max_order, "Highest order allocated");
+module_param(remote_free, bool, 0444);
+MODULE_PARM_DESC(remote_free, "Free pages allocated on another cpu");
+
+struct bench_order {
+	unsigned long allocs;
+	unsigned long failures;
+	u64 alloc_ns;
+	u64 free_ns;
+};
+
+struct bench_thread {
+	struct task_struct *task;
+	int cpu;
+	struct page **pages;		/* current batch */
+	unsigned int *orders;		/* order of each page in the batch */
+	atomic_t full;			/* batch ready to be freed */
+	struct bench_order stat[BENCH_MAX_ORDER + 1];
+} ____cacheline_aligned_in_smp;
+
+static struct bench_thread *bench_threads;
+static int bench_nr;
+
+static atomic_t bench_ready;
+static atomic_t bench_running;
+static int bench_go;
+static unsigned long bench_end;
+static DECLARE_COMPLETION(bench_done);
+
+/* free a full batch of @owner, accounting the time to @bt */
+static void bench_free_batch(struct bench_thread *bt,
+			     struct bench_thread *owner)
+{
+	unsigned int order;
+	u64 t0;
+	int i;
+
+	for (i = 0; i < batch; i++) {
+		if (!owner->pages[i])
+			continue;
+		order = owner->orders[i];
+		t0 = local_clock();
+		__free_pages(owner->pages[i], order);
+		bt->stat[order].free_ns += local_clock() - t0;
+		owner->pages[i] = NULL;
+	}
+	smp_wmb();
+	atomic_set(&owner->full, 0);
+}
+
+static int bench_thread_fn(void *arg)
+{
+	struct bench_thread *bt = arg;
+	struct bench_thread *next;
+	unsigned long rounds = 0;
+	unsigned int seed = bt->cpu * 2654435761U + 1;
+	unsigned int order;
+	u64 t0;
+	int i;
+
+	next = &bench_threads[(bt - bench_threads + 1) % bench_nr];
+
+	/* wait until every thread is bound and ready to go */
+	atomic_inc(&bench_ready);
+	while (!ACCESS_ONCE(bench_go))
+		schedule_timeout_uninterruptible(1);
+	smp_rmb();
+
+	while (time_before(jiffies, bench_end)) {
+		/* wait for our previous batch to be freed by the neighbour */
+		while (atomic_read(&bt->full)) {
+			if (!time_before(jiffies, bench_end))
+				goto out;
+			if (atomic_read(&next->full)) {
+				smp_rmb();
+				bench_free_batch(bt, next);
+			}
+			cond_resched();
+		}
+
+		for (i = 0; i < batch; i++) {
+			seed = seed * 1103515245 + 12345;
+			order = (seed >> 16) % (max_order + 1);
+
+			t0 = local_clock();
+			bt->pages[i] = alloc_pages(GFP_KERNEL | __GFP_NOWARN,
+						   order);
+			bt->stat[order].alloc_ns += local_clock() - t0;
+			bt->orders[i] = order;
+			if (bt->pages[i])
+				bt->stat[order].allocs++;
+			else
+				bt->stat[order].failures++;
+		}
+		smp_wmb();
+		atomic_set(&bt->full, 1);
+
+		if (!remote_free) {
+			bench_free_batch(bt, bt);
+		} else if (atomic_read(&next->full)) {
+			smp_rmb();
+			bench_free_batch(bt, next);
+		}
+
+		if ((++rounds & 15) == 0)
+			cond_resched();
+	}
+out:
+	if (atomic_dec_and_test(&bench_running))
+		complete(&bench_done);
+
+	/* keep the task around until the results have been collected */
+	set_current_state(TASK_INTERRUPTIBLE);
+	while (!kthread_should_stop()) {
+		schedule();
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+
+	return 0;
+}
+
+static void bench_sum_pcp_events(unsigned long *hit, unsigned long *refill)
+{
+	unsigned long events[NR_VM_EVENT_ITEMS];
+	int order;
+
+	all_vm_events(events);
+	for (order = 0; order <= BENCH_MAX_ORDER; order++) {
+		hit[order] = events[PCP_HIT_ORDER0 + order];
+		refill[order] = events[PCP_REFILL_ORDER0 + order];
+	}
+}
+
+static void bench_report(unsigned long *hit, unsigned long *refill)
+{
+	int i, order;
+
+	for (order = 0; order <= max_order; order++) {
+		struct bench_order sum = { 0 };
+		u64 alloc_avg, free_avg;
+
+		for (i = 0; i < bench_nr; i++) {
+			struct bench_order *bo = &bench_threads[i].stat[order];
+
+			sum.allocs += bo->allocs;
+			sum.failures += bo->failures;
+			sum.alloc_ns += bo->alloc_ns;
+			sum.free_ns += bo->free_ns;
+		}
+
+		alloc_avg = sum.alloc_ns;
+		free_avg = sum.free_ns;
+		if (sum.allocs) {
+			do_div(alloc_avg, sum.allocs + sum.failures);
+			do_div(free_avg, sum.allocs);
+		}
+
+		printk(KERN_INFO "page_alloc_bench: order %d: %lu allocs, "
+		       "%lu failed, alloc %llu ns, free %llu ns, "
+		       "pcp hit %lu refill %lu\n", order, sum.allocs,
+		       sum.failures, (unsigned long long)alloc_avg,
+		       (unsigned long long)free_avg, hit[order],
+		       refill[order]);
+	}
+}
+
+static int __init page_alloc_bench_init(void)
+{
+	unsigned long hit[BENCH_MAX_ORDER + 1], refill[BENCH_MAX_ORDER + 1];
+	unsigned long hit1[BENCH_MAX_ORDER + 1], refill1[BENCH_MAX_ORDER + 1];
+	int i, n, cpu, order, ret = 0;
+
+	if (batch <= 0 || max_order < 0 || max_order > BENCH_MAX_ORDER)
+		return -EINVAL;
+
+	get_online_cpus();
+
+	n = nthreads > 0 ? nthreads : num_online_cpus();
+	bench_threads = kcalloc(n, sizeof(*bench_threads), GFP_KERNEL);
+	if (!bench_threads) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	bench_nr = n;
+
+	for (i = 0; i < n; i++) {
+		bench_threads[i].pages = kcalloc(batch, sizeof(struct page *),
+						 GFP_KERNEL);
+		bench_threads[i].orders = kcalloc(batch, sizeof(unsigned int),
+						  GFP_KERNEL);
+		if (!bench_threads[i].pages || !bench_threads[i].orders) {
+			ret = -ENOMEM;
+			goto out_free;
+		}
+	}
+
+	atomic_set(&bench_ready, 0);
+	atomic_set(&bench_running, n);
+
+	cpu = cpumask_first(cpu_online_mask);
+	for (i = 0; i < n; i++) {
+		struct bench_thread *bt = &bench_threads[i];
+
+		bt->cpu = cpu;
+		bt->task = kthread_create(bench_thread_fn, bt,
+					  "page_alloc_bench/%d", i);
+		if (IS_ERR(bt->task)) {
+			ret = PTR_ERR(bt->task);
+			bt->task = NULL;
+			break;
+		}
+		kthread_bind(bt->task, cpu);
+
+		cpu = cpumask_next(cpu, cpu_online_mask);
+		if (cpu >= nr_cpu_ids)
+			cpu = cpumask_first(cpu_online_mask);
+	}
+
+	if (ret) {
+		/* threads that were never woken never ran bench_thread_fn */
+		for (i = 0; i < n && bench_threads[i].task; i++)
+			kthread_stop(bench_threads[i].task);
+		goto out_free;
+	}
+
+	bench_sum_pcp_events(hit, refill);
+
+	for (i = 0; i < n; i++)
+		wake_up_process(bench_threads[i].task);
+	while (atomic_read(&bench_ready) < n)
+		schedule_timeout_uninterruptible(1);
+
+	bench_end = jiffies + duration * HZ;
+	smp_wmb();
+	bench_go = 1;
+
+	wait_for_completion(&bench_done);
+
+	for (i = 0; i < n; i++)
+		kthread_stop(bench_threads[i].task);
+
+	bench_sum_pcp_events(hit1, refill1);
+	for (order = 0; order <= BENCH_MAX_ORDER; order++) {
+		hit[order] = hit1[order] - hit[order];
+		refill[order] = refill1[order] - refill[order];
+	}
+
+	/* batches left over when the run ended */
+	for (i = 0; i < n; i++)
+		if (atomic_read(&bench_threads[i].full))
+			bench_free_batch(&bench_threads[i], &bench_threads[i]);
+
+	printk(KERN_INFO "page_alloc_bench: %d threads, %d s, batch %d, "
+	       "orders 0-%d, %s free\n", n, duration, batch, max_order,
+	       remote_free ? "remote" : "local");
+	bench_report(hit, refill);
+
+out_free:
+	for (i = 0; i < n; i++) {
+		kfree(bench_threads[i].pages);
+		kfree(bench_threads[i].orders);
+	}
+	kfree(bench_threads);
+out:
+	put_online_cpus();
+	return ret;
+}
+
+static void __exit page_alloc_bench_exit(void)
+{
+}
+
+module_init(page_alloc_bench_init);
+module_exit(page_alloc_bench_exit);
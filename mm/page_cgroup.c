@@ -28,20 +28,6 @@ void __meminit pgdat_page_cgroup_init(struct pglist_data *pgdat)
 	pgdat->node_page_cgroup = NULL;
 }
 
-struct page_cgroup *lookup_page_cgroup(struct page *page)
-{
-	unsigned long pfn = page_to_pfn(page);
-	unsigned long offset;
-	struct page_cgroup *base;
-
-	base = NODE_DATA(page_to_nid(page))->node_page_cgroup;
-	if (unlikely(!base))
-		return NULL;
-
-	offset = pfn - NODE_DATA(page_to_nid(page))->node_start_pfn;
-	return base + offset;
-}
-
 struct page *lookup_cgroup_page(struct page_cgroup *pc)
 {
 	unsigned long pfn;
@@ -107,16 +93,6 @@ fail:
 
 #else /* CONFIG_FLAT_NODE_MEM_MAP */
 
-struct page_cgroup *lookup_page_cgroup(struct page *page)
-{
-	unsigned long pfn = page_to_pfn(page);
-	struct mem_section *section = __pfn_to_section(pfn);
-
-	if (!section->page_cgroup)
-		return NULL;
-	return section->page_cgroup + pfn;
-}
-
 struct page *lookup_cgroup_page(struct page_cgroup *pc)
 {
 	struct mem_section *section;
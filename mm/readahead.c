@@ -18,6 +18,9 @@
 #include <linux/pagevec.h>
 #include <linux/pagemap.h>
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/readahead.h>
+
 /*
  * Initialise a struct file's readahead state.  Assumes that the caller has
  * memset *ra to zero.
@@ -177,7 +180,7 @@ __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 		rcu_read_lock();
 		page = radix_tree_lookup(&mapping->page_tree, page_offset);
 		rcu_read_unlock();
-		if (page)
+		if (page && !radix_tree_exceptional_entry(page))
 			continue;
 
 		page = page_cache_alloc_readahead(mapping);
@@ -195,9 +198,12 @@ __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 	 * uptodate then the caller will launch readpage again, and
 	 * will then handle the error.
 	 */
-	if (ret)
+	if (ret) {
 		read_pages(mapping, filp, &page_pool, ret);
+		count_vm_events(READAHEAD_PAGES, ret);
+	}
 	BUG_ON(!list_empty(&page_pool));
+	trace_mm_readahead(mapping, offset, nr_to_read, ret);
 out:
 	return ret;
 }
@@ -349,7 +355,7 @@ static pgoff_t count_history_pages(struct address_space *mapping,
 	pgoff_t head;
 
 	rcu_read_lock();
-	head = radix_tree_prev_hole(&mapping->page_tree, offset - 1, max);
+	head = page_cache_prev_hole(mapping, offset - 1, max);
 	rcu_read_unlock();
 
 	return offset - 1 - head;
@@ -389,6 +395,101 @@ static int try_context_readahead(struct address_space *mapping,
 	return 1;
 }
 
+/*
+ * Strided and backward reads.
+ *
+ * Misses that are neither sequential nor explained by the page cache
+ * history are remembered in ra->miss_index, and the distance between two
+ * of them in ra->stride.  Once the same stride has been seen
+ * RA_STRIDE_HITS times in a row, the next chunks of the pattern are read
+ * along with the current one:
+ *
+ *	|req|     |req|     |req|     |req|     |req|
+ *	^offset   ^+stride  ^+2*stride          ^miss_index, PG_readahead
+ *
+ * The first page of the last chunk gets PG_readahead, so the stream
+ * continues from page_cache_async_readahead() like a sequential one
+ * without missing again.  A negative stride that is no larger than the
+ * request is a backward read; for those one window below the current
+ * read is issued, its lowest page carrying the marker.
+ */
+#define RA_STRIDE_HITS		2
+#define RA_STRIDE_CHUNKS	16
+
+static bool ra_stride_active(struct file_ra_state *ra)
+{
+	return ra->stride && ra->stride_hits >= RA_STRIDE_HITS;
+}
+
+static bool ra_is_backward(struct file_ra_state *ra, unsigned long req_size)
+{
+	return ra->stride < 0 && -ra->stride <= (long)req_size;
+}
+
+static void ra_update_stride(struct file_ra_state *ra, pgoff_t offset)
+{
+	long delta = offset - ra->miss_index;
+
+	if (delta && delta == ra->stride) {
+		if (ra->stride_hits < UINT_MAX)
+			ra->stride_hits++;
+	} else {
+		ra->stride = delta;
+		ra->stride_hits = 0;
+	}
+	ra->miss_index = offset;
+}
+
+/*
+ * Read the window of up to @max pages that ends right below @offset and
+ * put the marker on its first page.
+ */
+static unsigned long
+backward_readahead(struct address_space *mapping, struct file_ra_state *ra,
+		   struct file *filp, pgoff_t offset, unsigned long max)
+{
+	unsigned long size = min_t(unsigned long, offset, max);
+
+	if (!size)
+		return 0;
+
+	ra->miss_index = offset - size;
+	count_vm_event(READAHEAD_BACKWARD);
+	return __do_page_cache_readahead(mapping, filp, offset - size,
+					 size, size);
+}
+
+/*
+ * Read the chunks of a strided stream from @offset on, @first chunks
+ * skipped because they are in the page cache already.
+ */
+static unsigned long
+stride_readahead(struct address_space *mapping, struct file_ra_state *ra,
+		 struct file *filp, pgoff_t offset, unsigned long req_size,
+		 unsigned long max, unsigned int first)
+{
+	unsigned int i, nr = clamp_t(unsigned long, max / req_size,
+				     first + 1, RA_STRIDE_CHUNKS);
+	unsigned long actual = 0;
+	pgoff_t index = offset;
+
+	count_vm_event(READAHEAD_STRIDE);
+	for (i = 0; i < nr; i++) {
+		if (i && (ra->stride < 0 && index < -ra->stride))
+			break;
+		if (i)
+			index += ra->stride;
+		if (i < first)
+			continue;
+
+		/* the last chunk carries the marker */
+		actual += __do_page_cache_readahead(mapping, filp, index,
+				req_size, i == nr - 1 ? req_size : 0);
+	}
+	ra->miss_index = index;
+	return actual;
+}
+
 /*
  * A minimal readahead algorithm for trivial sequential/random reads.
  */
@@ -399,12 +500,17 @@ ondemand_readahead(struct address_space *mapping,
 		   unsigned long req_size)
 {
 	unsigned long max = max_sane_readahead(ra->ra_pages);
+	int pattern;
+
+	count_vm_event(hit_readahead_marker ? READAHEAD_ASYNC : READAHEAD_SYNC);
 
 	/*
 	 * start of file
 	 */
-	if (!offset)
+	if (!offset) {
+		pattern = RA_PATTERN_INITIAL;
 		goto initial_readahead;
+	}
 
 	/*
 	 * It's the expected callback offset, assume sequential access.
@@ -415,9 +521,30 @@ ondemand_readahead(struct address_space *mapping,
 		ra->start += ra->size;
 		ra->size = get_next_ra_size(ra, max);
 		ra->async_size = ra->size;
+		pattern = RA_PATTERN_SEQUENTIAL;
 		goto readit;
 	}
 
+	/*
+	 * The marker left by a stride or backward readahead: carry on with
+	 * the next chunks of the pattern.
+	 */
+	if (hit_readahead_marker && ra_stride_active(ra) &&
+	    offset == ra->miss_index) {
+		if (ra_is_backward(ra, req_size)) {
+			pattern = RA_PATTERN_BACKWARD;
+			trace_mm_readahead_pattern(mapping, offset, req_size,
+						   true, pattern, ra);
+			return backward_readahead(mapping, ra, filp, offset,
+						  max);
+		}
+		pattern = RA_PATTERN_STRIDE;
+		trace_mm_readahead_pattern(mapping, offset, req_size, true,
+					   pattern, ra);
+		return stride_readahead(mapping, ra, filp, offset, req_size,
+					max, 1);
+	}
+
 	/*
 	 * Hit a marked page without valid readahead state.
 	 * E.g. interleaved reads.
@@ -428,7 +555,7 @@ ondemand_readahead(struct address_space *mapping,
 		pgoff_t start;
 
 		rcu_read_lock();
-		start = radix_tree_next_hole(&mapping->page_tree, offset+1,max);
+		start = page_cache_next_hole(mapping, offset+1, max);
 		rcu_read_unlock();
 
 		if (!start || start - offset > max)
@@ -439,32 +566,63 @@ ondemand_readahead(struct address_space *mapping,
 		ra->size += req_size;
 		ra->size = get_next_ra_size(ra, max);
 		ra->async_size = ra->size;
+		pattern = RA_PATTERN_MARKER;
 		goto readit;
 	}
 
 	/*
 	 * oversize read
 	 */
-	if (req_size > max)
+	if (req_size > max) {
+		pattern = RA_PATTERN_INITIAL;
 		goto initial_readahead;
+	}
 
 	/*
 	 * sequential cache miss
 	 */
-	if (offset - (ra->prev_pos >> PAGE_CACHE_SHIFT) <= 1UL)
+	if (offset - (ra->prev_pos >> PAGE_CACHE_SHIFT) <= 1UL) {
+		pattern = RA_PATTERN_SEQUENTIAL;
 		goto initial_readahead;
+	}
 
 	/*
 	 * Query the page cache and look for the traces(cached history pages)
 	 * that a sequential stream would leave behind.
 	 */
-	if (try_context_readahead(mapping, ra, offset, req_size, max))
+	if (try_context_readahead(mapping, ra, offset, req_size, max)) {
+		pattern = RA_PATTERN_CONTEXT;
 		goto readit;
+	}
+
+	/*
+	 * A strided or backward stream shows as a series of misses
+	 * at a constant distance from each other.
+	 */
+	ra_update_stride(ra, offset);
+	if (ra_stride_active(ra)) {
+		if (ra_is_backward(ra, req_size)) {
+			pattern = RA_PATTERN_BACKWARD;
+			trace_mm_readahead_pattern(mapping, offset, req_size,
+						   false, pattern, ra);
+			return __do_page_cache_readahead(mapping, filp, offset,
+							 req_size, 0) +
+			       backward_readahead(mapping, ra, filp, offset,
+						  max);
+		}
+		pattern = RA_PATTERN_STRIDE;
+		trace_mm_readahead_pattern(mapping, offset, req_size, false,
+					   pattern, ra);
+		return stride_readahead(mapping, ra, filp, offset, req_size,
+					max, 0);
+	}
 
 	/*
 	 * standalone, small random read
 	 * Read as is, and do not pollute the readahead state.
 	 */
+	trace_mm_readahead_pattern(mapping, offset, req_size, false,
+				   RA_PATTERN_RANDOM, ra);
 	return __do_page_cache_readahead(mapping, filp, offset, req_size, 0);
 
 initial_readahead:
@@ -483,6 +641,8 @@ readit:
 		ra->size += ra->async_size;
 	}
 
+	trace_mm_readahead_pattern(mapping, offset, req_size,
+				   hit_readahead_marker, pattern, ra);
 	return ra_submit(ra, mapping, filp);
 }
 
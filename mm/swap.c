@@ -206,15 +206,24 @@ static void pagevec_lru_move_fn(struct pagevec *pvec,
 	pagevec_reinit(pvec);
 }
 
+static void move_page_to_lru_tail(struct zone *zone, struct page *page)
+{
+	enum lru_list lru = page_lru_base_type(page);
+
+	if (lru_gen_rotate_page(zone, page))
+		return;
+
+	list_move_tail(&page->lru, &zone->lru[lru].list);
+	mem_cgroup_rotate_reclaimable_page(page);
+}
+
 static void pagevec_move_tail_fn(struct page *page, void *arg)
 {
 	int *pgmoved = arg;
 	struct zone *zone = page_zone(page);
 
 	if (PageLRU(page) && !PageActive(page) && !PageUnevictable(page)) {
-		enum lru_list lru = page_lru_base_type(page);
-		list_move_tail(&page->lru, &zone->lru[lru].list);
-		mem_cgroup_rotate_reclaimable_page(page);
+		move_page_to_lru_tail(zone, page);
 		(*pgmoved)++;
 	}
 }
@@ -341,6 +350,8 @@ void mark_page_accessed(struct page *page)
 			PageReferenced(page) && PageLRU(page)) {
 		activate_page(page);
 		ClearPageReferenced(page);
+		if (page_is_file_cache(page))
+			workingset_activation(page);
 	} else if (!PageReferenced(page)) {
 		SetPageReferenced(page);
 	}
@@ -457,8 +468,7 @@ static void lru_deactivate_fn(struct page *page, void *arg)
 		 * The page's writeback ends up during pagevec
 		 * We moves tha page into tail of inactive.
 		 */
-		list_move_tail(&page->lru, &zone->lru[lru].list);
-		mem_cgroup_rotate_reclaimable_page(page);
+		move_page_to_lru_tail(zone, page);
 		__count_vm_event(PGROTATED);
 	}
 
@@ -43,6 +43,9 @@
 #include <linux/sysctl.h>
 #include <linux/oom.h>
 #include <linux/prefetch.h>
+#include <linux/hugetlb.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include <asm/tlbflush.h>
 #include <asm/div64.h>
@@ -481,7 +484,8 @@ static pageout_t pageout(struct page *page, struct address_space *mapping,
  * Same as remove_mapping, but if the page is removed from the mapping, it
  * gets returned with a refcount of 0.
  */
-static int __remove_mapping(struct address_space *mapping, struct page *page)
+static int __remove_mapping(struct address_space *mapping, struct page *page,
+			    bool reclaimed)
 {
 	BUG_ON(!PageLocked(page));
 	BUG_ON(mapping != page_mapping(page));
@@ -527,10 +531,19 @@ static int __remove_mapping(struct address_space *mapping, struct page *page)
 		swapcache_free(swap, page);
 	} else {
 		void (*freepage)(struct page *);
+		void *shadow = NULL;
 
 		freepage = mapping->a_ops->freepage;
 
-		__delete_from_page_cache(page);
+		/*
+		 * Remember when a page is evicted by reclaim, so that a
+		 * refault can tell how long it was gone for.  Invalidation
+		 * through remove_mapping() is no eviction: the page was
+		 * dropped on purpose, not pushed out by memory pressure.
+		 */
+		if (reclaimed && page_is_file_cache(page))
+			shadow = workingset_eviction(mapping, page);
+		__delete_from_page_cache(page, shadow);
 		spin_unlock_irq(&mapping->tree_lock);
 		mem_cgroup_uncharge_cache_page(page);
 
@@ -553,7 +566,7 @@ cannot_free:
  */
 int remove_mapping(struct address_space *mapping, struct page *page)
 {
-	if (__remove_mapping(mapping, page)) {
+	if (__remove_mapping(mapping, page, false)) {
 		/*
 		 * Unfreezing the refcount with 1 rather than 2 effectively
 		 * drops the pagecache ref for us without requiring another
@@ -901,7 +914,7 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			}
 		}
 
-		if (!mapping || !__remove_mapping(mapping, page))
+		if (!mapping || !__remove_mapping(mapping, page, true))
 			goto keep_locked;
 
 		/*
@@ -1656,6 +1669,10 @@ static int inactive_anon_is_low(struct zone *zone, struct scan_control *sc)
 	if (!total_swap_pages)
 		return 0;
 
+	/* the multi-gen LRU has no active list to rebalance */
+	if (lru_gen_enabled())
+		return 0;
+
 	if (scanning_global_lru(sc))
 		low = inactive_anon_is_low_global(zone);
 	else
@@ -1928,6 +1945,632 @@ static inline bool should_continue_reclaim(struct zone *zone,
 	}
 }
 
+#ifdef CONFIG_LRU_GEN
+/*
+ * Multi-gen LRU
+ *
+ * Instead of the active and inactive lists, the evictable pages of a zone
+ * are sorted into generations, separately for anon and file.  max_seq is
+ * the youngest generation and min_seq[] the oldest one of each type; the
+ * two youngest generations are accounted as active.  Aging creates a new
+ * generation by incrementing max_seq.  kswapd then walks the page tables
+ * of every mm in bulk and moves the pages it finds young there to the new
+ * generation, which is far cheaper than finding them one rmap walk at a
+ * time.  Eviction takes pages from the tail of the oldest generation and
+ * hands them to shrink_page_list(), whose rmap check still catches pages
+ * that have been used since the last walk.  min_seq advances once the
+ * oldest generation is empty.
+ *
+ * A walk only updates the generation stored in page->flags; pages are
+ * moved to the list of their generation when eviction comes across them.
+ */
+
+static LIST_HEAD(lru_gen_mm_list);
+static DEFINE_SPINLOCK(lru_gen_mm_lock);
+static unsigned long lru_gen_nr_mms;
+
+/* the oldest generation is not evicted before it is this old, in jiffies */
+static unsigned long lru_gen_min_ttl __read_mostly;
+
+void lru_gen_add_mm(struct mm_struct *mm)
+{
+	spin_lock(&lru_gen_mm_lock);
+	list_add_tail(&mm->lru_gen_list, &lru_gen_mm_list);
+	lru_gen_nr_mms++;
+	spin_unlock(&lru_gen_mm_lock);
+}
+
+void lru_gen_del_mm(struct mm_struct *mm)
+{
+	spin_lock(&lru_gen_mm_lock);
+	list_del(&mm->lru_gen_list);
+	lru_gen_nr_mms--;
+	spin_unlock(&lru_gen_mm_lock);
+}
+
+void __paginginit lru_gen_init_zone(struct zone *zone)
+{
+	struct lru_gen_struct *lrugen = &zone->lrugen;
+	int gen, type;
+
+	lrugen->max_seq = MIN_NR_GENS;
+	for (type = 0; type < 2; type++) {
+		lrugen->min_seq[type] = 0;
+		for (gen = 0; gen < MAX_NR_GENS; gen++) {
+			INIT_LIST_HEAD(&lrugen->lists[gen][type]);
+			lrugen->nr_pages[gen][type] = 0;
+		}
+	}
+	for (gen = 0; gen < MAX_NR_GENS; gen++)
+		lrugen->timestamps[gen] = jiffies;
+	lrugen->anon_credit = 0;
+}
+
+/*
+ * Move @page from @old_gen to @new_gen, unless a page table walk has
+ * changed its generation in the meantime.
+ */
+static bool page_move_lru_gen(struct page *page, int old_gen, int new_gen)
+{
+	unsigned long old_flags, new_flags;
+
+	do {
+		old_flags = ACCESS_ONCE(page->flags);
+		if ((int)((old_flags & LRU_GEN_MASK) >> LRU_GEN_PGOFF) - 1 !=
+		    old_gen)
+			return false;
+		new_flags = (old_flags & ~LRU_GEN_MASK) |
+			    ((unsigned long)(new_gen + 1) << LRU_GEN_PGOFF);
+	} while (cmpxchg(&page->flags, old_flags, new_flags) != old_flags);
+
+	return true;
+}
+
+/* fold the oldest generation of @type into the next one */
+static void inc_min_seq(struct zone *zone, int type)
+{
+	struct lru_gen_struct *lrugen = &zone->lrugen;
+	int old_gen = lru_gen_from_seq(lrugen->min_seq[type]);
+	int new_gen = lru_gen_from_seq(lrugen->min_seq[type] + 1);
+	struct list_head *head = &lrugen->lists[old_gen][type];
+
+	while (!list_empty(head)) {
+		struct page *page = lru_to_page(head);
+		int gen = page_lru_gen(page);
+
+		if (gen == old_gen &&
+		    page_move_lru_gen(page, old_gen, new_gen)) {
+			lru_gen_update_size(zone, type, old_gen, new_gen,
+					    hpage_nr_pages(page));
+			gen = new_gen;
+		} else {
+			gen = page_lru_gen(page);
+		}
+		list_move(&page->lru, &lrugen->lists[gen][type]);
+	}
+	lrugen->min_seq[type]++;
+}
+
+/* retire the oldest generations that eviction has emptied */
+static void try_inc_min_seq(struct zone *zone)
+{
+	struct lru_gen_struct *lrugen = &zone->lrugen;
+	int type;
+
+	for (type = 0; type < 2; type++) {
+		while (lrugen->min_seq[type] + MIN_NR_GENS <= lrugen->max_seq) {
+			int gen = lru_gen_from_seq(lrugen->min_seq[type]);
+
+			if (!list_empty(&lrugen->lists[gen][type]))
+				break;
+			lrugen->min_seq[type]++;
+		}
+	}
+}
+
+/* move the pages of @gen between the active and the inactive counters */
+static void lru_gen_reclassify(struct zone *zone, int gen, bool active)
+{
+	struct lru_gen_struct *lrugen = &zone->lrugen;
+	int type;
+
+	for (type = 0; type < 2; type++) {
+		long delta = lrugen->nr_pages[gen][type];
+		enum lru_list lru = type ? LRU_INACTIVE_FILE : LRU_INACTIVE_ANON;
+
+		if (!delta)
+			continue;
+		if (!active)
+			delta = -delta;
+		__mod_zone_page_state(zone, NR_LRU_BASE + lru, -delta);
+		__mod_zone_page_state(zone, NR_LRU_BASE + lru + LRU_ACTIVE,
+				      delta);
+	}
+}
+
+/*
+ * Create a new generation, unless somebody else already did since
+ * @seq was read.  Returns true if max_seq was incremented.
+ */
+static bool inc_max_seq(struct zone *zone, unsigned long seq)
+{
+	struct lru_gen_struct *lrugen = &zone->lrugen;
+	bool success = false;
+	int type, prev, next;
+
+	spin_lock_irq(&zone->lru_lock);
+	if (seq != lrugen->max_seq)
+		goto unlock;
+
+	for (type = 0; type < 2; type++) {
+		if (lrugen->min_seq[type] + MAX_NR_GENS - 1 <= lrugen->max_seq)
+			inc_min_seq(zone, type);
+	}
+
+	/*
+	 * The second youngest generation becomes inactive.  The one being
+	 * created is normally empty, but page table walks that have not
+	 * been accounted yet may have left a transient count behind.
+	 */
+	prev = lru_gen_from_seq(lrugen->max_seq - 1);
+	next = lru_gen_from_seq(lrugen->max_seq + 1);
+	lru_gen_reclassify(zone, prev, false);
+	lru_gen_reclassify(zone, next, true);
+
+	lrugen->timestamps[next] = jiffies;
+	lrugen->max_seq++;
+	__count_vm_event(LRU_GEN_AGING);
+	success = true;
+unlock:
+	spin_unlock_irq(&zone->lru_lock);
+
+	return success;
+}
+
+struct lru_gen_walk {
+	struct zone *zone;
+	struct vm_area_struct *vma;
+	unsigned long seq;
+	/* changes to nr_pages[][] not yet accounted under the lru_lock */
+	long nr_pages[MAX_NR_GENS][2];
+	unsigned long nr_young;
+};
+
+static int lru_gen_walk_pmd(pmd_t *pmd, unsigned long addr,
+			    unsigned long end, struct mm_walk *mm_walk)
+{
+	struct lru_gen_walk *walk = mm_walk->private;
+	struct vm_area_struct *vma = walk->vma;
+	int new_gen = lru_gen_from_seq(walk->seq);
+	unsigned long start = addr;
+	bool flush = false;
+	spinlock_t *ptl;
+	pte_t *pte;
+
+	/* huge pages are left to the rmap check at eviction time */
+	if (pmd_none(*pmd) || pmd_trans_huge(*pmd) || pmd_bad(*pmd))
+		return 0;
+
+	pte = pte_offset_map_lock(vma->vm_mm, pmd, addr, &ptl);
+	for (; addr != end; pte++, addr += PAGE_SIZE) {
+		struct page *page;
+		int old_gen, type;
+
+		if (!pte_present(*pte) || !pte_young(*pte))
+			continue;
+
+		page = vm_normal_page(vma, addr, *pte);
+		if (!page || page_zone(page) != walk->zone)
+			continue;
+
+		if (!ptep_test_and_clear_young(vma, addr, pte))
+			continue;
+		walk->nr_young++;
+		flush = true;
+
+		old_gen = page_xchg_lru_gen(page, new_gen, false);
+		if (old_gen < 0 || old_gen == new_gen)
+			continue;
+
+		type = page_is_file_cache(page);
+		walk->nr_pages[old_gen][type]--;
+		walk->nr_pages[new_gen][type]++;
+	}
+	pte_unmap_unlock(pte - 1, ptl);
+
+	/*
+	 * Like ptep_clear_flush_young(), but once for the whole range:
+	 * where the young bit is emulated by faults (ARM), a stale TLB
+	 * entry would keep a hot page from ever being marked young again.
+	 */
+	if (flush)
+		flush_tlb_range(vma, start, end);
+
+	return 0;
+}
+
+static void lru_gen_flush_walk(struct lru_gen_walk *walk)
+{
+	struct zone *zone = walk->zone;
+	int gen, type;
+
+	spin_lock_irq(&zone->lru_lock);
+	for (gen = 0; gen < MAX_NR_GENS; gen++) {
+		for (type = 0; type < 2; type++) {
+			long delta = walk->nr_pages[gen][type];
+
+			if (!delta)
+				continue;
+			walk->nr_pages[gen][type] = 0;
+			lru_gen_update_size(zone, type, -1, gen, delta);
+		}
+	}
+	spin_unlock_irq(&zone->lru_lock);
+
+	count_vm_events(LRU_GEN_YOUNG, walk->nr_young);
+	walk->nr_young = 0;
+}
+
+/*
+ * Walk the page tables of every mm once, moving the pages of @zone that
+ * were accessed since the last walk to generation @seq.  mms are visited
+ * round-robin and skipped when their mmap_sem is contended; the walk
+ * stops early when another generation has been created meanwhile.
+ */
+static void lru_gen_walk_mms(struct zone *zone, unsigned long seq)
+{
+	struct lru_gen_walk walk = {
+		.zone	= zone,
+		.seq	= seq,
+	};
+	struct mm_walk mm_walk = {
+		.pmd_entry	= lru_gen_walk_pmd,
+		.private	= &walk,
+	};
+	unsigned long nr_mms;
+
+	spin_lock(&lru_gen_mm_lock);
+	nr_mms = lru_gen_nr_mms;
+	spin_unlock(&lru_gen_mm_lock);
+
+	count_vm_event(LRU_GEN_WALK);
+
+	while (nr_mms--) {
+		struct mm_struct *mm = NULL;
+		struct vm_area_struct *vma;
+
+		spin_lock(&lru_gen_mm_lock);
+		if (!list_empty(&lru_gen_mm_list)) {
+			mm = list_first_entry(&lru_gen_mm_list,
+					      struct mm_struct, lru_gen_list);
+			list_move_tail(&mm->lru_gen_list, &lru_gen_mm_list);
+			if (!atomic_inc_not_zero(&mm->mm_users))
+				mm = NULL;
+		}
+		spin_unlock(&lru_gen_mm_lock);
+
+		if (!mm)
+			continue;
+
+		if (down_read_trylock(&mm->mmap_sem)) {
+			mm_walk.mm = mm;
+			for (vma = mm->mmap; vma; vma = vma->vm_next) {
+				if ((vma->vm_flags & (VM_LOCKED | VM_IO |
+						      VM_PFNMAP)) ||
+				    is_vm_hugetlb_page(vma))
+					continue;
+				walk.vma = vma;
+				walk_page_range(vma->vm_start, vma->vm_end,
+						&mm_walk);
+				cond_resched();
+			}
+			up_read(&mm->mmap_sem);
+		}
+		mmput(mm);
+
+		lru_gen_flush_walk(&walk);
+		if (ACCESS_ONCE(zone->lrugen.max_seq) != seq)
+			break;
+	}
+}
+
+static bool lru_gen_has_pages(struct lru_gen_struct *lrugen, int type)
+{
+	int gen;
+
+	for (gen = 0; gen < MAX_NR_GENS; gen++)
+		if (!list_empty(&lrugen->lists[gen][type]))
+			return true;
+	return false;
+}
+
+/*
+ * Evict file pages only when we can't swap or there are no anon pages.
+ * Otherwise prefer the type that can be evicted without aging first,
+ * then the older type; when both are equally old, anon is picked in
+ * proportion to swappiness.
+ */
+static int lru_gen_pick_type(struct zone *zone, struct scan_control *sc)
+{
+	struct lru_gen_struct *lrugen = &zone->lrugen;
+	bool anon, file;
+
+	if (!sc->may_swap || nr_swap_pages <= 0 ||
+	    !lru_gen_has_pages(lrugen, 0))
+		return 1;
+
+	anon = lrugen->min_seq[0] + MIN_NR_GENS <= lrugen->max_seq;
+	file = lrugen->min_seq[1] + MIN_NR_GENS <= lrugen->max_seq;
+	if (anon != file)
+		return file;
+
+	if (lrugen->min_seq[0] != lrugen->min_seq[1])
+		return lrugen->min_seq[0] > lrugen->min_seq[1];
+
+	lrugen->anon_credit += sc->swappiness;
+	if (lrugen->anon_credit >= 200) {
+		lrugen->anon_credit -= 200;
+		return 0;
+	}
+	return 1;
+}
+
+static unsigned long lru_gen_isolate(struct zone *zone, int type,
+				     unsigned long nr_to_scan,
+				     struct list_head *dst,
+				     unsigned long *nr_scanned)
+{
+	struct lru_gen_struct *lrugen = &zone->lrugen;
+	int gen = lru_gen_from_seq(lrugen->min_seq[type]);
+	struct list_head *head = &lrugen->lists[gen][type];
+	unsigned long nr_taken = 0, scan = 0;
+
+	while (scan < nr_to_scan && !list_empty(head)) {
+		struct page *page = lru_to_page(head);
+		int new_gen = page_lru_gen(page);
+
+		VM_BUG_ON(!PageLRU(page));
+		scan++;
+
+		if (new_gen != gen) {
+			/* promoted by a page table walk */
+			list_move(&page->lru, &lrugen->lists[new_gen][type]);
+			continue;
+		}
+
+		if (unlikely(!get_page_unless_zero(page))) {
+			/* being freed elsewhere */
+			list_move(&page->lru, head);
+			continue;
+		}
+
+		ClearPageLRU(page);
+		lru_gen_del_page(zone, page, true);
+		list_add(&page->lru, dst);
+		nr_taken += hpage_nr_pages(page);
+	}
+
+	*nr_scanned = scan;
+	return nr_taken;
+}
+
+/*
+ * Reclaim from the oldest generation, aging first if only MIN_NR_GENS
+ * are left.  Returns the number of pages reclaimed, *nr_scanned is 0 if
+ * nothing could be scanned.
+ */
+static unsigned long lru_gen_evict(struct zone *zone, struct scan_control *sc,
+				   int priority, unsigned long nr_to_scan,
+				   unsigned long *nr_scanned)
+{
+	struct lru_gen_struct *lrugen = &zone->lrugen;
+	LIST_HEAD(page_list);
+	unsigned long nr_taken, nr_reclaimed, seq;
+	int type, gen;
+
+	*nr_scanned = 0;
+
+	spin_lock_irq(&zone->lru_lock);
+	try_inc_min_seq(zone);
+	type = lru_gen_pick_type(zone, sc);
+	seq = lrugen->max_seq;
+	if (lrugen->min_seq[type] + MIN_NR_GENS > seq) {
+		spin_unlock_irq(&zone->lru_lock);
+
+		/* only kswapd pays for walking the page tables */
+		if (inc_max_seq(zone, seq) && current_is_kswapd())
+			lru_gen_walk_mms(zone, seq + 1);
+
+		spin_lock_irq(&zone->lru_lock);
+		try_inc_min_seq(zone);
+		if (lrugen->min_seq[type] + MIN_NR_GENS > lrugen->max_seq)
+			goto unlock;
+	}
+
+	/* leave the working set alone unless reclaim is getting desperate */
+	gen = lru_gen_from_seq(lrugen->min_seq[type]);
+	if (lru_gen_min_ttl && priority &&
+	    time_before(jiffies, lrugen->timestamps[gen] + lru_gen_min_ttl))
+		goto unlock;
+
+	nr_taken = lru_gen_isolate(zone, type, nr_to_scan, &page_list,
+				   nr_scanned);
+	zone->pages_scanned += *nr_scanned;
+	if (current_is_kswapd())
+		__count_zone_vm_events(PGSCAN_KSWAPD, zone, *nr_scanned);
+	else
+		__count_zone_vm_events(PGSCAN_DIRECT, zone, *nr_scanned);
+
+	if (!nr_taken)
+		goto unlock;
+
+	__mod_zone_page_state(zone, NR_ISOLATED_ANON + type, nr_taken);
+	spin_unlock_irq(&zone->lru_lock);
+
+	nr_reclaimed = shrink_page_list(&page_list, zone, sc);
+
+	local_irq_disable();
+	if (current_is_kswapd())
+		__count_vm_events(KSWAPD_STEAL, nr_reclaimed);
+	__count_zone_vm_events(PGSTEAL, zone, nr_reclaimed);
+
+	putback_lru_pages(zone, sc, type ? 0 : nr_taken, type ? nr_taken : 0,
+			  &page_list);
+
+	return nr_reclaimed;
+unlock:
+	spin_unlock_irq(&zone->lru_lock);
+	return 0;
+}
+
+static bool lru_gen_shrink_zone(int priority, struct zone *zone,
+				struct scan_control *sc)
+{
+	unsigned long nr_to_scan, nr_scanned, nr_reclaimed = 0;
+
+	nr_to_scan = max(zone_reclaimable_pages(zone) >> priority,
+			 (unsigned long)SWAP_CLUSTER_MAX);
+
+	while (unlikely(too_many_isolated(zone, 1, sc))) {
+		congestion_wait(BLK_RW_ASYNC, HZ/10);
+
+		/* We are about to die and free our memory. Return now. */
+		if (fatal_signal_pending(current)) {
+			sc->nr_reclaimed += SWAP_CLUSTER_MAX;
+			return true;
+		}
+	}
+
+	set_reclaim_mode(priority, sc, false);
+	lru_add_drain();
+
+	while (nr_to_scan) {
+		nr_reclaimed += lru_gen_evict(zone, sc, priority,
+				min(nr_to_scan, (unsigned long)SWAP_CLUSTER_MAX),
+				&nr_scanned);
+		if (!nr_scanned)
+			break;
+		nr_to_scan -= min(nr_to_scan, nr_scanned);
+
+		if (nr_reclaimed >= sc->nr_to_reclaim && priority < DEF_PRIORITY)
+			break;
+	}
+	sc->nr_reclaimed += nr_reclaimed;
+
+	throttle_vm_writeout(sc->gfp_mask);
+	return true;
+}
+
+#ifdef CONFIG_SYSFS
+static ssize_t min_ttl_ms_show(struct kobject *kobj,
+			       struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", jiffies_to_msecs(lru_gen_min_ttl));
+}
+
+static ssize_t min_ttl_ms_store(struct kobject *kobj,
+				struct kobj_attribute *attr,
+				const char *buf, size_t count)
+{
+	unsigned long msecs;
+
+	if (strict_strtoul(buf, 10, &msecs) || msecs > UINT_MAX)
+		return -EINVAL;
+
+	lru_gen_min_ttl = msecs_to_jiffies(msecs);
+	return count;
+}
+
+static struct kobj_attribute min_ttl_ms_attr =
+	__ATTR(min_ttl_ms, 0644, min_ttl_ms_show, min_ttl_ms_store);
+
+static struct attribute *lru_gen_attrs[] = {
+	&min_ttl_ms_attr.attr,
+	NULL,
+};
+
+static struct attribute_group lru_gen_attr_group = {
+	.attrs = lru_gen_attrs,
+	.name = "lru_gen",
+};
+#endif /* CONFIG_SYSFS */
+
+#ifdef CONFIG_DEBUG_FS
+/*
+ * One line per generation and zone: sequence number, age in ms and the
+ * number of anon and file pages, "-" once a type has evicted it.
+ */
+static int lru_gen_show(struct seq_file *m, void *v)
+{
+	struct zone *zone;
+
+	for_each_populated_zone(zone) {
+		struct lru_gen_struct *lrugen = &zone->lrugen;
+		unsigned long seq;
+		int type;
+
+		seq_printf(m, "node %d zone %s\n", zone_to_nid(zone),
+			   zone->name);
+
+		spin_lock_irq(&zone->lru_lock);
+		seq = min(lrugen->min_seq[0], lrugen->min_seq[1]);
+		for (; seq <= lrugen->max_seq; seq++) {
+			int gen = lru_gen_from_seq(seq);
+
+			seq_printf(m, " %10lu %10u", seq,
+				   jiffies_to_msecs(jiffies -
+						    lrugen->timestamps[gen]));
+			for (type = 0; type < 2; type++) {
+				if (seq < lrugen->min_seq[type])
+					seq_printf(m, " %10s", "-");
+				else
+					seq_printf(m, " %10ld",
+						   lrugen->nr_pages[gen][type]);
+			}
+			seq_putc(m, '\n');
+		}
+		spin_unlock_irq(&zone->lru_lock);
+	}
+
+	return 0;
+}
+
+static int lru_gen_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, lru_gen_show, NULL);
+}
+
+static const struct file_operations lru_gen_fops = {
+	.open		= lru_gen_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+#endif /* CONFIG_DEBUG_FS */
+
+static int __init lru_gen_init(void)
+{
+#ifdef CONFIG_SYSFS
+	if (sysfs_create_group(mm_kobj, &lru_gen_attr_group))
+		printk(KERN_ERR "lru_gen: failed to register sysfs group\n");
+#endif
+#ifdef CONFIG_DEBUG_FS
+	debugfs_create_file("lru_gen", 0444, NULL, NULL, &lru_gen_fops);
+#endif
+	return 0;
+}
+late_initcall(lru_gen_init);
+
+#else /* !CONFIG_LRU_GEN */
+
+static inline bool lru_gen_shrink_zone(int priority, struct zone *zone,
+				       struct scan_control *sc)
+{
+	return false;
+}
+
+#endif /* CONFIG_LRU_GEN */
+
 /*
  * This is a basic per-zone page freer.  Used by both kswapd and direct reclaim.
  */
@@ -1940,6 +2583,9 @@ static void shrink_zone(int priority, struct zone *zone,
 	unsigned long nr_reclaimed, nr_scanned;
 	unsigned long nr_to_reclaim = sc->nr_to_reclaim;
 
+	if (lru_gen_shrink_zone(priority, zone, sc))
+		return;
+
 restart:
 	nr_reclaimed = 0;
 	nr_scanned = sc->nr_scanned;
@@ -2030,7 +2676,7 @@ static void shrink_zones(int priority, struct zonelist *zonelist,
 			 */
 			nr_soft_scanned = 0;
 			nr_soft_reclaimed = mem_cgroup_soft_limit_reclaim(zone,
-						sc->order, sc->gfp_mask,
+						sc->order, priority, sc->gfp_mask,
 						&nr_soft_scanned);
 			sc->nr_reclaimed += nr_soft_reclaimed;
 			sc->nr_scanned += nr_soft_scanned;
@@ -2210,7 +2856,7 @@ unsigned long try_to_free_pages(struct zonelist *zonelist, int order,
 unsigned long mem_cgroup_shrink_node_zone(struct mem_cgroup *mem,
 						gfp_t gfp_mask, bool noswap,
 						unsigned int swappiness,
-						struct zone *zone,
+						struct zone *zone, int priority,
 						unsigned long *nr_scanned)
 {
 	struct scan_control sc = {
@@ -2232,13 +2878,11 @@ unsigned long mem_cgroup_shrink_node_zone(struct mem_cgroup *mem,
 						      sc.gfp_mask);
 
 	/*
-	 * NOTE: Although we can get the priority field, using it
-	 * here is not a good idea, since it limits the pages we can scan.
-	 * if we don't reclaim here, the shrink_zone from balance_pgdat
-	 * will pick up pages from other mem cgroup's as well. We hack
-	 * the priority and make it zero.
+	 * Scan at the priority of the global reclaim, so that every cgroup
+	 * over its soft limit loses pages in proportion to its size and the
+	 * shrink_zone() from balance_pgdat picks up the rest.
 	 */
-	shrink_zone(0, zone, &sc);
+	shrink_zone(priority, zone, &sc);
 
 	trace_mm_vmscan_memcg_softlimit_reclaim_end(sc.nr_reclaimed);
 
@@ -2497,7 +3141,7 @@ loop_again:
 			 * Call soft limit reclaim before calling shrink_zone.
 			 */
 			nr_soft_reclaimed = mem_cgroup_soft_limit_reclaim(zone,
-							order, sc.gfp_mask,
+							order, priority, sc.gfp_mask,
 							&nr_soft_scanned);
 			sc.nr_reclaimed += nr_soft_reclaimed;
 			total_scanned += nr_soft_scanned;
@@ -2662,7 +3306,8 @@ out:
 	return order;
 }
 
-static void kswapd_try_to_sleep(pg_data_t *pgdat, int order, int classzone_idx)
+static void kswapd_try_to_sleep(pg_data_t *pgdat, int order, int alloc_order,
+				int classzone_idx)
 {
 	long remaining = 0;
 	DEFINE_WAIT(wait);
@@ -2686,6 +3331,14 @@ static void kswapd_try_to_sleep(pg_data_t *pgdat, int order, int classzone_idx)
 	if (!sleeping_prematurely(pgdat, order, remaining, classzone_idx)) {
 		trace_mm_vmscan_kswapd_sleep(pgdat->node_id);
 
+		/*
+		 * The free pages are there now, but possibly not in blocks
+		 * of the order kswapd was woken for, which balance_pgdat()
+		 * may have given up on.  Have kcompactd put them together
+		 * before the allocator has to compact directly.
+		 */
+		wakeup_kcompactd(pgdat, alloc_order, classzone_idx);
+
 		/*
 		 * vmstat counters are not perfectly accurate and the estimated
 		 * value for counters such as NR_FREE_PAGES can deviate from the
@@ -2721,7 +3374,7 @@ static void kswapd_try_to_sleep(pg_data_t *pgdat, int order, int classzone_idx)
  */
 static int kswapd(void *p)
 {
-	unsigned long order, new_order;
+	unsigned long order, new_order, alloc_order;
 	int classzone_idx, new_classzone_idx;
 	pg_data_t *pgdat = (pg_data_t*)p;
 	struct task_struct *tsk = current;
@@ -2752,7 +3405,7 @@ static int kswapd(void *p)
 	tsk->flags |= PF_MEMALLOC | PF_SWAPWRITE | PF_KSWAPD;
 	set_freezable();
 
-	order = new_order = 0;
+	order = new_order = alloc_order = 0;
 	classzone_idx = new_classzone_idx = pgdat->nr_zones - 1;
 	for ( ; ; ) {
 		int ret;
@@ -2777,7 +3430,8 @@ static int kswapd(void *p)
 			order = new_order;
 			classzone_idx = new_classzone_idx;
 		} else {
-			kswapd_try_to_sleep(pgdat, order, classzone_idx);
+			kswapd_try_to_sleep(pgdat, order, alloc_order,
+					    classzone_idx);
 			order = pgdat->kswapd_max_order;
 			classzone_idx = pgdat->classzone_idx;
 			pgdat->kswapd_max_order = 0;
@@ -2794,6 +3448,7 @@ static int kswapd(void *p)
 		 */
 		if (!ret) {
 			trace_mm_vmscan_kswapd_wake(pgdat->node_id, order);
+			alloc_order = order;
 			order = balance_pgdat(pgdat, order, &classzone_idx);
 		}
 	}
@@ -3236,10 +3891,8 @@ retry:
 	if (page_evictable(page, NULL)) {
 		enum lru_list l = page_lru_base_type(page);
 
-		__dec_zone_state(zone, NR_UNEVICTABLE);
-		list_move(&page->lru, &zone->lru[l].list);
-		mem_cgroup_move_lists(page, LRU_UNEVICTABLE, l);
-		__inc_zone_state(zone, NR_INACTIVE_ANON + l);
+		del_page_from_lru_list(zone, page, LRU_UNEVICTABLE);
+		add_page_to_lru_list(zone, page, l);
 		__count_vm_event(UNEVICTABLE_PGRESCUED);
 	} else {
 		/*
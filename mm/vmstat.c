@@ -602,6 +602,24 @@ int fragmentation_index(struct zone *zone, unsigned int order)
 	fill_contig_page_info(zone, order, &info);
 	return __fragmentation_index(order, &info);
 }
+
+/*
+ * Percentage of the free memory of a zone that is in blocks smaller than
+ * the given order: 0 when all of it could serve such allocations, 100
+ * when none of it could.
+ */
+unsigned int extfrag_for_order(struct zone *zone, unsigned int order)
+{
+	struct contig_page_info info;
+
+	fill_contig_page_info(zone, order, &info);
+	if (info.free_pages == 0)
+		return 0;
+
+	return div_u64((info.free_pages -
+			(info.free_blocks_suitable << order)) * 100,
+			info.free_pages);
+}
 #endif
 
 #if defined(CONFIG_PROC_FS) || defined(CONFIG_COMPACTION)
@@ -613,6 +631,9 @@ static char * const migratetype_names[MIGRATE_TYPES] = {
 	"Reclaimable",
 	"Movable",
 	"Reserve",
+#ifdef CONFIG_CMA
+	"CMA",
+#endif
 	"Isolate",
 };
 
@@ -681,6 +702,9 @@ static void walk_zones_in_node(struct seq_file *m, pg_data_t *pgdat,
 #define TEXTS_FOR_ZONES(xx) TEXT_FOR_DMA(xx) TEXT_FOR_DMA32(xx) xx "_normal", \
 					TEXT_FOR_HIGHMEM(xx) xx "_movable",
 
+#define TEXTS_FOR_PCP_ORDERS(xx) xx "_order0", xx "_order1", xx "_order2", \
+					xx "_order3",
+
 const char * const vmstat_text[] = {
 	/* Zoned VM counters */
 	"nr_free_pages",
@@ -708,6 +732,8 @@ const char * const vmstat_text[] = {
 	"nr_shmem",
 	"nr_dirtied",
 	"nr_written",
+	"workingset_refault",
+	"workingset_activate",
 
 #ifdef CONFIG_NUMA
 	"numa_hit",
@@ -733,6 +759,10 @@ const char * const vmstat_text[] = {
 	"pgactivate",
 	"pgdeactivate",
 
+	TEXTS_FOR_PCP_ORDERS("pcp_hit")
+	TEXTS_FOR_PCP_ORDERS("pcp_refill")
+	"pcp_drain",
+
 	"pgfault",
 	"pgmajfault",
 
@@ -755,6 +785,12 @@ const char * const vmstat_text[] = {
 	"allocstall",
 
 	"pgrotated",
+	"workingset_nodereclaim",
+	"readahead_sync",
+	"readahead_async",
+	"readahead_stride",
+	"readahead_backward",
+	"readahead_pages",
 
 #ifdef CONFIG_COMPACTION
 	"compact_blocks_moved",
@@ -763,6 +799,11 @@ const char * const vmstat_text[] = {
 	"compact_stall",
 	"compact_fail",
 	"compact_success",
+	"compact_stall_us",
+	"compact_daemon_wake",
+	"compact_daemon_success",
+	"compact_daemon_fail",
+	"compact_proactive",
 #endif
 
 #ifdef CONFIG_HUGETLB_PAGE
@@ -778,6 +819,11 @@ const char * const vmstat_text[] = {
 	"unevictable_pgs_stranded",
 	"unevictable_pgs_mlockfreed",
 
+#ifdef CONFIG_LRU_GEN
+	"lru_gen_aging",
+	"lru_gen_walk",
+	"lru_gen_young",
+#endif
 #ifdef CONFIG_TRANSPARENT_HUGEPAGE
 	"thp_fault_alloc",
 	"thp_fault_fallback",
@@ -0,0 +1,358 @@
+/*
+ * linux/mm/workingset.c
+ *
+ * Workingset detection
+ *
+ * A page that is faulted in for the first time goes onto the inactive
+ * file list and has to be referenced again while it is there to make it
+ * onto the active list.  When the inactive list is too short to hold the
+ * pages of a workingset that is bigger than it, those pages get evicted
+ * before their second access, and then keep thrashing through the
+ * inactive list without ever getting activated - the kernel can not tell
+ * them apart from a streaming read that is used only once.
+ *
+ * To catch this, a shadow entry is left in the page cache slot of every
+ * page that reclaim evicts.  It records the zone the page was in and a
+ * snapshot of the zone's inactive_age, a counter that is bumped on every
+ * eviction from and every activation out of the inactive file list.  On
+ * refault, the difference between the current inactive_age and the one
+ * in the shadow is the refault distance: the minimum number of slots the
+ * inactive list would have needed in addition to its current size for
+ * the page to have stayed in memory.  If the distance is no bigger than
+ * the active file list, the page would have been kept had the active
+ * list given up that space, so it is activated right away and competes
+ * with the pages that are there now.
+ *
+ *	zone->inactive_age
+ *	    E     = inactive_age when the page was evicted
+ *	    R     = inactive_age when the page refaults
+ *	    R - E = refault distance
+ *
+ * Shadow entries of pages that never come back would pile up in the radix
+ * trees of long-lived files, and keep nodes alive whose pages are all
+ * gone.  A shrinker keeps their number in check: once there are more of
+ * them than file pages on the LRU lists, it walks the mappings that have
+ * shadow entries and frees the blocks of slots that hold nothing but
+ * shadows, releasing the tree nodes that held them.
+ */
+
+#include <linux/mm.h>
+#include <linux/mmzone.h>
+#include <linux/fs.h>
+#include <linux/swap.h>
+#include <linux/pagemap.h>
+#include <linux/radix-tree.h>
+#include <linux/spinlock.h>
+#include <linux/sched.h>
+#include <linux/init.h>
+#include <linux/module.h>
+
+/*
+ * Eviction timestamps need to be able to cover the full range of actionable
+ * refaults, which is bounded by the memory size.  What is left of the long
+ * after the node, zone and radix tree tagging bits is more than enough.
+ */
+#define EVICTION_SHIFT	(RADIX_TREE_EXCEPTIONAL_SHIFT + \
+			 ZONES_SHIFT + NODES_SHIFT)
+#define EVICTION_MASK	(~0UL >> EVICTION_SHIFT)
+
+static void *pack_shadow(unsigned long eviction, struct zone *zone)
+{
+	eviction = (eviction << NODES_SHIFT) | zone_to_nid(zone);
+	eviction = (eviction << ZONES_SHIFT) | zone_idx(zone);
+	eviction = (eviction << RADIX_TREE_EXCEPTIONAL_SHIFT);
+
+	return (void *)(eviction | RADIX_TREE_EXCEPTIONAL_ENTRY);
+}
+
+static void unpack_shadow(void *shadow, struct zone **zone,
+			  unsigned long *distance)
+{
+	unsigned long entry = (unsigned long)shadow;
+	unsigned long eviction;
+	unsigned long refault;
+	int zid, nid;
+
+	entry >>= RADIX_TREE_EXCEPTIONAL_SHIFT;
+	zid = entry & ((1UL << ZONES_SHIFT) - 1);
+	entry >>= ZONES_SHIFT;
+	nid = entry & ((1UL << NODES_SHIFT) - 1);
+	entry >>= NODES_SHIFT;
+	eviction = entry;
+
+	*zone = NODE_DATA(nid)->node_zones + zid;
+
+	refault = atomic_long_read(&(*zone)->inactive_age);
+	*distance = (refault - eviction) & EVICTION_MASK;
+}
+
+/**
+ * workingset_eviction - note the eviction of a page from memory
+ * @mapping: address space the page was backing
+ * @page: the page being evicted
+ *
+ * Returns a shadow entry to be stored in @mapping->page_tree in place
+ * of the evicted @page so that a later refault can be detected, or NULL
+ * if @mapping does not keep shadow entries.  Called under tree_lock.
+ */
+void *workingset_eviction(struct address_space *mapping, struct page *page)
+{
+	struct zone *zone = page_zone(page);
+	unsigned long eviction;
+
+	/*
+	 * Only the i_data of an inode gets its shadows cleared when the
+	 * inode goes away, leave the page caches of everything else alone.
+	 */
+	if (!mapping->host || mapping != &mapping->host->i_data)
+		return NULL;
+
+	eviction = atomic_long_inc_return(&zone->inactive_age);
+	return pack_shadow(eviction, zone);
+}
+
+/**
+ * workingset_refault - evaluate the refault of a previously evicted page
+ * @shadow: shadow entry of the evicted page
+ *
+ * Calculates and evaluates the refault distance of the previously
+ * evicted page in the context of the zone it was allocated in.
+ *
+ * Returns %true if the page should be activated, %false otherwise.
+ */
+bool workingset_refault(void *shadow)
+{
+	unsigned long refault_distance;
+	struct zone *zone;
+
+	unpack_shadow(shadow, &zone, &refault_distance);
+	inc_zone_state(zone, WORKINGSET_REFAULT);
+
+	if (refault_distance <= zone_page_state(zone, NR_ACTIVE_FILE)) {
+		inc_zone_state(zone, WORKINGSET_ACTIVATE);
+		return true;
+	}
+	return false;
+}
+
+/**
+ * workingset_activation - note a page activation
+ * @page: page that is being activated
+ */
+void workingset_activation(struct page *page)
+{
+	atomic_long_inc(&page_zone(page)->inactive_age);
+}
+
+/*
+ * Mappings that have shadow entries are kept on shadow_mappings for the
+ * shrinker to find them.  shadow_lock nests inside the tree_lock of the
+ * mappings, so the shrinker, which comes from the other side, may only
+ * trylock those.
+ */
+static LIST_HEAD(shadow_mappings);
+static DEFINE_SPINLOCK(shadow_lock);
+static atomic_long_t nr_shadows;
+
+/* the mapping the shrinker is working its way through, and how far */
+static struct address_space *shadow_cursor_mapping;
+static pgoff_t shadow_cursor;
+
+/* one block of slots, only used under shadow_lock */
+static void **shadow_slots[RADIX_TREE_MAP_SIZE];
+static unsigned long shadow_indices[RADIX_TREE_MAP_SIZE];
+
+/**
+ * workingset_shadow_add - account a shadow entry stored in a mapping
+ * @mapping: the address space
+ *
+ * Called under @mapping->tree_lock.
+ */
+void workingset_shadow_add(struct address_space *mapping)
+{
+	if (!mapping->nrshadows++) {
+		spin_lock(&shadow_lock);
+		list_add_tail(&mapping->shadow_list, &shadow_mappings);
+		spin_unlock(&shadow_lock);
+	}
+	atomic_long_inc(&nr_shadows);
+}
+
+static void __workingset_shadow_del(struct address_space *mapping)
+{
+	if (!--mapping->nrshadows) {
+		list_del_init(&mapping->shadow_list);
+		if (mapping == shadow_cursor_mapping)
+			shadow_cursor_mapping = NULL;
+	}
+	atomic_long_dec(&nr_shadows);
+}
+
+/**
+ * workingset_shadow_del - account a shadow entry removed from a mapping
+ * @mapping: the address space
+ *
+ * Called under @mapping->tree_lock.
+ */
+void workingset_shadow_del(struct address_space *mapping)
+{
+	spin_lock(&shadow_lock);
+	__workingset_shadow_del(mapping);
+	spin_unlock(&shadow_lock);
+}
+
+#define CLEAR_SHADOWS_BATCH	16
+
+/**
+ * workingset_clear_shadows - remove the shadow entries of a range
+ * @mapping: the address space
+ * @start: first page index of the range
+ * @end: last page index of the range, inclusive
+ *
+ * Truncation leaves the shadow entries of evicted pages behind, which
+ * are stale from then on.  Must be called after the pages of the range
+ * are gone, and before @mapping is freed.
+ */
+void workingset_clear_shadows(struct address_space *mapping,
+			      pgoff_t start, pgoff_t end)
+{
+	void **slots[CLEAR_SHADOWS_BATCH];
+	unsigned long indices[CLEAR_SHADOWS_BATCH];
+	pgoff_t index = start;
+	unsigned int i, nr;
+
+	spin_lock_irq(&mapping->tree_lock);
+	while (mapping->nrshadows && index <= end) {
+		nr = radix_tree_gang_lookup_slot(&mapping->page_tree, slots,
+				indices, index, CLEAR_SHADOWS_BATCH);
+		if (!nr)
+			break;
+		for (i = 0; i < nr; i++) {
+			void *entry;
+
+			if (indices[i] > end)
+				goto out;
+			entry = radix_tree_deref_slot_protected(slots[i],
+							&mapping->tree_lock);
+			if (!radix_tree_exceptional_entry(entry))
+				continue;
+			radix_tree_delete(&mapping->page_tree, indices[i]);
+			workingset_shadow_del(mapping);
+		}
+		index = indices[nr - 1] + 1;
+		if (!index)
+			break;
+		spin_unlock_irq(&mapping->tree_lock);
+		cond_resched();
+		spin_lock_irq(&mapping->tree_lock);
+	}
+out:
+	spin_unlock_irq(&mapping->tree_lock);
+}
+
+/*
+ * Look at the next block of RADIX_TREE_MAP_SIZE slots of @mapping that
+ * has any entries in it, and free the shadow entries in it if there are
+ * no pages among them.  Returns true once the end of @mapping has been
+ * reached.  Called under shadow_lock and @mapping->tree_lock.
+ */
+static bool shrink_shadow_block(struct address_space *mapping,
+				unsigned long *nr_to_scan)
+{
+	unsigned long block;
+	unsigned int i, nr, nr_block;
+
+	nr = radix_tree_gang_lookup_slot(&mapping->page_tree, shadow_slots,
+			shadow_indices, shadow_cursor, RADIX_TREE_MAP_SIZE);
+	if (!nr)
+		return true;
+
+	block = shadow_indices[0] & ~RADIX_TREE_MAP_MASK;
+	for (nr_block = 0; nr_block < nr; nr_block++) {
+		void *entry;
+
+		if (shadow_indices[nr_block] >= block + RADIX_TREE_MAP_SIZE)
+			break;
+		entry = radix_tree_deref_slot_protected(shadow_slots[nr_block],
+							&mapping->tree_lock);
+		if (!radix_tree_exceptional_entry(entry))
+			goto next;
+	}
+
+	for (i = 0; i < nr_block; i++) {
+		radix_tree_delete(&mapping->page_tree, shadow_indices[i]);
+		__workingset_shadow_del(mapping);
+	}
+	count_vm_event(WORKINGSET_NODERECLAIM);
+next:
+	*nr_to_scan -= min_t(unsigned long, *nr_to_scan, nr_block);
+	shadow_cursor = block + RADIX_TREE_MAP_SIZE;
+	return !shadow_cursor || !mapping->nrshadows;
+}
+
+static void scan_shadows(unsigned long nr_to_scan)
+{
+	struct address_space *mapping;
+
+	spin_lock_irq(&shadow_lock);
+	while (nr_to_scan && !list_empty(&shadow_mappings)) {
+		mapping = list_first_entry(&shadow_mappings,
+					   struct address_space, shadow_list);
+		if (mapping != shadow_cursor_mapping) {
+			shadow_cursor_mapping = mapping;
+			shadow_cursor = 0;
+		}
+
+		if (!spin_trylock(&mapping->tree_lock)) {
+			/* busy, come back to it later */
+			list_move_tail(&mapping->shadow_list, &shadow_mappings);
+			nr_to_scan--;
+			continue;
+		}
+		if (shrink_shadow_block(mapping, &nr_to_scan) &&
+		    mapping->nrshadows) {
+			list_move_tail(&mapping->shadow_list, &shadow_mappings);
+			shadow_cursor_mapping = NULL;
+		}
+		spin_unlock(&mapping->tree_lock);
+	}
+	spin_unlock_irq(&shadow_lock);
+}
+
+/*
+ * Shadows of pages evicted longer ago than the size of the file LRU
+ * lists can not produce a refault distance that leads to activation.
+ */
+static long excess_shadows(void)
+{
+	unsigned long max;
+
+	max = global_page_state(NR_ACTIVE_FILE) +
+	      global_page_state(NR_INACTIVE_FILE);
+	return atomic_long_read(&nr_shadows) - max;
+}
+
+static int shrink_shadows(struct shrinker *shrink, struct shrink_control *sc)
+{
+	long excess;
+
+	if (sc->nr_to_scan && excess_shadows() > 0)
+		scan_shadows(sc->nr_to_scan);
+
+	excess = excess_shadows();
+	if (excess <= 0)
+		return 0;
+	return min_t(long, excess, INT_MAX);
+}
+
+static struct shrinker shadow_shrinker = {
+	.shrink = shrink_shadows,
+	.seeks = DEFAULT_SEEKS,
+};
+
+static int __init workingset_init(void)
+{
+	register_shrinker(&shadow_shrinker);
+	return 0;
+}
+module_init(workingset_init);
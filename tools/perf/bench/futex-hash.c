@@ -0,0 +1,197 @@
+/*
+ *
+ * futex-hash.c
+ *
+ * hash: Stress the futex hash table
+ *
+ * Every thread repeatedly issues FUTEX_WAIT on its own set of futexes with
+ * a mismatching value, so each call only hashes the key, takes and drops
+ * the bucket lock and returns EWOULDBLOCK. The throughput therefore shows
+ * how well the hash spreads the futexes and how much the bucket locks are
+ * contended across threads.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+#include "futex.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+static unsigned int nthreads;
+static unsigned int nfutexes = 1024;
+static unsigned int nsecs = 10;
+static bool fshared;
+
+static volatile int done;
+static int futex_flag;
+
+static pthread_mutex_t thread_lock;
+static pthread_cond_t thread_parent, thread_worker;
+static unsigned int threads_starting;
+
+struct worker {
+	pthread_t thread;
+	u_int32_t *futex;
+	unsigned long ops;
+};
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads,
+		     "Specify amount of threads (default: online cpus)"),
+	OPT_UINTEGER('f', "futexes", &nfutexes,
+		     "Specify amount of futexes per thread"),
+	OPT_UINTEGER('r', "runtime", &nsecs,
+		     "Specify runtime (in seconds)"),
+	OPT_BOOLEAN('S', "shared", &fshared,
+		    "Use shared futexes instead of private ones"),
+	OPT_END()
+};
+
+static const char * const bench_futex_hash_usage[] = {
+	"perf bench futex hash <options>",
+	NULL
+};
+
+static void *workerfn(void *arg)
+{
+	struct worker *w = arg;
+	unsigned int i;
+
+	pthread_mutex_lock(&thread_lock);
+	threads_starting--;
+	if (!threads_starting)
+		pthread_cond_signal(&thread_parent);
+	pthread_cond_wait(&thread_worker, &thread_lock);
+	pthread_mutex_unlock(&thread_lock);
+
+	do {
+		for (i = 0; i < nfutexes; i++, w->ops++) {
+			/* *futex is 0, so this returns EWOULDBLOCK at once */
+			if (futex_wait(&w->futex[i], 1234, NULL,
+				       futex_flag) == -1 &&
+			    errno != EAGAIN && errno != EINTR) {
+				perror("futex_wait");
+				exit(EXIT_FAILURE);
+			}
+		}
+	} while (!done);
+
+	return NULL;
+}
+
+static void alarm_handler(int sig __used)
+{
+	done = 1;
+}
+
+int bench_futex_hash(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	struct timeval start, stop, diff;
+	unsigned long long total_ops = 0, min_ops = ~0ULL, max_ops = 0;
+	unsigned long long runtime_usec;
+	struct worker *worker;
+	unsigned int i;
+
+	argc = parse_options(argc, argv, options,
+			     bench_futex_hash_usage, 0);
+	if (argc)
+		usage_with_options(bench_futex_hash_usage, options);
+
+	if (!nthreads)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (!nfutexes || !nsecs)
+		usage_with_options(bench_futex_hash_usage, options);
+
+	if (!fshared)
+		futex_flag = FUTEX_PRIVATE_FLAG;
+
+	worker = calloc(nthreads, sizeof(*worker));
+	if (!worker)
+		die("calloc");
+
+	signal(SIGALRM, alarm_handler);
+
+	pthread_mutex_init(&thread_lock, NULL);
+	pthread_cond_init(&thread_parent, NULL);
+	pthread_cond_init(&thread_worker, NULL);
+
+	threads_starting = nthreads;
+	for (i = 0; i < nthreads; i++) {
+		worker[i].futex = calloc(nfutexes, sizeof(*worker[i].futex));
+		if (!worker[i].futex)
+			die("calloc");
+		if (pthread_create(&worker[i].thread, NULL, workerfn,
+				   &worker[i]))
+			die("pthread_create");
+	}
+
+	pthread_mutex_lock(&thread_lock);
+	while (threads_starting)
+		pthread_cond_wait(&thread_parent, &thread_lock);
+	pthread_cond_broadcast(&thread_worker);
+	pthread_mutex_unlock(&thread_lock);
+
+	gettimeofday(&start, NULL);
+	alarm(nsecs);
+
+	for (i = 0; i < nthreads; i++)
+		if (pthread_join(worker[i].thread, NULL))
+			die("pthread_join");
+
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+	runtime_usec = diff.tv_sec * 1000000ULL + diff.tv_usec;
+
+	for (i = 0; i < nthreads; i++) {
+		total_ops += worker[i].ops;
+		if (worker[i].ops < min_ops)
+			min_ops = worker[i].ops;
+		if (worker[i].ops > max_ops)
+			max_ops = worker[i].ops;
+		free(worker[i].futex);
+	}
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %u threads, %u %s futexes each, %u secs\n\n",
+		       nthreads, nfutexes, fshared ? "shared" : "private",
+		       nsecs);
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec, (unsigned long) (diff.tv_usec/1000));
+
+		printf(" %14.0lf ops/sec total\n",
+		       (double)total_ops * 1000000 / (double)runtime_usec);
+		printf(" %14.0lf ops/sec per thread (min %.0lf, max %.0lf)\n",
+		       (double)total_ops * 1000000 /
+		       (double)runtime_usec / nthreads,
+		       (double)min_ops * 1000000 / (double)runtime_usec,
+		       (double)max_ops * 1000000 / (double)runtime_usec);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.0lf\n",
+		       (double)total_ops * 1000000 / (double)runtime_usec);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	free(worker);
+	return 0;
+}
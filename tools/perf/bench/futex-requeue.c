@@ -0,0 +1,183 @@
+/*
+ *
+ * futex-requeue.c
+ *
+ * requeue: Measure FUTEX_CMP_REQUEUE latency
+ *
+ * A number of threads block on one futex, then the main thread moves
+ * them all to a second futex (waking nwakes of them on the way), the
+ * way a condition variable broadcast does, and measures how long the
+ * requeue takes.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+#include "futex.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+static unsigned int nthreads;
+static unsigned int nwakes = 1;
+static unsigned int nrepeat = 10;
+static bool fshared;
+
+static u_int32_t futex1, futex2;
+static int futex_flag;
+
+static pthread_mutex_t thread_lock;
+static pthread_cond_t thread_parent, thread_worker;
+static unsigned int threads_starting;
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads,
+		     "Specify amount of threads (default: online cpus)"),
+	OPT_UINTEGER('w', "nwakes", &nwakes,
+		     "Specify amount of threads to wake while requeueing"),
+	OPT_UINTEGER('r', "repeat", &nrepeat,
+		     "Specify amount of times to repeat the run"),
+	OPT_BOOLEAN('S', "shared", &fshared,
+		    "Use shared futexes instead of private ones"),
+	OPT_END()
+};
+
+static const char * const bench_futex_requeue_usage[] = {
+	"perf bench futex requeue <options>",
+	NULL
+};
+
+static void *workerfn(void *arg __used)
+{
+	pthread_mutex_lock(&thread_lock);
+	threads_starting--;
+	if (!threads_starting)
+		pthread_cond_signal(&thread_parent);
+	pthread_cond_wait(&thread_worker, &thread_lock);
+	pthread_mutex_unlock(&thread_lock);
+
+	/* woken either on futex1 by the requeue, or later on futex2 */
+	while (futex_wait(&futex1, 0, NULL, futex_flag) == -1 &&
+	       errno == EINTR)
+		;
+
+	return NULL;
+}
+
+static void block_threads(pthread_t *w)
+{
+	unsigned int i;
+
+	threads_starting = nthreads;
+	for (i = 0; i < nthreads; i++)
+		if (pthread_create(&w[i], NULL, workerfn, NULL))
+			die("pthread_create");
+
+	pthread_mutex_lock(&thread_lock);
+	while (threads_starting)
+		pthread_cond_wait(&thread_parent, &thread_lock);
+	pthread_cond_broadcast(&thread_worker);
+	pthread_mutex_unlock(&thread_lock);
+
+	/* give the workers a chance to actually block on the futex */
+	usleep(100000);
+}
+
+int bench_futex_requeue(int argc, const char **argv,
+			const char *prefix __used)
+{
+	struct timeval start, stop, diff;
+	unsigned long long runtime_usec, total_usec = 0;
+	unsigned int i, j, nrequeued, nwoken;
+	pthread_t *worker;
+	int ret;
+
+	argc = parse_options(argc, argv, options,
+			     bench_futex_requeue_usage, 0);
+	if (argc)
+		usage_with_options(bench_futex_requeue_usage, options);
+
+	if (!nthreads)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (!nrepeat)
+		usage_with_options(bench_futex_requeue_usage, options);
+	if (nwakes > nthreads)
+		nwakes = nthreads;
+
+	if (!fshared)
+		futex_flag = FUTEX_PRIVATE_FLAG;
+
+	worker = calloc(nthreads, sizeof(*worker));
+	if (!worker)
+		die("calloc");
+
+	pthread_mutex_init(&thread_lock, NULL);
+	pthread_cond_init(&thread_parent, NULL);
+	pthread_cond_init(&thread_worker, NULL);
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# %u threads requeued between two %s futexes, waking "
+		       "%u\n\n", nthreads, fshared ? "shared" : "private",
+		       nwakes);
+
+	for (j = 0; j < nrepeat; j++) {
+		block_threads(worker);
+
+		nrequeued = nwoken = 0;
+		gettimeofday(&start, NULL);
+		/* the return value counts both woken and requeued tasks */
+		while (nrequeued < nthreads) {
+			ret = futex_cmp_requeue(&futex1, 0, &futex2, nwakes,
+						nthreads, futex_flag);
+			if (ret < 0)
+				die("futex_cmp_requeue");
+			nrequeued += ret;
+			/* the first nwakes tasks are woken, not requeued */
+			nwoken += (unsigned int)ret < nwakes ? (unsigned int)ret : nwakes;
+		}
+		gettimeofday(&stop, NULL);
+
+		timersub(&stop, &start, &diff);
+		runtime_usec = diff.tv_sec * 1000000ULL + diff.tv_usec;
+		total_usec += runtime_usec;
+
+		if (bench_format == BENCH_FORMAT_DEFAULT)
+			printf(" [Run %u]: requeued %u threads in %.4f ms\n",
+			       j + 1, nrequeued, runtime_usec / 1000.0);
+
+		/* everybody not woken yet is now on futex2 */
+		while (nwoken < nthreads)
+			nwoken += futex_wake(&futex2, nthreads, futex_flag);
+
+		for (i = 0; i < nthreads; i++)
+			if (pthread_join(worker[i], NULL))
+				die("pthread_join");
+	}
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("\n %14.4f ms average to requeue %u threads\n",
+		       total_usec / 1000.0 / nrepeat, nthreads);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.4f\n", total_usec / 1000.0 / nrepeat);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	free(worker);
+	return 0;
+}
@@ -0,0 +1,169 @@
+/*
+ *
+ * futex-wake.c
+ *
+ * wake: Measure FUTEX_WAKE latency
+ *
+ * A number of threads block on a single futex, then the main thread
+ * wakes them nwakes at a time and measures how long waking all of them
+ * takes. This is repeated a few times to smooth out the noise.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+#include "futex.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+static unsigned int nthreads;
+static unsigned int nwakes = 1;
+static unsigned int nrepeat = 10;
+static bool fshared;
+
+static u_int32_t futex1;
+static int futex_flag;
+
+static pthread_mutex_t thread_lock;
+static pthread_cond_t thread_parent, thread_worker;
+static unsigned int threads_starting;
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads,
+		     "Specify amount of threads (default: online cpus)"),
+	OPT_UINTEGER('w', "nwakes", &nwakes,
+		     "Specify amount of threads to wake at once"),
+	OPT_UINTEGER('r', "repeat", &nrepeat,
+		     "Specify amount of times to repeat the run"),
+	OPT_BOOLEAN('S', "shared", &fshared,
+		    "Use shared futexes instead of private ones"),
+	OPT_END()
+};
+
+static const char * const bench_futex_wake_usage[] = {
+	"perf bench futex wake <options>",
+	NULL
+};
+
+static void *workerfn(void *arg __used)
+{
+	pthread_mutex_lock(&thread_lock);
+	threads_starting--;
+	if (!threads_starting)
+		pthread_cond_signal(&thread_parent);
+	pthread_cond_wait(&thread_worker, &thread_lock);
+	pthread_mutex_unlock(&thread_lock);
+
+	/* only an explicit FUTEX_WAKE may end the wait */
+	while (futex_wait(&futex1, 0, NULL, futex_flag) == -1 &&
+	       errno == EINTR)
+		;
+
+	return NULL;
+}
+
+static void block_threads(pthread_t *w)
+{
+	unsigned int i;
+
+	threads_starting = nthreads;
+	for (i = 0; i < nthreads; i++)
+		if (pthread_create(&w[i], NULL, workerfn, NULL))
+			die("pthread_create");
+
+	pthread_mutex_lock(&thread_lock);
+	while (threads_starting)
+		pthread_cond_wait(&thread_parent, &thread_lock);
+	pthread_cond_broadcast(&thread_worker);
+	pthread_mutex_unlock(&thread_lock);
+
+	/* give the workers a chance to actually block on the futex */
+	usleep(100000);
+}
+
+int bench_futex_wake(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	struct timeval start, stop, diff;
+	unsigned long long runtime_usec, total_usec = 0;
+	unsigned int i, j, nwoken;
+	pthread_t *worker;
+
+	argc = parse_options(argc, argv, options,
+			     bench_futex_wake_usage, 0);
+	if (argc)
+		usage_with_options(bench_futex_wake_usage, options);
+
+	if (!nthreads)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (!nwakes || !nrepeat)
+		usage_with_options(bench_futex_wake_usage, options);
+
+	if (!fshared)
+		futex_flag = FUTEX_PRIVATE_FLAG;
+
+	worker = calloc(nthreads, sizeof(*worker));
+	if (!worker)
+		die("calloc");
+
+	pthread_mutex_init(&thread_lock, NULL);
+	pthread_cond_init(&thread_parent, NULL);
+	pthread_cond_init(&thread_worker, NULL);
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# %u threads waiting on a %s futex, waking %u at a "
+		       "time\n\n", nthreads, fshared ? "shared" : "private",
+		       nwakes);
+
+	for (j = 0; j < nrepeat; j++) {
+		block_threads(worker);
+
+		nwoken = 0;
+		gettimeofday(&start, NULL);
+		while (nwoken != nthreads)
+			nwoken += futex_wake(&futex1, nwakes, futex_flag);
+		gettimeofday(&stop, NULL);
+
+		timersub(&stop, &start, &diff);
+		runtime_usec = diff.tv_sec * 1000000ULL + diff.tv_usec;
+		total_usec += runtime_usec;
+
+		if (bench_format == BENCH_FORMAT_DEFAULT)
+			printf(" [Run %u]: woke %u threads in %.4f ms\n",
+			       j + 1, nwoken, runtime_usec / 1000.0);
+
+		for (i = 0; i < nthreads; i++)
+			if (pthread_join(worker[i], NULL))
+				die("pthread_join");
+	}
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("\n %14.4f ms average to wake %u threads\n",
+		       total_usec / 1000.0 / nrepeat, nthreads);
+		printf(" %14.4f usecs/wake\n",
+		       (double)total_usec / nrepeat / nthreads);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.4f\n", total_usec / 1000.0 / nrepeat);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	free(worker);
+	return 0;
+}
@@ -0,0 +1,57 @@
+/*
+ * futex.h
+ *
+ * Thin wrappers around the futex syscall for the futex benchmarks,
+ * glibc does not provide any.
+ */
+
+#ifndef _FUTEX_H
+#define _FUTEX_H
+
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <linux/futex.h>
+
+static inline int
+sys_futex(u_int32_t *uaddr, int op, u_int32_t val, struct timespec *timeout,
+	  u_int32_t *uaddr2, u_int32_t val3, int opflags)
+{
+	return syscall(SYS_futex, uaddr, op | opflags, val, timeout,
+		       uaddr2, val3);
+}
+
+/*
+ * futex_wait() - block on uaddr with optional timeout, returns at once
+ * with EWOULDBLOCK if *uaddr != val
+ */
+static inline int
+futex_wait(u_int32_t *uaddr, u_int32_t val, struct timespec *timeout,
+	   int opflags)
+{
+	return sys_futex(uaddr, FUTEX_WAIT, val, timeout, NULL, 0, opflags);
+}
+
+/*
+ * futex_wake() - wake up to nr_wake waiters on uaddr, returns the number
+ * of tasks woken
+ */
+static inline int futex_wake(u_int32_t *uaddr, int nr_wake, int opflags)
+{
+	return sys_futex(uaddr, FUTEX_WAKE, nr_wake, NULL, NULL, 0, opflags);
+}
+
+/*
+ * futex_cmp_requeue() - wake up to nr_wake waiters on uaddr and move up
+ * to nr_requeue of the others to uaddr2, as long as *uaddr == val
+ */
+static inline int
+futex_cmp_requeue(u_int32_t *uaddr, u_int32_t val, u_int32_t *uaddr2,
+		  int nr_wake, int nr_requeue, int opflags)
+{
+	return sys_futex(uaddr, FUTEX_CMP_REQUEUE, nr_wake,
+			 (struct timespec *)(long)nr_requeue, uaddr2, val,
+			 opflags);
+}
+
+#endif /* _FUTEX_H */
@@ -0,0 +1,276 @@
+/*
+ * Slubbench: measure slab allocations that get freed on other cpus
+ *
+ * Pairs of threads are bound to two cpus each, a sender and a receiver,
+ * and connected by a unix seqpacket socket.  Every message the sender
+ * writes costs an object from skbuff_head_cache and a kmalloc for its
+ * data, allocated on the sender's cpu; the receiver frees both on its
+ * own cpu when it reads the message.  That is the pattern that sends
+ * frees to slabs that are not the cpu slab of the freeing processor and
+ * therefore exercises the partial slab handling of the allocator.
+ *
+ * The rate of alloc/free pairs is reported, together with the changes of
+ * the statistics of the slab cache given with -c if the kernel has been
+ * built with CONFIG_SLUB_STATS.
+ *
+ * Compile by:
+ *
+ * gcc -o slubbench slubbench.c -lpthread
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+static int nr_pairs;
+static int distance = -1;
+static int msg_size = 64;
+static int nsecs = 5;
+static const char *cache = "skbuff_head_cache";
+
+static volatile int done;
+static int nr_cpus;
+
+struct pair {
+	pthread_t sender, receiver;
+	int cpu_send, cpu_recv;
+	int fd[2];
+	unsigned long long msgs;
+};
+
+static const char * const stat_items[] = {
+	"alloc_fastpath",
+	"alloc_slowpath",
+	"free_fastpath",
+	"free_slowpath",
+	"alloc_from_partial",
+	"free_add_partial",
+	"cpu_partial_alloc",
+	"cpu_partial_free",
+	"cpu_partial_node",
+	"cpu_partial_drain",
+};
+#define NR_STAT_ITEMS	(sizeof(stat_items) / sizeof(stat_items[0]))
+
+static void fatal(const char *x)
+{
+	perror(x);
+	exit(1);
+}
+
+static void usage(void)
+{
+	printf("slubbench [-p pairs] [-d distance] [-s size] [-t secs] "
+		"[-c cache]\n\n"
+		"-p|--pairs <n>      Sender/receiver pairs (default cpus / 2)\n"
+		"-d|--distance <n>   Receiver runs on cpu sender + n "
+		"(default cpus / 2, 0 frees locally)\n"
+		"-s|--size <bytes>   Message size (default 64)\n"
+		"-t|--time <secs>    Duration of the run (default 5)\n"
+		"-c|--cache <name>   Slab cache whose statistics are shown "
+		"(default skbuff_head_cache)\n");
+	exit(1);
+}
+
+/* first number of a /sys/kernel/slab statistics file, -1 if missing */
+static long long read_stat(const char *item)
+{
+	char path[256];
+	long long val;
+	FILE *f;
+
+	snprintf(path, sizeof(path), "/sys/kernel/slab/%s/%s", cache, item);
+	f = fopen(path, "r");
+	if (!f)
+		return -1;
+	if (fscanf(f, "%lld", &val) != 1)
+		val = -1;
+	fclose(f);
+	return val;
+}
+
+static void read_stats(long long *vals)
+{
+	unsigned int i;
+
+	for (i = 0; i < NR_STAT_ITEMS; i++)
+		vals[i] = read_stat(stat_items[i]);
+}
+
+static void bind_cpu(int cpu)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (sched_setaffinity(0, sizeof(set), &set))
+		fatal("sched_setaffinity");
+}
+
+static void *sender(void *arg)
+{
+	struct pair *p = arg;
+	char *buf;
+
+	bind_cpu(p->cpu_send);
+	buf = calloc(1, msg_size);
+	if (!buf)
+		fatal("calloc");
+
+	while (!done) {
+		if (send(p->fd[0], buf, msg_size, 0) < 0 && errno != EINTR)
+			fatal("send");
+	}
+	shutdown(p->fd[0], SHUT_WR);
+	free(buf);
+	return NULL;
+}
+
+static void *receiver(void *arg)
+{
+	struct pair *p = arg;
+	ssize_t len;
+	char *buf;
+
+	bind_cpu(p->cpu_recv);
+	buf = malloc(msg_size);
+	if (!buf)
+		fatal("malloc");
+
+	for (;;) {
+		len = recv(p->fd[1], buf, msg_size, 0);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			fatal("recv");
+		}
+		if (!len)
+			break;
+		p->msgs++;
+	}
+	free(buf);
+	return NULL;
+}
+
+static void alarm_handler(int sig)
+{
+	done = 1;
+}
+
+int main(int argc, char *argv[])
+{
+	long long before[NR_STAT_ITEMS], after[NR_STAT_ITEMS];
+	unsigned long long total = 0;
+	struct timeval start, stop;
+	struct pair *pairs;
+	double secs;
+	unsigned int j;
+	int c, i;
+
+	struct option opts[] = {
+		{ "pairs", 1, NULL, 'p' },
+		{ "distance", 1, NULL, 'd' },
+		{ "size", 1, NULL, 's' },
+		{ "time", 1, NULL, 't' },
+		{ "cache", 1, NULL, 'c' },
+		{ "help", 0, NULL, 'h' },
+		{ NULL, 0, NULL, 0 }
+	};
+
+	while ((c = getopt_long(argc, argv, "p:d:s:t:c:h",
+						opts, NULL)) != -1)
+		switch (c) {
+		case 'p':
+			nr_pairs = atoi(optarg);
+			break;
+		case 'd':
+			distance = atoi(optarg);
+			break;
+		case 's':
+			msg_size = atoi(optarg);
+			break;
+		case 't':
+			nsecs = atoi(optarg);
+			break;
+		case 'c':
+			cache = optarg;
+			break;
+		default:
+			usage();
+		}
+
+	nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nr_pairs <= 0)
+		nr_pairs = nr_cpus / 2 ? nr_cpus / 2 : 1;
+	if (distance < 0)
+		distance = nr_cpus / 2;
+	if (msg_size <= 0 || nsecs <= 0)
+		usage();
+
+	pairs = calloc(nr_pairs, sizeof(*pairs));
+	if (!pairs)
+		fatal("calloc");
+
+	for (i = 0; i < nr_pairs; i++) {
+		pairs[i].cpu_send = i % nr_cpus;
+		pairs[i].cpu_recv = (i + distance) % nr_cpus;
+		if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, pairs[i].fd))
+			fatal("socketpair");
+	}
+
+	signal(SIGALRM, alarm_handler);
+	read_stats(before);
+	gettimeofday(&start, NULL);
+	alarm(nsecs);
+
+	for (i = 0; i < nr_pairs; i++) {
+		if (pthread_create(&pairs[i].receiver, NULL, receiver,
+				   &pairs[i]) ||
+		    pthread_create(&pairs[i].sender, NULL, sender, &pairs[i]))
+			fatal("pthread_create");
+	}
+	for (i = 0; i < nr_pairs; i++) {
+		pthread_join(pairs[i].sender, NULL);
+		pthread_join(pairs[i].receiver, NULL);
+		total += pairs[i].msgs;
+	}
+
+	gettimeofday(&stop, NULL);
+	read_stats(after);
+	secs = (stop.tv_sec - start.tv_sec) +
+	       (stop.tv_usec - start.tv_usec) / 1e6;
+
+	printf("%d pairs, receiver at cpu + %d, %d byte messages, %.2f s\n",
+		nr_pairs, distance, msg_size, secs);
+	for (i = 0; i < nr_pairs; i++)
+		printf("  cpu %3d -> cpu %3d %12llu\n", pairs[i].cpu_send,
+			pairs[i].cpu_recv, pairs[i].msgs);
+	printf("Alloc/free pairs     %12llu\n", total);
+	printf("Pairs per second     %12.0f\n", total / secs);
+	if (total)
+		printf("ns per pair and cpu  %12.1f\n",
+			secs * 1e9 * nr_pairs / total);
+
+	if (before[0] < 0) {
+		printf("\nNo statistics for %s, "
+			"kernel built without CONFIG_SLUB_STATS?\n", cache);
+		return 0;
+	}
+
+	printf("\nSlab cache %s\n", cache);
+	for (j = 0; j < NR_STAT_ITEMS; j++) {
+		if (before[j] < 0 || after[j] < 0)
+			continue;
+		printf("%-20s %12lld\n", stat_items[j], after[j] - before[j]);
+	}
+	return 0;
+}